@@ -24,11 +24,50 @@
 
 #include "Adafruit_OPT4048.h"
 
+#ifdef OPT4048_INSTRUMENTATION
+// Time the enclosing method and count its bus traffic
+#define OPT4048_TRACE(call) CallTrace _trace(this, call)
+#else
+#define OPT4048_TRACE(call)
+#endif
+
 /**
  * @brief Construct a new Adafruit_OPT4048 object.
  */
 Adafruit_OPT4048::Adafruit_OPT4048() {
   i2c_dev = nullptr;
+  _wire = nullptr;
+  _config_reg = 0;
+  _threshold_cfg_reg = 0;
+  _last_counter = -1;
+  _sample_status = OPT4048_SAMPLE_NEW;
+  _missed_samples = 0;
+  _total_missed_samples = 0;
+  _crc_retry_limit = 0;
+  _crc_deadline = 0;
+  _crc_retry_count = 0;
+  _crc_give_up_count = 0;
+  _async_channels = 0;
+  _async_ready = false;
+  _async_due = 0;
+  _callback = nullptr;
+  opt4048_prepareCalibration(nullptr, &_calibration);
+  _int_time = 0;
+  _int_pending = false;
+  _dup_time = 0;
+  _have_dup = false;
+  _sample_time = 0;
+  resetTimingStats();
+  _track_band = 0;
+  _track_channel = 0;
+  _track_window[0] = _track_window[1] = 0;
+  _track_latch = true;
+  _track_int_cfg = OPT4048_INT_CFG_DATA_READY_ALL;
+#ifdef OPT4048_INSTRUMENTATION
+  _active_call = OPT4048_CALL_COUNT;
+  _call_start = 0;
+  resetCallStats();
+#endif
 }
 
 /**
@@ -44,15 +83,18 @@ Adafruit_OPT4048::~Adafruit_OPT4048() {
 /**
  * @brief Initialize the OPT4048 sensor over I2C.
  *
- * Deletes any existing I2C device instance, then creates a new one.
+ * Deletes any existing I2C device instance, then creates a new one. See
+ * resume() for a faster start when waking from sleep.
  *
  * @return true if initialization was successful, false otherwise.
  */
 bool Adafruit_OPT4048::begin(uint8_t addr, TwoWire* wire) {
+  OPT4048_TRACE(OPT4048_CALL_BEGIN);
   // Clean up old instance if reinitializing
   if (i2c_dev) {
     delete i2c_dev;
     i2c_dev = nullptr;
+    _wire = nullptr;
   }
 
   // Create I2C device
@@ -60,6 +102,7 @@ bool Adafruit_OPT4048::begin(uint8_t addr, TwoWire* wire) {
   if (!i2c_dev) {
     return false;
   }
+  _wire = wire;
 
   if (!i2c_dev->begin()) {
     return false;
@@ -67,580 +110,1032 @@ bool Adafruit_OPT4048::begin(uint8_t addr, TwoWire* wire) {
 
   // Verify device ID to ensure correct chip is connected
   {
-    Adafruit_BusIO_Register idreg(i2c_dev, OPT4048_REG_DEVICE_ID, 2, MSBFIRST);
-    uint16_t id = idreg.read();
+    uint16_t id;
 
     // Default reset device ID is 0x0821
-    if (id != 0x0821) {
+    if (!readRegisters(OPT4048_REG_DEVICE_ID, &id, 1) || id != 0x0821) {
       return false;
     }
   }
 
-  // Set interrupt direction to default (high threshold active)
-  // Even though this is the device default, we set it explicitly for clarity
-  setInterruptDirection(true);
-
-  // Set interrupt configuration to "data ready for all channels"
-  setInterruptConfig(OPT4048_INT_CFG_DATA_READY_ALL);
+  // Fill the cached copies of the configuration registers so the
+  // interrupt settings below only need a write
+  if (!resync()) {
+    return false;
+  }
 
-  setInterruptLatch(true);    // Use latched interrupts
-  setInterruptPolarity(true); // Use active-high interrupts
-  setInterruptConfig(OPT4048_INT_CFG_DATA_READY_ALL);
+  resetState();
+
+  // INT as an output (INT_DIR) signalling data ready for all channels,
+  // latched and active high. All four settings go out in one burst, and
+  // not at all if the device already has them.
+  uint16_t regs[2];
+  regs[0] = _config_reg | 0x000C; // LATCH, INT_POL
+  regs[1] = (_threshold_cfg_reg & ~0x001C) | 0x0010 |
+            ((uint16_t)OPT4048_INT_CFG_DATA_READY_ALL << 2);
+  if (regs[0] == _config_reg && regs[1] == _threshold_cfg_reg) {
+    return true;
+  }
+  if (!writeRegisters(OPT4048_REG_CONFIG, regs, 2)) {
+    return false;
+  }
 
+  _config_reg = regs[0];
+  _threshold_cfg_reg = regs[1];
   return true;
 }
 
 /**
- * @brief Read all four channels, verify CRC, and return raw ADC code values.
- *
- * Reads registers for channels 0-3 in one burst, checks the CRC bits for each,
- * and computes the 20-bit ADC code = mantissa << exponent.
- *
- * @return true if read succeeds and all CRC checks pass, false otherwise.
+ * @brief Restore a saved configuration with as little bus traffic as
+ * possible
+ *
+ * A faster alternative to begin() for nodes that wake from sleep every few
+ * seconds. begin() probes the address, reads the device ID and the
+ * configuration registers and then writes the interrupt settings. This
+ * skips the probe and, unless asked for, the ID check, and writes both
+ * thresholds and both configuration registers from words saved by
+ * suspend() in a single burst. That single transaction is all it costs,
+ * and in the one-shot modes it also starts the first conversion, so a
+ * sample can be read after getMeasurementTime().
+ *
+ * The I2C device from an earlier begin() or resume() on the same address
+ * and bus is reused instead of allocating a new one.
+ *
+ * @param words The 4 register words for 0x08 to 0x0B from suspend() or an
+ * Adafruit_OPT4048_Config, or nullptr to keep the device's configuration
+ * and only read it back
+ * @param addr I2C address, defaults to OPT4048_DEFAULT_ADDR
+ * @param wire Pointer to TwoWire instance, defaults to &Wire
+ * @param checkID Read the device ID and fail if it isn't an OPT4048
+ * @return true on success, false on failure
  */
-bool Adafruit_OPT4048::getChannelsRaw(uint32_t* ch0, uint32_t* ch1,
-                                      uint32_t* ch2, uint32_t* ch3) {
+bool Adafruit_OPT4048::resume(const uint16_t* words, uint8_t addr,
+                              TwoWire* wire, bool checkID) {
+  OPT4048_TRACE(OPT4048_CALL_RESUME);
+  if (i2c_dev && (i2c_dev->address() != addr || _wire != wire)) {
+    delete i2c_dev;
+    i2c_dev = nullptr;
+  }
   if (!i2c_dev) {
-    return false;
+    i2c_dev = new Adafruit_I2CDevice(addr, wire);
+    if (!i2c_dev) {
+      return false;
+    }
+    _wire = wire;
   }
-  uint8_t buf[16];
-  uint8_t reg = OPT4048_REG_CH0_MSB;
-  if (!i2c_dev->write_then_read(&reg, 1, buf, sizeof(buf))) {
+
+  // No address probe, the first transfer fails if nothing answers
+  if (!i2c_dev->begin(false)) {
     return false;
   }
 
-  for (uint8_t ch = 0; ch < 4; ch++) {
-    uint8_t exp = (uint16_t)buf[4 * ch] >> 4;
-    uint16_t msb = (((uint16_t)(buf[4 * ch] & 0xF)) << 8) | buf[4 * ch + 1];
-    uint16_t lsb = ((uint16_t)buf[4 * ch + 2]);
-    uint8_t counter = buf[4 * ch + 3] >> 4;
-    uint8_t crc = buf[4 * ch + 3] & 0xF;
-
-    uint32_t mant = ((uint32_t)msb << 8) | lsb;
-
-    /*
-// Debug output for each channel
-Serial.print(F("DEBUG: CH"));
-Serial.print(ch);
-Serial.print(F(": MSB=0x"));
-Serial.print(msb, HEX);
-Serial.print(F(", LSB=0x"));
-Serial.print(lsb, HEX);
-Serial.print(F(", count="));
-Serial.print(counter);
-Serial.print(F(", crc="));
-Serial.print(crc);
-Serial.print(F(", exp="));
-Serial.print(exp);
-Serial.print(F(", mant=0x"));
-Serial.println(mant, HEX);
-*/
-
-    // Implementing CRC check based on the formula from the datasheet:
-    // CRC bits for each channel:
-    // R[19:0]=(RESULT_MSB_CH0[11:0]<<8)+RESULT_LSB_CH0[7:0]
-    // X[0]=XOR(EXPONENT_CH0[3:0],R[19:0],COUNTER_CHx[3:0]) - XOR of all bits
-    // X[1]=XOR(COUNTER_CHx[1],COUNTER_CHx[3],R[1],R[3],R[5],R[7],R[9],R[11],R[13],R[15],R[17],R[19],E[1],E[3])
-    // X[2]=XOR(COUNTER_CHx[3],R[3],R[7],R[11],R[15],R[19],E[3])
-    // X[3]=XOR(R[3],R[11],R[19])
-
-    // Note: COUNTER_CHx[3:0] is the CRC itself, which creates a circular
-    // reference We need to include it in our calculations to match the hardware
-    // implementation
-
-    // Initialize CRC variables
-    uint8_t x0 = 0; // CRC bit 0
-    uint8_t x1 = 0; // CRC bit 1
-    uint8_t x2 = 0; // CRC bit 2
-    uint8_t x3 = 0; // CRC bit 3
-
-    // Calculate each CRC bit according to the datasheet formula:
-    // Calculate bit 0 (x0):
-    // X[0]=XOR(EXPONENT_CH0[3:0],R[19:0],COUNTER_CHx[3:0])
-    x0 = 0;
-
-    // XOR all exponent bits
-    for (uint8_t i = 0; i < 4; i++) {
-      x0 ^= (exp >> i) & 1;
-    }
-
-    // XOR all mantissa bits
-    for (uint8_t i = 0; i < 20; i++) {
-      x0 ^= (mant >> i) & 1;
-    }
-
-    // XOR all counter (CRC) bits
-    for (uint8_t i = 0; i < 4; i++) {
-      x0 ^= (counter >> i) & 1;
-    }
-
-    // Calculate bit 1 (x1) per datasheet:
-    // X[1]=XOR(COUNTER_CHx[1],COUNTER_CHx[3],R[1],R[3],R[5],R[7],R[9],R[11],R[13],R[15],R[17],R[19],E[1],E[3])
-    x1 = 0;
-    // Include counter bits 1 and 3
-    x1 ^= (counter >> 1) & 1; // COUNTER_CHx[1]
-    x1 ^= (counter >> 3) & 1; // COUNTER_CHx[3]
-
-    // Include odd-indexed mantissa bits
-    for (uint8_t i = 1; i < 20; i += 2) {
-      x1 ^= (mant >> i) & 1;
-    }
-
-    // Include exponent bits 1 and 3
-    x1 ^= (exp >> 1) & 1; // E[1]
-    x1 ^= (exp >> 3) & 1; // E[3]
-
-    // Calculate bit 2 (x2) per datasheet:
-    // X[2]=XOR(COUNTER_CHx[3],R[3],R[7],R[11],R[15],R[19],E[3])
-    x2 = 0;
-    // Include counter bit 3
-    x2 ^= (counter >> 3) & 1; // COUNTER_CHx[3]
-
-    // Include mantissa bits at positions 3,7,11,15,19
-    for (uint8_t i = 3; i < 20; i += 4) {
-      x2 ^= (mant >> i) & 1;
-    }
-
-    // Include exponent bit 3
-    x2 ^= (exp >> 3) & 1; // E[3]
-
-    // Calculate bit 3 (x3) per datasheet:
-    // X[3]=XOR(R[3],R[11],R[19])
-    x3 = 0;
-    // XOR mantissa bits at positions 3, 11, 19
-    x3 ^= (mant >> 3) & 1;  // R[3]
-    x3 ^= (mant >> 11) & 1; // R[11]
-    x3 ^= (mant >> 19) & 1; // R[19]
-
-    // Combine bits to form the CRC
-    uint8_t calculated_crc = (x3 << 3) | (x2 << 2) | (x1 << 1) | x0;
-
-    // Verify CRC
-    if (crc != calculated_crc) {
-      // Serial.print(F("DEBUG: CRC check failed for channel "));
-      // Serial.println(ch);
+  if (checkID) {
+    uint16_t id;
+    if (!readRegisters(OPT4048_REG_DEVICE_ID, &id, 1) || id != 0x0821) {
       return false;
     }
-
-    // Convert to 20-bit mantissa << exponent format
-    // This is safe because the sensor only uses exponents 0-6 in actual
-    // measurements (even when auto-range mode (12) is enabled in the
-    // configuration register)
-    uint32_t output = (uint32_t)mant << (uint32_t)exp;
-
-    // Assign output
-    switch (ch) {
-      case 0:
-        *ch0 = output;
-        break;
-      case 1:
-        *ch1 = output;
-        break;
-      case 2:
-        *ch2 = output;
-        break;
-      case 3:
-        *ch3 = output;
-        break;
-    }
   }
-  // Serial.println(F("DEBUG: All channel reads successful"));
-  return true;
+
+  resetState();
+  return words ? setConfigWords(words) : resync();
 }
 
 /**
- * @brief Get the current low threshold value
+ * @brief Save the configuration for resume() before the host sleeps
  *
- * Reads the low threshold register (0x08) and converts the exponent/mantissa
- * format to a single 32-bit value.
+ * Reads both thresholds and both configuration registers in one burst.
+ * Keep the words somewhere that survives the sleep, e.g. RTC memory.
  *
- * As per page 18 of the datasheet, threshold calculation is:
- * ADC_CODES_TL = THRESHOLD_L_RESULT << (8 + THRESHOLD_L_EXPONENT)
+ * The saved mode is the one last set through the driver, since in the
+ * one-shot modes the device reads back as powered down once a conversion
+ * is done.
  *
- * @return The current low threshold value
+ * With quickWake in one of the one-shot modes, QWAKE is also set on the
+ * device and in the saved words: the sensor then keeps some circuits
+ * powered in standby and converts sooner after the next wake, for a little
+ * more standby current. It is set with the device powered down, so no
+ * conversion is started on the way into sleep.
+ *
+ * @param words Array to store the 4 register words for 0x08 to 0x0B in
+ * @param quickWake Enable Quick Wake-up in the one-shot modes
+ * @return true on success, false on failure
  */
-uint32_t Adafruit_OPT4048::getThresholdLow(void) {
-  if (!i2c_dev) {
-    return 0;
+bool Adafruit_OPT4048::suspend(uint16_t* words, bool quickWake) {
+  OPT4048_TRACE(OPT4048_CALL_SUSPEND);
+  if (!i2c_dev || !words) {
+    return false;
   }
 
-  // Create the register object for the threshold register
-  Adafruit_BusIO_Register threshold_reg(i2c_dev, OPT4048_REG_THRESHOLD_LOW, 2,
-                                        MSBFIRST);
-
-  // Create register bits for the exponent (top 4 bits) and mantissa (lower 12
-  // bits)
-  Adafruit_BusIO_RegisterBits exponent_bits(&threshold_reg, 4, 12);
-  Adafruit_BusIO_RegisterBits mantissa_bits(&threshold_reg, 12, 0);
+  if (!readRegisters(OPT4048_REG_THRESHOLD_LOW, words, 4)) {
+    return false;
+  }
 
-  // Read the exponent and mantissa
-  uint8_t exponent = exponent_bits.read();
-  uint32_t mantissa = mantissa_bits.read();
+  // After a one-shot conversion CONFIG reads back as power-down, so the
+  // mode to save is the one last set, not the one read
+  uint16_t config = _config_reg;
+  opt4048_mode_t mode = (opt4048_mode_t)((config >> 4) & 0x03);
+  bool oneShot =
+      mode == OPT4048_MODE_ONESHOT || mode == OPT4048_MODE_AUTO_ONESHOT;
+  if (quickWake && oneShot) {
+    config |= 0x8000;
+
+    // Set QWAKE in power-down, since writing a one-shot MODE would start a
+    // conversion
+    uint16_t standby = config & ~0x0030;
+    if (words[2] != standby &&
+        !writeRegisters(OPT4048_REG_CONFIG, &standby, 1)) {
+      return false;
+    }
+  }
 
-  // Calculate ADC code value by applying the exponent as a bit shift
-  // ADD 8 to the exponent as per datasheet equations 12-13
-  return mantissa << (8 + exponent);
+  words[2] = config;
+  _config_reg = config;
+  _threshold_cfg_reg = words[3];
+  return true;
 }
 
 /**
- * @brief Set the low threshold value for interrupt generation
+ * @brief Get the I2C bus the sensor was begun on
  *
- * Configures the low threshold register (0x08) with the given value in
- * the sensor's exponent/mantissa format.
+ * @return The bus, or nullptr before begin()
+ */
+TwoWire* Adafruit_OPT4048::getWire(void) {
+  return _wire;
+}
+
+/**
+ * @brief Refresh the cached configuration registers from the device
  *
- * Value is stored as THRESHOLD_L_RESULT and THRESHOLD_L_EXPONENT where:
- * ADC_CODES_TL = THRESHOLD_L_RESULT << (8 + THRESHOLD_L_EXPONENT)
+ * The configuration (0x0A) and threshold configuration (0x0B) registers are
+ * kept in RAM so that setters only need a single write and getters need no
+ * bus traffic at all. Call this if the device may have been changed behind
+ * the driver's back, e.g. after a power glitch or a reset of the sensor.
  *
- * @param thl The low threshold value
- * @return true if successful, false otherwise
+ * @return true if both registers were read back, false otherwise
  */
-bool Adafruit_OPT4048::setThresholdLow(uint32_t thl) {
+bool Adafruit_OPT4048::resync(void) {
+  OPT4048_TRACE(OPT4048_CALL_RESYNC);
   if (!i2c_dev) {
     return false;
   }
 
-  // Find the appropriate exponent and mantissa values that represent the
-  // threshold In this case, we need to find the smallest exponent that allows
-  // mantissa to fit in 12 bits
-  uint8_t exponent = 0;
-  uint32_t mantissa = thl;
-
-  // The mantissa needs to fit in 12 bits, so we start by shifting right
-  // to determine how many shifts we need (which gives us the exponent)
-  // Note that the threshold registers already have 8 added to exponent
-  // internally so we first subtract 8 from our target exponent
-  if (mantissa > 0xFFF) { // If value won't fit in 12 bits
-    while (mantissa > 0xFFF && exponent < 15) {
-      mantissa >>= 1;
-      exponent++;
-    }
-    if (mantissa > 0xFFF) { // If still won't fit with max exponent, clamp
-      mantissa = 0xFFF;
-      exponent =
-          15 - 8; // Max exponent (15) minus the 8 that's added internally
-    }
+  // 0x0A and 0x0B are adjacent, so fetch both in one burst
+  uint16_t regs[2];
+  if (!readRegisters(OPT4048_REG_CONFIG, regs, 2)) {
+    return false;
   }
 
-  // Create the register object for the threshold register
-  Adafruit_BusIO_Register threshold_reg(i2c_dev, OPT4048_REG_THRESHOLD_LOW, 2,
-                                        MSBFIRST);
-
-  // Create register bits for the exponent (top 4 bits) and mantissa (lower 12
-  // bits)
-  Adafruit_BusIO_RegisterBits exponent_bits(&threshold_reg, 4, 12);
-  Adafruit_BusIO_RegisterBits mantissa_bits(&threshold_reg, 12, 0);
-
-  // Write the exponent and mantissa to the register
-  exponent_bits.write(exponent);
-  mantissa_bits.write(mantissa);
-
+  _config_reg = regs[0];
+  _threshold_cfg_reg = regs[1];
   return true;
 }
 
 /**
- * @brief Get the current high threshold value
- *
- * Reads the high threshold register (0x09) and converts the exponent/mantissa
- * format to a single 32-bit value.
+ * @brief Apply a complete configuration in one bus transaction
  *
- * As per page 18 of the datasheet, threshold calculation is:
- * ADC_CODES_TH = THRESHOLD_H_RESULT << (8 + THRESHOLD_H_EXPONENT)
+ * Builds new values for the configuration (0x0A) and threshold configuration
+ * (0x0B) registers and writes both in a single burst, so the device never
+ * runs in a half-configured state between individual setter calls. Reserved
+ * bits keep the value last read from the device.
  *
- * @return The current high threshold value
+ * @param config Pointer to the configuration to apply
+ * @return true if the configuration was written, false otherwise
  */
-uint32_t Adafruit_OPT4048::getThresholdHigh(void) {
-  if (!i2c_dev) {
-    return 0;
+bool Adafruit_OPT4048::setConfig(const opt4048_config_t* config) {
+  OPT4048_TRACE(OPT4048_CALL_SET_CONFIG);
+  if (!i2c_dev || !config || config->thresholdChannel > 3) {
+    return false;
   }
 
-  // Create the register object for the threshold register
-  Adafruit_BusIO_Register threshold_reg(i2c_dev, OPT4048_REG_THRESHOLD_HIGH, 2,
-                                        MSBFIRST);
-
-  // Create register bits for the exponent (top 4 bits) and mantissa (lower 12
-  // bits)
-  Adafruit_BusIO_RegisterBits exponent_bits(&threshold_reg, 4, 12);
-  Adafruit_BusIO_RegisterBits mantissa_bits(&threshold_reg, 12, 0);
-
-  // Read the exponent and mantissa
-  uint8_t exponent = exponent_bits.read();
-  uint32_t mantissa = mantissa_bits.read();
+  uint16_t regs[2];
+
+  // CONFIG (0x0A): QWAKE[15] RANGE[13:10] CONVERSION_TIME[9:6]
+  // OPERATING_MODE[5:4] LATCH[3] INT_POL[2] FAULT_COUNT[1:0]
+  regs[0] = _config_reg & 0x4000; // Keep the reserved bit
+  regs[0] |= (uint16_t)config->quickWake << 15;
+  regs[0] |= ((uint16_t)config->range & 0x0F) << 10;
+  regs[0] |= ((uint16_t)config->convTime & 0x0F) << 6;
+  regs[0] |= ((uint16_t)config->mode & 0x03) << 4;
+  regs[0] |= (uint16_t)config->interruptLatch << 3;
+  regs[0] |= (uint16_t)config->interruptActiveHigh << 2;
+  regs[0] |= (uint16_t)config->faultCount & 0x03;
+
+  // THRESHOLD_CFG (0x0B): THRESHOLD_CH_SEL[6:5] INT_DIR[4] INT_CFG[3:2]
+  regs[1] = _threshold_cfg_reg & 0xFF83; // Keep reserved and I2C_BURST bits
+  regs[1] |= ((uint16_t)config->thresholdChannel & 0x03) << 5;
+  regs[1] |= (uint16_t)config->interruptDirection << 4;
+  regs[1] |= ((uint16_t)config->interruptConfig & 0x03) << 2;
+
+  if (!writeRegisters(OPT4048_REG_CONFIG, regs, 2)) {
+    return false;
+  }
 
-  // Calculate ADC code value by applying the exponent as a bit shift
-  // ADD 8 to the exponent as per datasheet equations 10-11
-  return mantissa << (8 + exponent);
+  _config_reg = regs[0];
+  _threshold_cfg_reg = regs[1];
+  return true;
 }
 
 /**
- * @brief Set the high threshold value for interrupt generation
- *
- * Configures the high threshold register (0x09) with the given value in
- * the sensor's exponent/mantissa format.
+ * @brief Write both thresholds and both configuration registers in one burst
  *
- * Value is stored as THRESHOLD_H_RESULT and THRESHOLD_H_EXPONENT where:
- * ADC_CODES_TH = THRESHOLD_H_RESULT << (8 + THRESHOLD_H_EXPONENT)
+ * Takes the register words as they are, e.g. from an Adafruit_OPT4048_Config
+ * or saved from a running sensor, so nothing is encoded at run time. Change
+ * tracking, see startChangeTracking(), stops since its window and interrupt
+ * settings are replaced.
  *
- * @param thh The high threshold value
- * @return true if successful, false otherwise
+ * @param words The words for registers 0x08 to 0x0B: low threshold, high
+ * threshold, configuration and threshold configuration
+ * @return true if the words were written, false otherwise
  */
-bool Adafruit_OPT4048::setThresholdHigh(uint32_t thh) {
-  if (!i2c_dev) {
+bool Adafruit_OPT4048::setConfigWords(const uint16_t* words) {
+  OPT4048_TRACE(OPT4048_CALL_SET_CONFIG_WORDS);
+  if (!i2c_dev || !words) {
     return false;
   }
 
-  // Find the appropriate exponent and mantissa values that represent the
-  // threshold In this case, we need to find the smallest exponent that allows
-  // mantissa to fit in 12 bits
-  uint8_t exponent = 0;
-  uint32_t mantissa = thh;
-
-  // The mantissa needs to fit in 12 bits, so we start by shifting right
-  // to determine how many shifts we need (which gives us the exponent)
-  // Note that the threshold registers already have 8 added to exponent
-  // internally so we first subtract 8 from our target exponent
-  if (mantissa > 0xFFF) { // If value won't fit in 12 bits
-    while (mantissa > 0xFFF && exponent < 15) {
-      mantissa >>= 1;
-      exponent++;
-    }
-    if (mantissa > 0xFFF) { // If still won't fit with max exponent, clamp
-      mantissa = 0xFFF;
-      exponent =
-          15 - 8; // Max exponent (15) minus the 8 that's added internally
-    }
+  if (!writeRegisters(OPT4048_REG_THRESHOLD_LOW, words, 4)) {
+    return false;
   }
 
-  // Create the register object for the threshold register
-  Adafruit_BusIO_Register threshold_reg(i2c_dev, OPT4048_REG_THRESHOLD_HIGH, 2,
-                                        MSBFIRST);
-
-  // Create register bits for the exponent (top 4 bits) and mantissa (lower 12
-  // bits)
-  Adafruit_BusIO_RegisterBits exponent_bits(&threshold_reg, 4, 12);
-  Adafruit_BusIO_RegisterBits mantissa_bits(&threshold_reg, 12, 0);
-
-  // Write the exponent and mantissa to the register
-  exponent_bits.write(exponent);
-  mantissa_bits.write(mantissa);
-
+  _config_reg = words[2];
+  _threshold_cfg_reg = words[3];
+  _track_band = 0;
   return true;
 }
 
 /**
- * @brief Enable or disable Quick Wake-up feature
- *
- * Controls the QWAKE bit (bit 15) in the configuration register (0x0A).
- * When enabled, the sensor doesn't power down completely in one-shot mode,
- * allowing faster wake-up from standby with lower power consumption.
+ * @brief Get the complete current configuration
  *
- * From the datasheet (page 29):
- * "Quick Wake-up from Standby in one shot mode by not powering down all
- * circuits. Applicable only in One-shot mode and helps get out of standby mode
- * faster with penalty in power consumption compared to full standby mode."
+ * Decodes the cached configuration registers, so this causes no bus traffic.
+ * The result can be modified and passed back to setConfig().
  *
- * @param enable True to enable Quick Wake, false to disable
- * @return True if successful, false otherwise
+ * @param config Pointer to store the configuration in
+ * @return true if successful, false otherwise
  */
-bool Adafruit_OPT4048::setQuickWake(bool enable) {
-  if (!i2c_dev) {
+bool Adafruit_OPT4048::getConfig(opt4048_config_t* config) {
+  if (!i2c_dev || !config) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bit for the QWAKE bit (bit 15)
-  Adafruit_BusIO_RegisterBits qwake_bit(&config_reg, 1, 15);
-
-  // Set the QWAKE bit according to the enable parameter
-  return qwake_bit.write(enable);
+  config->quickWake = (_config_reg >> 15) & 0x01;
+  config->range = (opt4048_range_t)((_config_reg >> 10) & 0x0F);
+  config->convTime = (opt4048_conversion_time_t)((_config_reg >> 6) & 0x0F);
+  config->mode = (opt4048_mode_t)((_config_reg >> 4) & 0x03);
+  config->interruptLatch = (_config_reg >> 3) & 0x01;
+  config->interruptActiveHigh = (_config_reg >> 2) & 0x01;
+  config->faultCount = (opt4048_fault_count_t)(_config_reg & 0x03);
+  config->thresholdChannel = (_threshold_cfg_reg >> 5) & 0x03;
+  config->interruptDirection = (_threshold_cfg_reg >> 4) & 0x01;
+  config->interruptConfig =
+      (opt4048_int_cfg_t)((_threshold_cfg_reg >> 2) & 0x03);
+  return true;
 }
 
 /**
- * @brief Get the current state of the Quick Wake feature
+ * @brief Read all four channels, verify CRC, and return raw ADC code values.
  *
- * Reads the QWAKE bit (bit 15) from the configuration register (0x0A)
- * to determine if Quick Wake is enabled or disabled.
+ * Reads registers for channels 0-3 in one burst, checks the CRC bits for each,
+ * and computes the 20-bit ADC code = mantissa << exponent.
  *
- * @return True if Quick Wake is enabled, false if disabled
+ * @return true if read succeeds and all CRC checks pass, false otherwise.
  */
-bool Adafruit_OPT4048::getQuickWake(void) {
-  if (!i2c_dev) {
+bool Adafruit_OPT4048::getChannelsRaw(uint32_t* ch0, uint32_t* ch1,
+                                      uint32_t* ch2, uint32_t* ch3) {
+  OPT4048_TRACE(OPT4048_CALL_GET_CHANNELS_RAW);
+  uint32_t values[4];
+  if (!getChannelsRaw(OPT4048_CHANNEL_ALL, values)) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
+  *ch0 = values[0];
+  *ch1 = values[1];
+  *ch2 = values[2];
+  *ch3 = values[3];
+  return true;
+}
 
-  // Create register bit for the QWAKE bit (bit 15)
-  Adafruit_BusIO_RegisterBits qwake_bit(&config_reg, 1, 15);
+/**
+ * @brief Read a subset of the channels and return raw ADC code values.
+ *
+ * Only the contiguous register span from the lowest to the highest requested
+ * channel is read, so e.g. OPT4048_CHANNEL_Y costs a 4 byte transfer and
+ * OPT4048_CHANNEL_XYZ a 12 byte one instead of the full 16 bytes. Only the
+ * requested channels are CRC checked and decoded.
+ *
+ * The channels are only returned if they all belong to one conversion. The
+ * sensor stores each channel as soon as it is converted, so in continuous
+ * mode a read can land while a conversion is half stored. That read fails,
+ * unless a deadline was set with setCRCRetry() and the remaining channels
+ * will be stored within it; then it waits for them and reads them again.
+ * readIfNew() and poll() never wait.
+ *
+ * @param channels Bitmask of OPT4048_CHANNEL_* values to read
+ * @param values Array of 4 ADC codes indexed by channel number; entries for
+ * channels that were not requested are left untouched
+ * @return true if read succeeds and all CRC checks pass, false otherwise.
+ */
+bool Adafruit_OPT4048::getChannelsRaw(uint8_t channels, uint32_t* values) {
+  OPT4048_TRACE(OPT4048_CALL_GET_CHANNELS_RAW);
+  return readChannels(channels, values, false);
+}
 
-  // Read the QWAKE bit
-  return qwake_bit.read();
+/**
+ * @brief Read channels only if the sensor has finished a new conversion
+ *
+ * Uses the sample counter embedded in each channel to tell whether the data
+ * is a conversion that was already returned by a previous read. In that case
+ * nothing beyond the first requested channel is decoded and false is
+ * returned, so polling loops don't process the same sample twice. Use
+ * getSampleStatus() to tell a duplicate apart from a failed read. A read
+ * that lands while the sensor is still storing a conversion also returns
+ * false, and the conversion stays new for the next call.
+ *
+ * @param channels Bitmask of OPT4048_CHANNEL_* values to read
+ * @param values Array of 4 ADC codes indexed by channel number; entries for
+ * channels that were not requested are left untouched
+ * @return true if fresh data was read and passed CRC, false otherwise
+ */
+bool Adafruit_OPT4048::readIfNew(uint8_t channels, uint32_t* values) {
+  OPT4048_TRACE(OPT4048_CALL_READ_IF_NEW);
+  return readChannels(channels, values, true);
 }
 
 /**
- * @brief Set the range for light measurements
+ * @brief Read the result registers of all four channels without decoding
  *
- * Controls the RANGE field (bits 10-13) in the configuration register (0x0A).
- * Allows setting a fixed range or enabling automatic range selection.
- *
- * From the datasheet (page 29):
- * "Controls the full-scale light level range of the device. The format of this
- * register is same as the EXPONENT register for all values from 0 to 6.
- * 0: 2.2klux
- * 1: 4.5kux
- * 2: 9klux
- * 3: 18klux
- * 4: 36klux
- * 5: 72klux
- * 6: 144klux
- * 12: Auto-Range"
+ * A single 16 byte burst read with no CRC check and no sample counter
+ * tracking, for capturing samples as fast as possible and decoding them
+ * later, e.g. with opt4048_decodeChannel().
  *
- * @param range The range setting to use from opt4048_range_t enum
- * @return True if successful, false otherwise
+ * @param buf Buffer of 16 bytes for registers 0x00-0x07, MSB first
+ * @return true if the read succeeded, false otherwise
  */
-bool Adafruit_OPT4048::setRange(opt4048_range_t range) {
-  if (!i2c_dev) {
+bool Adafruit_OPT4048::getFrameRaw(uint8_t* buf) {
+  OPT4048_TRACE(OPT4048_CALL_GET_FRAME_RAW);
+  if (!i2c_dev || !buf) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the RANGE field (bits 10-13)
-  Adafruit_BusIO_RegisterBits range_bits(&config_reg, 4, 10);
+  uint8_t reg = OPT4048_REG_CH0_MSB;
+  return transfer(&reg, 1, buf, 16);
+}
 
-  // Set the RANGE field according to the range parameter
-  return range_bits.write(range);
+/**
+ * @brief Get how the last successfully read sample relates to the one before
+ *
+ * @return OPT4048_SAMPLE_NEW, OPT4048_SAMPLE_DUPLICATE if the sensor had not
+ * completed a conversion since the previous read, or OPT4048_SAMPLE_MISSED
+ * if one or more conversions were never read
+ */
+opt4048_sample_status_t Adafruit_OPT4048::getSampleStatus(void) {
+  return _sample_status;
 }
 
 /**
- * @brief Get the current range setting
+ * @brief Get the number of conversions skipped before the last sample
  *
- * Reads the RANGE field (bits 10-13) from the configuration register (0x0A)
- * to determine the current range setting.
+ * The sample counter is only 4 bits wide, so gaps are counted modulo 16: a
+ * gap of exactly 16 conversions is indistinguishable from a duplicate.
  *
- * @return The current range setting as opt4048_range_t enum value
+ * @return Number of conversions missed just before the last sample
  */
-opt4048_range_t Adafruit_OPT4048::getRange(void) {
-  if (!i2c_dev) {
-    return OPT4048_RANGE_AUTO; // Default to auto-range if no device
-  }
-
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the RANGE field (bits 10-13)
-  Adafruit_BusIO_RegisterBits range_bits(&config_reg, 4, 10);
+uint8_t Adafruit_OPT4048::getMissedSamples(void) {
+  return _missed_samples;
+}
 
-  // Read the RANGE field and return as enum value
-  return (opt4048_range_t)range_bits.read();
+/**
+ * @brief Get the total number of missed conversions since begin()
+ *
+ * @return The accumulated count of conversions that were never read
+ */
+uint32_t Adafruit_OPT4048::getTotalMissedSamples(void) {
+  return _total_missed_samples;
 }
 
 /**
- * @brief Set the conversion time per channel
+ * @brief Configure re-reading of channels that fail their CRC check
  *
- * Controls the CONVERSION_TIME field (bits 6-9) in the configuration register
- * (0x0A). This sets how long each channel will take to convert, ranging from
- * 600 microseconds to 800 milliseconds per channel.
+ * A long or noisy I2C cable occasionally corrupts a channel. With retries
+ * enabled, only the bad channel is read again instead of dropping the whole
+ * sample, which is much cheaper than a new burst and keeps getCIE() and
+ * friends working. The channel data stays valid until the next conversion,
+ * so a deadline of a fraction of the conversion time is a sensible bound.
  *
- * @param convTime The conversion time setting from opt4048_conversion_time_t
- * enum
- * @return True if successful, false otherwise
+ * A deadline also lets getChannelsRaw() and the reads built on it wait for
+ * a conversion that is half stored, if the rest of it lands within the
+ * deadline. Without one they return false for it instead of blocking.
+ *
+ * @param retries Most re-reads per bad channel, 0 to disable (default)
+ * @param deadline Time allowed for re-reads, or to wait out a half stored
+ * conversion, in microseconds; 0 for no re-read limit and no waiting
  */
-bool Adafruit_OPT4048::setConversionTime(opt4048_conversion_time_t convTime) {
-  if (!i2c_dev) {
-    return false;
-  }
+void Adafruit_OPT4048::setCRCRetry(uint8_t retries, uint32_t deadline) {
+  _crc_retry_limit = retries;
+  _crc_deadline = deadline;
+}
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
+/**
+ * @brief Get the number of channel re-reads done after CRC failures
+ *
+ * @return Re-reads since begin()
+ */
+uint32_t Adafruit_OPT4048::getCRCRetries(void) {
+  return _crc_retry_count;
+}
 
-  // Create register bits for the CONVERSION_TIME field (bits 6-9)
-  Adafruit_BusIO_RegisterBits convTime_bits(&config_reg, 4, 6);
+/**
+ * @brief Get the number of channels that still failed after re-reading
+ *
+ * @return Channels given up on since begin()
+ */
+uint32_t Adafruit_OPT4048::getCRCGiveUps(void) {
+  return _crc_give_up_count;
+}
 
-  // Set the CONVERSION_TIME field according to the convTime parameter
-  return convTime_bits.write(convTime);
+/**
+ * @brief Record that the sensor signalled data ready, call from the INT ISR
+ *
+ * With the INT pin configured for data ready, the edge is the most exact
+ * estimate of when a sample became ready. The next new sample read takes
+ * its timestamp from it; see getSampleTime().
+ */
+void Adafruit_OPT4048::notifyDataReady(void) {
+  _int_time = micros();
+  _int_pending = true;
 }
 
 /**
- * @brief Get the current conversion time setting
+ * @brief Get when the last new sample became ready on the sensor
  *
- * Reads the CONVERSION_TIME field (bits 6-9) from the configuration register
- * (0x0A) to determine the current conversion time setting.
+ * Taken from the INT edge if notifyDataReady() was called since the
+ * previous sample. Otherwise, if the read just before saw the old sample,
+ * the midpoint between that read and the one that saw the counter change.
+ * Otherwise the time of the read itself, an upper bound.
  *
- * @return The current conversion time setting as opt4048_conversion_time_t enum
- * value
+ * @return micros() timestamp of the last sample
  */
-opt4048_conversion_time_t Adafruit_OPT4048::getConversionTime(void) {
-  if (!i2c_dev) {
-    return OPT4048_CONVERSION_TIME_100MS; // Default to 100ms if no device
-  }
-
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the CONVERSION_TIME field (bits 6-9)
-  Adafruit_BusIO_RegisterBits convTime_bits(&config_reg, 4, 6);
-
-  // Read the CONVERSION_TIME field and return as enum value
-  return (opt4048_conversion_time_t)convTime_bits.read();
+uint32_t Adafruit_OPT4048::getSampleTime(void) {
+  return _sample_time;
 }
 
 /**
- * @brief Set the operating mode of the sensor
+ * @brief Get statistics of the interval between sample timestamps
  *
- * Controls the OPERATING_MODE field (bits 4-5) in the configuration register
- * (0x0A). This sets the device's operating mode: power-down, one-shot, or
- * continuous.
+ * Comparing these with the nominal interval tells sensor pacing apart from
+ * bus and loop latency. Reset them after changing the conversion time.
  *
- * @param mode The operating mode setting from opt4048_mode_t enum
- * @return True if successful, false otherwise
+ * @param stats Pointer to store the statistics in
+ * @return true if at least one interval was measured, false otherwise
  */
-bool Adafruit_OPT4048::setMode(opt4048_mode_t mode) {
-  if (!i2c_dev) {
+bool Adafruit_OPT4048::getTimingStats(opt4048_timing_t* stats) {
+  if (!stats) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the OPERATING_MODE field (bits 4-5)
-  Adafruit_BusIO_RegisterBits mode_bits(&config_reg, 2, 4);
+  stats->count = _interval_count;
+  stats->nominal = getMeasurementTime();
+  stats->min = _interval_min;
+  stats->max = _interval_max;
+  stats->mean = _interval_mean;
+  stats->stddev = _interval_count ? sqrt(_interval_m2 / _interval_count) : 0;
+  return _interval_count != 0;
+}
 
-  // Set the OPERATING_MODE field according to the mode parameter
-  return mode_bits.write(mode);
+/**
+ * @brief Clear the interval statistics
+ *
+ * The next sample starts a new interval, so the time spent before the reset
+ * is not counted.
+ */
+void Adafruit_OPT4048::resetTimingStats(void) {
+  _have_sample_time = false;
+  _interval_count = 0;
+  _interval_min = 0xFFFFFFFF;
+  _interval_max = 0;
+  _interval_mean = 0;
+  _interval_m2 = 0;
 }
 
 /**
- * @brief Get the current operating mode setting
+ * @brief Start a non-blocking measurement
  *
- * Reads the OPERATING_MODE field (bits 4-5) from the configuration register
- * (0x0A) to determine the current operating mode.
+ * In one-shot modes this triggers a new conversion, using the one-shot mode
+ * that was last set (forced auto-range one-shot if the sensor was powered
+ * down). In continuous mode the sensor is already converting and this only
+ * starts tracking it. Either way, call poll() from loop() afterwards.
  *
- * @return The current operating mode as opt4048_mode_t enum value
+ * @param channels Bitmask of OPT4048_CHANNEL_* values to read when done
+ * @return true if the measurement was started, false otherwise
  */
-opt4048_mode_t Adafruit_OPT4048::getMode(void) {
-  if (!i2c_dev) {
-    return OPT4048_MODE_POWERDOWN; // Default to power-down if no device
+bool Adafruit_OPT4048::startMeasurement(uint8_t channels) {
+  OPT4048_TRACE(OPT4048_CALL_START_MEASUREMENT);
+  channels &= OPT4048_CHANNEL_ALL;
+  if (!i2c_dev || !channels) {
+    return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
+  // Completion is detected by the sample counter changing, so it needs a
+  // known starting point. This only costs a read on the first measurement.
+  if (_last_counter < 0) {
+    uint32_t values[4];
+    uint8_t lowest = channels & -channels;
+    if (!getChannelsRaw(lowest, values)) {
+      return false;
+    }
+  }
 
-  // Create register bits for the OPERATING_MODE field (bits 4-5)
-  Adafruit_BusIO_RegisterBits mode_bits(&config_reg, 2, 4);
+  opt4048_mode_t mode = (opt4048_mode_t)((_config_reg >> 4) & 0x03);
+  if (mode != OPT4048_MODE_CONTINUOUS) {
+    if (mode == OPT4048_MODE_POWERDOWN) {
+      mode = OPT4048_MODE_AUTO_ONESHOT;
+    }
+    // Writing a one-shot mode starts a conversion, even if it is unchanged
+    if (!setMode(mode)) {
+      return false;
+    }
+  }
 
-  // Read the OPERATING_MODE field and return as enum value
-  return (opt4048_mode_t)mode_bits.read();
+  // An unclaimed sample from the previous measurement stays available
+  _async_channels = channels;
+  _async_due = micros() + getMeasurementTime();
+  return true;
 }
 
 /**
- * @brief Set the interrupt latch mode
+ * @brief Stop tracking the measurement started by startMeasurement()
  *
- * Controls the LATCH bit (bit 3) in the configuration register (0x0A).
- * This sets whether interrupts are latched or transparent.
+ * The sensor's operating mode is not changed, so in continuous mode it keeps
+ * converting; use setMode() to power it down.
+ */
+void Adafruit_OPT4048::stopMeasurement(void) {
+  _async_channels = 0;
+}
+
+/**
+ * @brief Advance a measurement started by startMeasurement()
+ *
+ * Call this as often as convenient. Until the configured conversion time
+ * has passed it returns immediately without touching the I2C bus. After
+ * that it reads the requested channels and, if they hold a new conversion,
+ * marks the sample ready and invokes the callback set by setCallback(). If
+ * the conversion is not quite done yet, the next bus access is deferred by
+ * a sixteenth of the measurement time.
+ *
+ * In one-shot modes the measurement is finished once a sample is ready; in
+ * continuous mode polling carries on with the next conversion.
+ *
+ * @return true if a new sample became ready during this call
+ */
+bool Adafruit_OPT4048::poll(void) {
+  OPT4048_TRACE(OPT4048_CALL_POLL);
+  if (!i2c_dev || !_async_channels) {
+    return false;
+  }
+
+  uint32_t now = micros();
+  if ((int32_t)(now - _async_due) < 0) {
+    return false;
+  }
+
+  uint32_t period = getMeasurementTime();
+  uint32_t values[4];
+  if (!readIfNew(_async_channels, values)) {
+    _async_due = now + (period >> 4);
+    return false;
+  }
+
+  memcpy(_async_values, values, sizeof(values));
+  _async_ready = true;
+
+  if (((_config_reg >> 4) & 0x03) == OPT4048_MODE_CONTINUOUS) {
+    // The conversion finished at most one retry interval ago
+    _async_due = now + period - (period >> 4);
+  } else {
+    _async_channels = 0;
+  }
+
+  if (_callback) {
+    _callback(this, _async_values);
+  }
+  return true;
+}
+
+/**
+ * @brief Check whether a measurement started by startMeasurement() is active
+ *
+ * @return true until a one-shot sample is ready or stopMeasurement() is
+ * called, false otherwise
+ */
+bool Adafruit_OPT4048::isMeasuring(void) {
+  return _async_channels != 0;
+}
+
+/**
+ * @brief Get when poll() will next access the bus
+ *
+ * Lets a scheduler serving several sensors poll only the ones that are due.
+ * Only meaningful while isMeasuring() is true.
+ *
+ * @return The micros() timestamp of the next bus access by poll()
+ */
+uint32_t Adafruit_OPT4048::getNextPoll(void) {
+  return _async_due;
+}
+
+/**
+ * @brief Check whether an asynchronous sample is waiting to be claimed
+ *
+ * Causes no bus traffic; poll() is what updates this.
+ *
+ * @return true if getMeasurement() has a new sample to return
+ */
+bool Adafruit_OPT4048::ready(void) {
+  return _async_ready;
+}
+
+/**
+ * @brief Claim the last sample produced by poll()
+ *
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels passed to startMeasurement() are valid
+ * @return true if a new sample was copied, false if none was ready
+ */
+bool Adafruit_OPT4048::getMeasurement(uint32_t* values) {
+  if (!values || !_async_ready) {
+    return false;
+  }
+
+  memcpy(values, _async_values, sizeof(_async_values));
+  _async_ready = false;
+  return true;
+}
+
+/**
+ * @brief Set the function poll() calls when a sample is ready
+ *
+ * The callback runs from poll(), never from an interrupt. The sample stays
+ * available through getMeasurement() as well.
+ *
+ * @param callback Function to call, or nullptr to disable
+ */
+void Adafruit_OPT4048::setCallback(opt4048_callback_t callback) {
+  _callback = callback;
+}
+
+/**
+ * @brief Get the time the sensor needs to convert all four channels
+ *
+ * The conversion time setting applies per channel and the sensor always
+ * converts X, Y, Z and W in turn, so a full sample takes four times as long.
+ * Based on the cached configuration, so this causes no bus traffic.
+ *
+ * @return The duration of one measurement in microseconds
+ */
+uint32_t Adafruit_OPT4048::getMeasurementTime(void) {
+  // Conversion time per channel in microseconds, datasheet page 29
+  static const uint32_t conversion_us[12] = {
+      600,   1000,  1800,   3400,   6500,   12700,
+      25000, 50000, 100000, 200000, 400000, 800000};
+
+  uint8_t convTime = (_config_reg >> 6) & 0x0F;
+  if (convTime > 11) {
+    convTime = 11;
+  }
+  return 4 * conversion_us[convTime];
+}
+
+#ifdef OPT4048_INSTRUMENTATION
+/**
+ * @brief Get the bus traffic and latency recorded for a method
+ *
+ * Only available when the library is built with OPT4048_INSTRUMENTATION.
+ * Counting starts at construction or at the last resetCallStats().
+ *
+ * @param call The method to look up
+ * @param stats Pointer to store the statistics in
+ * @return true if call is valid, false otherwise
+ */
+bool Adafruit_OPT4048::getCallStats(opt4048_call_t call,
+                                    opt4048_call_stats_t* stats) {
+  if (call >= OPT4048_CALL_COUNT || !stats) {
+    return false;
+  }
+
+  *stats = _call_stats[call];
+  return true;
+}
+
+/**
+ * @brief Clear the statistics of all methods
+ */
+void Adafruit_OPT4048::resetCallStats(void) {
+  memset(_call_stats, 0, sizeof(_call_stats));
+}
+#endif
+
+/**
+ * @brief Get the current low threshold value
+ *
+ * Reads the low threshold register (0x08) and converts the exponent/mantissa
+ * format to a single 32-bit value.
+ *
+ * As per page 18 of the datasheet, threshold calculation is:
+ * ADC_CODES_TL = THRESHOLD_L_RESULT << (8 + THRESHOLD_L_EXPONENT)
+ *
+ * @return The current low threshold value
+ */
+uint32_t Adafruit_OPT4048::getThresholdLow(void) {
+  OPT4048_TRACE(OPT4048_CALL_GET_THRESHOLD_LOW);
+  if (!i2c_dev) {
+    return 0;
+  }
+
+  uint16_t threshold;
+  if (!readRegisters(OPT4048_REG_THRESHOLD_LOW, &threshold, 1)) {
+    return 0;
+  }
+
+  // Split into the exponent (top 4 bits) and mantissa (lower 12 bits)
+  uint8_t exponent = threshold >> 12;
+  uint32_t mantissa = threshold & 0x0FFF;
+
+  // Calculate ADC code value by applying the exponent as a bit shift
+  // ADD 8 to the exponent as per datasheet equations 12-13
+  return mantissa << (8 + exponent);
+}
+
+/**
+ * @brief Set the low threshold value for interrupt generation
+ *
+ * Configures the low threshold register (0x08) with the given value in
+ * the sensor's exponent/mantissa format.
+ *
+ * Value is stored as THRESHOLD_L_RESULT and THRESHOLD_L_EXPONENT where:
+ * ADC_CODES_TL = THRESHOLD_L_RESULT << (8 + THRESHOLD_L_EXPONENT)
+ *
+ * The value is rounded down to the nearest one the register can hold, see
+ * opt4048_encodeThreshold().
+ *
+ * @param thl The low threshold value as an ADC code
+ * @return true if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setThresholdLow(uint32_t thl) {
+  OPT4048_TRACE(OPT4048_CALL_SET_THRESHOLD_LOW);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // The exponent (top 4 bits) and mantissa (lower 12 bits) make up the
+  // whole register, so it is written in one go
+  uint16_t threshold = opt4048_encodeThreshold(thl);
+  return writeRegisters(OPT4048_REG_THRESHOLD_LOW, &threshold, 1);
+}
+
+/**
+ * @brief Get the current high threshold value
+ *
+ * Reads the high threshold register (0x09) and converts the exponent/mantissa
+ * format to a single 32-bit value.
+ *
+ * As per page 18 of the datasheet, threshold calculation is:
+ * ADC_CODES_TH = THRESHOLD_H_RESULT << (8 + THRESHOLD_H_EXPONENT)
+ *
+ * @return The current high threshold value
+ */
+uint32_t Adafruit_OPT4048::getThresholdHigh(void) {
+  OPT4048_TRACE(OPT4048_CALL_GET_THRESHOLD_HIGH);
+  if (!i2c_dev) {
+    return 0;
+  }
+
+  uint16_t threshold;
+  if (!readRegisters(OPT4048_REG_THRESHOLD_HIGH, &threshold, 1)) {
+    return 0;
+  }
+
+  // Split into the exponent (top 4 bits) and mantissa (lower 12 bits)
+  uint8_t exponent = threshold >> 12;
+  uint32_t mantissa = threshold & 0x0FFF;
+
+  // Calculate ADC code value by applying the exponent as a bit shift
+  // ADD 8 to the exponent as per datasheet equations 10-11
+  return mantissa << (8 + exponent);
+}
+
+/**
+ * @brief Set the high threshold value for interrupt generation
+ *
+ * Configures the high threshold register (0x09) with the given value in
+ * the sensor's exponent/mantissa format.
+ *
+ * Value is stored as THRESHOLD_H_RESULT and THRESHOLD_H_EXPONENT where:
+ * ADC_CODES_TH = THRESHOLD_H_RESULT << (8 + THRESHOLD_H_EXPONENT)
+ *
+ * The value is rounded up to the nearest one the register can hold, see
+ * opt4048_encodeThreshold().
+ *
+ * @param thh The high threshold value as an ADC code
+ * @return true if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setThresholdHigh(uint32_t thh) {
+  OPT4048_TRACE(OPT4048_CALL_SET_THRESHOLD_HIGH);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // The exponent (top 4 bits) and mantissa (lower 12 bits) make up the
+  // whole register, so it is written in one go
+  uint16_t threshold = opt4048_encodeThreshold(thh, true);
+  return writeRegisters(OPT4048_REG_THRESHOLD_HIGH, &threshold, 1);
+}
+
+/**
+ * @brief Enable or disable Quick Wake-up feature
+ *
+ * Controls the QWAKE bit (bit 15) in the configuration register (0x0A).
+ * When enabled, the sensor doesn't power down completely in one-shot mode,
+ * allowing faster wake-up from standby with lower power consumption.
+ *
+ * From the datasheet (page 29):
+ * "Quick Wake-up from Standby in one shot mode by not powering down all
+ * circuits. Applicable only in One-shot mode and helps get out of standby mode
+ * faster with penalty in power consumption compared to full standby mode."
+ *
+ * @param enable True to enable Quick Wake, false to disable
+ * @return True if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setQuickWake(bool enable) {
+  OPT4048_TRACE(OPT4048_CALL_SET_QUICK_WAKE);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // Update the QWAKE bit (bit 15) in the cached configuration register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 1, 15, enable);
+}
+
+/**
+ * @brief Get the current state of the Quick Wake feature
+ *
+ * Reads the QWAKE bit (bit 15) from the cached configuration register
+ * (0x0A) to determine if Quick Wake is enabled or disabled.
+ *
+ * @return True if Quick Wake is enabled, false if disabled
+ */
+bool Adafruit_OPT4048::getQuickWake(void) {
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // QWAKE is bit 15 of the cached configuration register
+  return (_config_reg >> 15) & 0x01;
+}
+
+/**
+ * @brief Set the range for light measurements
+ *
+ * Controls the RANGE field (bits 10-13) in the configuration register (0x0A).
+ * Allows setting a fixed range or enabling automatic range selection.
+ *
+ * From the datasheet (page 29):
+ * "Controls the full-scale light level range of the device. The format of this
+ * register is same as the EXPONENT register for all values from 0 to 6.
+ * 0: 2.2klux
+ * 1: 4.5kux
+ * 2: 9klux
+ * 3: 18klux
+ * 4: 36klux
+ * 5: 72klux
+ * 6: 144klux
+ * 12: Auto-Range"
+ *
+ * @param range The range setting to use from opt4048_range_t enum
+ * @return True if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setRange(opt4048_range_t range) {
+  OPT4048_TRACE(OPT4048_CALL_SET_RANGE);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // Update the RANGE field (bits 10-13) in the cached configuration register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 4, 10, range);
+}
+
+/**
+ * @brief Get the current range setting
+ *
+ * Reads the RANGE field (bits 10-13) from the cached configuration register
+ * (0x0A) to determine the current range setting.
+ *
+ * @return The current range setting as opt4048_range_t enum value
+ */
+opt4048_range_t Adafruit_OPT4048::getRange(void) {
+  if (!i2c_dev) {
+    return OPT4048_RANGE_AUTO; // Default to auto-range if no device
+  }
+
+  // RANGE is bits 10-13 of the cached configuration register
+  return (opt4048_range_t)((_config_reg >> 10) & 0x0F);
+}
+
+/**
+ * @brief Set the conversion time per channel
+ *
+ * Controls the CONVERSION_TIME field (bits 6-9) in the configuration register
+ * (0x0A). This sets how long each channel will take to convert, ranging from
+ * 600 microseconds to 800 milliseconds per channel.
+ *
+ * @param convTime The conversion time setting from opt4048_conversion_time_t
+ * enum
+ * @return True if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setConversionTime(opt4048_conversion_time_t convTime) {
+  OPT4048_TRACE(OPT4048_CALL_SET_CONVERSION_TIME);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // Update the CONVERSION_TIME field (bits 6-9) in the cached configuration
+  // register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 4, 6, convTime);
+}
+
+/**
+ * @brief Get the current conversion time setting
+ *
+ * Reads the CONVERSION_TIME field (bits 6-9) from the cached configuration
+ * register (0x0A) to determine the current conversion time setting.
+ *
+ * @return The current conversion time setting as opt4048_conversion_time_t enum
+ * value
+ */
+opt4048_conversion_time_t Adafruit_OPT4048::getConversionTime(void) {
+  if (!i2c_dev) {
+    return OPT4048_CONVERSION_TIME_100MS; // Default to 100ms if no device
+  }
+
+  // CONVERSION_TIME is bits 6-9 of the cached configuration register
+  return (opt4048_conversion_time_t)((_config_reg >> 6) & 0x0F);
+}
+
+/**
+ * @brief Set the operating mode of the sensor
+ *
+ * Controls the OPERATING_MODE field (bits 4-5) in the configuration register
+ * (0x0A). This sets the device's operating mode: power-down, one-shot, or
+ * continuous.
+ *
+ * @param mode The operating mode setting from opt4048_mode_t enum
+ * @return True if successful, false otherwise
+ */
+bool Adafruit_OPT4048::setMode(opt4048_mode_t mode) {
+  OPT4048_TRACE(OPT4048_CALL_SET_MODE);
+  if (!i2c_dev) {
+    return false;
+  }
+
+  // Update the OPERATING_MODE field (bits 4-5) in the cached configuration
+  // register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 2, 4, mode);
+}
+
+/**
+ * @brief Get the current operating mode setting
+ *
+ * Returns the OPERATING_MODE field (bits 4-5) of the configuration register
+ * (0x0A) from the cached copy. In the one-shot modes the register is read
+ * back from the device, since the sensor returns itself to power-down when
+ * the conversion completes. The cached copy keeps the one-shot mode, so
+ * startMeasurement() and suspend() still use the mode that was set.
+ *
+ * @return The current operating mode as opt4048_mode_t enum value
+ */
+opt4048_mode_t Adafruit_OPT4048::getMode(void) {
+  OPT4048_TRACE(OPT4048_CALL_GET_MODE);
+  if (!i2c_dev) {
+    return OPT4048_MODE_POWERDOWN; // Default to power-down if no device
+  }
+
+  opt4048_mode_t mode = (opt4048_mode_t)((_config_reg >> 4) & 0x03);
+
+  // The device clears the one-shot modes back to power-down by itself once
+  // the conversion is done, so only those need a fresh read of the register
+  if (mode == OPT4048_MODE_ONESHOT || mode == OPT4048_MODE_AUTO_ONESHOT) {
+    uint16_t config;
+    if (readRegisters(OPT4048_REG_CONFIG, &config, 1)) {
+      mode = (opt4048_mode_t)((config >> 4) & 0x03);
+    }
+  }
+
+  return mode;
+}
+
+/**
+ * @brief Set the interrupt latch mode
+ *
+ * Controls the LATCH bit (bit 3) in the configuration register (0x0A).
+ * This sets whether interrupts are latched or transparent.
  *
  * When latched (true), the interrupt pin remains active until the flag
  * registers are read, regardless of whether the interrupt condition still
@@ -653,24 +1148,19 @@ opt4048_mode_t Adafruit_OPT4048::getMode(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setInterruptLatch(bool latch) {
+  OPT4048_TRACE(OPT4048_CALL_SET_INTERRUPT_LATCH);
   if (!i2c_dev) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bit for the LATCH bit (bit 3)
-  Adafruit_BusIO_RegisterBits latch_bit(&config_reg, 1, 3);
-
-  // Set the LATCH bit according to the latch parameter
-  return latch_bit.write(latch);
+  // Update the LATCH bit (bit 3) in the cached configuration register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 1, 3, latch);
 }
 
 /**
  * @brief Get the current interrupt latch mode
  *
- * Reads the LATCH bit (bit 3) from the configuration register (0x0A)
+ * Reads the LATCH bit (bit 3) from the cached configuration register (0x0A)
  * to determine the current latch mode.
  *
  * @return True if interrupts are latched, false if transparent
@@ -680,14 +1170,8 @@ bool Adafruit_OPT4048::getInterruptLatch(void) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bit for the LATCH bit (bit 3)
-  Adafruit_BusIO_RegisterBits latch_bit(&config_reg, 1, 3);
-
-  // Read the LATCH bit
-  return latch_bit.read();
+  // LATCH is bit 3 of the cached configuration register
+  return (_config_reg >> 3) & 0x01;
 }
 
 /**
@@ -701,24 +1185,19 @@ bool Adafruit_OPT4048::getInterruptLatch(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setInterruptPolarity(bool activeHigh) {
+  OPT4048_TRACE(OPT4048_CALL_SET_INTERRUPT_POLARITY);
   if (!i2c_dev) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bit for the INT_POL bit (bit 2)
-  Adafruit_BusIO_RegisterBits polarity_bit(&config_reg, 1, 2);
-
-  // Set the INT_POL bit according to the activeHigh parameter
-  return polarity_bit.write(activeHigh);
+  // Update the INT_POL bit (bit 2) in the cached configuration register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 1, 2, activeHigh);
 }
 
 /**
  * @brief Get the current interrupt pin polarity
  *
- * Reads the INT_POL bit (bit 2) from the configuration register (0x0A)
+ * Reads the INT_POL bit (bit 2) from the cached configuration register (0x0A)
  * to determine the current interrupt polarity.
  *
  * @return True if interrupts are active-high, false if active-low
@@ -728,14 +1207,8 @@ bool Adafruit_OPT4048::getInterruptPolarity(void) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bit for the INT_POL bit (bit 2)
-  Adafruit_BusIO_RegisterBits polarity_bit(&config_reg, 1, 2);
-
-  // Read the INT_POL bit
-  return polarity_bit.read();
+  // INT_POL is bit 2 of the cached configuration register
+  return (_config_reg >> 2) & 0x01;
 }
 
 /**
@@ -749,25 +1222,21 @@ bool Adafruit_OPT4048::getInterruptPolarity(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setFaultCount(opt4048_fault_count_t count) {
+  OPT4048_TRACE(OPT4048_CALL_SET_FAULT_COUNT);
   if (!i2c_dev) {
     return false;
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the FAULT_COUNT field (bits 0-1)
-  Adafruit_BusIO_RegisterBits fault_count_bits(&config_reg, 2, 0);
-
-  // Set the FAULT_COUNT field according to the count parameter
-  return fault_count_bits.write(count);
+  // Update the FAULT_COUNT field (bits 0-1) in the cached configuration
+  // register
+  return writeShadowBits(OPT4048_REG_CONFIG, &_config_reg, 2, 0, count);
 }
 
 /**
  * @brief Get the current fault count setting
  *
- * Reads the FAULT_COUNT field (bits 0-1) from the configuration register (0x0A)
- * to determine the current fault count setting.
+ * Reads the FAULT_COUNT field (bits 0-1) from the cached configuration
+ * register (0x0A) to determine the current fault count setting.
  *
  * @return The current fault count setting as opt4048_fault_count_t enum value
  */
@@ -776,14 +1245,8 @@ opt4048_fault_count_t Adafruit_OPT4048::getFaultCount(void) {
     return OPT4048_FAULT_COUNT_1; // Default to 1 fault count if no device
   }
 
-  // Create the register object for the configuration register
-  Adafruit_BusIO_Register config_reg(i2c_dev, OPT4048_REG_CONFIG, 2, MSBFIRST);
-
-  // Create register bits for the FAULT_COUNT field (bits 0-1)
-  Adafruit_BusIO_RegisterBits fault_count_bits(&config_reg, 2, 0);
-
-  // Read the FAULT_COUNT field and return as enum value
-  return (opt4048_fault_count_t)fault_count_bits.read();
+  // FAULT_COUNT is bits 0-1 of the cached configuration register
+  return (opt4048_fault_count_t)(_config_reg & 0x03);
 }
 
 /**
@@ -801,27 +1264,23 @@ opt4048_fault_count_t Adafruit_OPT4048::getFaultCount(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setThresholdChannel(uint8_t channel) {
+  OPT4048_TRACE(OPT4048_CALL_SET_THRESHOLD_CHANNEL);
   if (!i2c_dev || channel > 3) {
     return false;
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bits for the THRESHOLD_CH_SEL field (bits 5-6)
-  Adafruit_BusIO_RegisterBits thresh_ch_sel_bits(&thresh_cfg_reg, 2, 5);
-
-  // Set the THRESHOLD_CH_SEL field according to the channel parameter
-  return thresh_ch_sel_bits.write(channel);
+  // Update the THRESHOLD_CH_SEL field (bits 5-6) in the cached threshold
+  // configuration register
+  return writeShadowBits(OPT4048_REG_THRESHOLD_CFG, &_threshold_cfg_reg, 2, 5,
+                         channel);
 }
 
 /**
  * @brief Get the channel currently used for threshold comparison
  *
- * Reads the THRESHOLD_CH_SEL field (bits 5-6) from the threshold configuration
- * register (0x0B) to determine which channel is being used for threshold
- * comparison.
+ * Reads the THRESHOLD_CH_SEL field (bits 5-6) from the cached threshold
+ * configuration register (0x0B) to determine which channel is being used for
+ * threshold comparison.
  *
  * @return The channel number (0-3) currently used for threshold comparison:
  *         0 = Channel 0 (X)
@@ -834,15 +1293,9 @@ uint8_t Adafruit_OPT4048::getThresholdChannel(void) {
     return 0; // Default to channel 0 if no device
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bits for the THRESHOLD_CH_SEL field (bits 5-6)
-  Adafruit_BusIO_RegisterBits thresh_ch_sel_bits(&thresh_cfg_reg, 2, 5);
-
-  // Read the THRESHOLD_CH_SEL field
-  return thresh_ch_sel_bits.read();
+  // THRESHOLD_CH_SEL is bits 5-6 of the cached threshold configuration
+  // register
+  return (_threshold_cfg_reg >> 5) & 0x03;
 }
 
 /**
@@ -857,26 +1310,22 @@ uint8_t Adafruit_OPT4048::getThresholdChannel(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setInterruptDirection(bool thresholdHighActive) {
+  OPT4048_TRACE(OPT4048_CALL_SET_INTERRUPT_DIRECTION);
   if (!i2c_dev) {
     return false;
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bit for the INT_DIR bit (bit 4)
-  Adafruit_BusIO_RegisterBits int_dir_bit(&thresh_cfg_reg, 1, 4);
-
-  // Set the INT_DIR bit according to the thresholdHighActive parameter
-  return int_dir_bit.write(thresholdHighActive);
+  // Update the INT_DIR bit (bit 4) in the cached threshold configuration
+  // register
+  return writeShadowBits(OPT4048_REG_THRESHOLD_CFG, &_threshold_cfg_reg, 1, 4,
+                         thresholdHighActive);
 }
 
 /**
  * @brief Get the current interrupt direction setting
  *
- * Reads the INT_DIR bit (bit 4) from the threshold configuration register
- * (0x0B) to determine the current interrupt direction.
+ * Reads the INT_DIR bit (bit 4) from the cached threshold configuration
+ * register (0x0B) to determine the current interrupt direction.
  *
  * @return True if interrupts are generated when measurement > high threshold,
  *         false if interrupts are generated when measurement < low threshold
@@ -886,15 +1335,8 @@ bool Adafruit_OPT4048::getInterruptDirection(void) {
     return false;
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bit for the INT_DIR bit (bit 4)
-  Adafruit_BusIO_RegisterBits int_dir_bit(&thresh_cfg_reg, 1, 4);
-
-  // Read the INT_DIR bit
-  return int_dir_bit.read();
+  // INT_DIR is bit 4 of the cached threshold configuration register
+  return (_threshold_cfg_reg >> 4) & 0x01;
 }
 
 /**
@@ -907,26 +1349,22 @@ bool Adafruit_OPT4048::getInterruptDirection(void) {
  * @return True if successful, false otherwise
  */
 bool Adafruit_OPT4048::setInterruptConfig(opt4048_int_cfg_t config) {
+  OPT4048_TRACE(OPT4048_CALL_SET_INTERRUPT_CONFIG);
   if (!i2c_dev) {
     return false;
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bits for the INT_CFG field (bits 2-3)
-  Adafruit_BusIO_RegisterBits int_cfg_bits(&thresh_cfg_reg, 2, 2);
-
-  // Set the INT_CFG field according to the config parameter
-  return int_cfg_bits.write(config);
+  // Update the INT_CFG field (bits 2-3) in the cached threshold configuration
+  // register
+  return writeShadowBits(OPT4048_REG_THRESHOLD_CFG, &_threshold_cfg_reg, 2, 2,
+                         config);
 }
 
 /**
  * @brief Get the current interrupt configuration
  *
- * Reads the INT_CFG field (bits 2-3) from the threshold configuration register
- * (0x0B) to determine the current interrupt configuration.
+ * Reads the INT_CFG field (bits 2-3) from the cached threshold configuration
+ * register (0x0B) to determine the current interrupt configuration.
  *
  * @return The current interrupt configuration as opt4048_int_cfg_t enum value
  */
@@ -935,15 +1373,8 @@ opt4048_int_cfg_t Adafruit_OPT4048::getInterruptConfig(void) {
     return OPT4048_INT_CFG_SMBUS_ALERT; // Default to SMBUS Alert if no device
   }
 
-  // Create the register object for the threshold configuration register
-  Adafruit_BusIO_Register thresh_cfg_reg(i2c_dev, OPT4048_REG_THRESHOLD_CFG, 2,
-                                         MSBFIRST);
-
-  // Create register bits for the INT_CFG field (bits 2-3)
-  Adafruit_BusIO_RegisterBits int_cfg_bits(&thresh_cfg_reg, 2, 2);
-
-  // Read the INT_CFG field and return as enum value
-  return (opt4048_int_cfg_t)int_cfg_bits.read();
+  // INT_CFG is bits 2-3 of the cached threshold configuration register
+  return (opt4048_int_cfg_t)((_threshold_cfg_reg >> 2) & 0x03);
 }
 
 /**
@@ -959,23 +1390,168 @@ opt4048_int_cfg_t Adafruit_OPT4048::getInterruptConfig(void) {
  *   - bit 3 (0x08): OVERLOAD_FLAG - Overflow condition
  */
 uint8_t Adafruit_OPT4048::getFlags(void) {
+  OPT4048_TRACE(OPT4048_CALL_GET_FLAGS);
   if (!i2c_dev) {
     return 0;
   }
 
-  // Create the register object for the status register
-  Adafruit_BusIO_Register status_reg(i2c_dev, OPT4048_REG_STATUS, 2, MSBFIRST);
-
-  // Read the status register and return the lower byte (contains all flag bits)
-  uint16_t status = status_reg.read();
+  // Read the status register, the lower byte contains all flag bits
+  uint16_t status;
+  if (!readRegisters(OPT4048_REG_STATUS, &status, 1)) {
+    return 0;
+  }
   return status & 0x0F; // Mask to get only the lower 4 bits with the flags
 }
 
+/**
+ * @brief Interrupt on a change in light instead of on every sample
+ *
+ * Switches the INT pin to threshold mode with a window of +/- band around
+ * the current value of one channel. Every new sample the driver reads from
+ * that channel, through getChannelsRaw(), getCIE(), poll() and the like,
+ * centers the window on the new value again. INT then only fires once the
+ * light has moved by more than band since the last read, and the host can
+ * sleep without any bus traffic until it does.
+ *
+ * INT is latched, since only the latched window mode flags light that
+ * falls below the window; in transparent mode the sensor runs a hysteresis
+ * that only interrupts on rising light. Moving the window is a single 5 byte
+ * write followed by a status read that clears the latched flags and INT,
+ * both skipped when the rounded thresholds don't change. The sensor has to
+ * be in continuous mode for the thresholds to be checked, and
+ * setThresholdLow() and setThresholdHigh() are overridden by the next sample
+ * while tracking.
+ *
+ * @param channel Channel (0-3) to follow, 1 (Y) for the illuminance
+ * @param band Dead-band relative to the value, greater than 0 and less than
+ * 1, e.g. 0.05 for +/- 5%
+ * @return true if tracking started, false otherwise
+ */
+bool Adafruit_OPT4048::startChangeTracking(uint8_t channel, float band) {
+  OPT4048_TRACE(OPT4048_CALL_START_CHANGE_TRACKING);
+  if (!i2c_dev || channel > 3 || !(band > 0)) {
+    return false;
+  }
+  uint32_t q = band * 65536.0f + 0.5f;
+  if (!q || q > 0xFFFF) {
+    return false;
+  }
+
+  // Center the window on a fresh value, without moving an old window on
+  // the way
+  uint16_t oldBand = _track_band;
+  _track_band = 0;
+  uint32_t values[4];
+  if (!readChannels(1 << channel, values, false)) {
+    _track_band = oldBand;
+    return false;
+  }
+
+  uint16_t regs[4];
+  windowAround(values[channel], q, regs);
+  regs[2] = _config_reg | 0x0008; // LATCH on
+  regs[3] = _threshold_cfg_reg & ~0x006C;
+  regs[3] |= (uint16_t)channel << 5; // THRESHOLD_CH_SEL
+  regs[3] |= 0x0010;                 // INT_DIR output, INT_CFG threshold
+
+  // 0x08-0x0B are adjacent, so the window and both configuration registers
+  // go out in one burst and INT never sees a stale window. Flags latched
+  // before are cleared, or INT would stay asserted.
+  uint16_t status;
+  if (!writeRegisters(OPT4048_REG_THRESHOLD_LOW, regs, 4) ||
+      !readRegisters(OPT4048_REG_STATUS, &status, 1)) {
+    _track_band = oldBand;
+    return false;
+  }
+
+  if (!oldBand) {
+    _track_latch = (_config_reg >> 3) & 0x01;
+    _track_int_cfg = (opt4048_int_cfg_t)((_threshold_cfg_reg >> 2) & 0x03);
+  }
+  _config_reg = regs[2];
+  _threshold_cfg_reg = regs[3];
+  _track_window[0] = regs[0];
+  _track_window[1] = regs[1];
+  _track_channel = channel;
+  _track_band = q;
+  return true;
+}
+
+/**
+ * @brief Stop following the light with the threshold window
+ *
+ * Restores the interrupt latch and interrupt configuration that were in
+ * use before startChangeTracking(). The thresholds keep their last values.
+ *
+ * @return true if successful, false otherwise
+ */
+bool Adafruit_OPT4048::stopChangeTracking(void) {
+  OPT4048_TRACE(OPT4048_CALL_STOP_CHANGE_TRACKING);
+  if (!i2c_dev) {
+    return false;
+  }
+  if (!_track_band) {
+    return true;
+  }
+
+  uint16_t regs[2];
+  regs[0] = (_config_reg & ~0x0008) | ((uint16_t)_track_latch << 3);
+  regs[1] = (_threshold_cfg_reg & ~0x000C) | ((uint16_t)_track_int_cfg << 2);
+  if (!writeRegisters(OPT4048_REG_CONFIG, regs, 2)) {
+    return false;
+  }
+
+  _config_reg = regs[0];
+  _threshold_cfg_reg = regs[1];
+  _track_band = 0;
+  return true;
+}
+
+/**
+ * @brief Check whether startChangeTracking() is in effect
+ *
+ * @return true if the threshold window follows the light, false otherwise
+ */
+bool Adafruit_OPT4048::isTrackingChange(void) {
+  return _track_band != 0;
+}
+
+/**
+ * @brief Use a different matrix to convert channels to x, y and lux
+ *
+ * Replaces the datasheet matrix for getCIE(), getCIEFixed() and getLux()
+ * of this sensor, e.g. with one from a factory calibration stored in
+ * EEPROM. The matrix is prepared once here, see
+ * opt4048_prepareCalibration(), so per-sample conversions cost no more than
+ * with the datasheet matrix.
+ *
+ * @param matrix 4x4 matrix, one row per channel with the X, Y, Z and lux
+ * coefficients, or nullptr to go back to the datasheet matrix
+ * @return true if the matrix was accepted, false if it is out of range, in
+ * which case the previous one stays in use
+ */
+bool Adafruit_OPT4048::setCalibration(const float matrix[4][4]) {
+  return opt4048_prepareCalibration(matrix, &_calibration);
+}
+
+/**
+ * @brief Get the prepared calibration used by this sensor
+ *
+ * Pass it to opt4048_calculateCIE() to convert samples read with
+ * getChannelsRaw(), readIfNew() or startMeasurement() the same way getCIE()
+ * does.
+ *
+ * @return Pointer to the calibration, valid as long as the sensor object
+ */
+const opt4048_calibration_t* Adafruit_OPT4048::getCalibration(void) {
+  return &_calibration;
+}
+
 /**
  * @brief Calculate CIE chromaticity coordinates and lux from raw sensor values
  *
- * Reads all four channels and calculates CIE x and y chromaticity coordinates
- * and illuminance (lux) using a matrix transformation.
+ * Reads the X, Y and Z channels and calculates CIE x and y chromaticity
+ * coordinates and illuminance (lux) using a matrix transformation.
  *
  * @param CIEx Pointer to store the calculated CIE x coordinate
  * @param CIEy Pointer to store the calculated CIE y coordinate
@@ -983,66 +1559,132 @@ uint8_t Adafruit_OPT4048::getFlags(void) {
  * @return True if calculation succeeded, false otherwise
  */
 bool Adafruit_OPT4048::getCIE(double* CIEx, double* CIEy, double* lux) {
+  OPT4048_TRACE(OPT4048_CALL_GET_CIE);
+  if (!i2c_dev || !CIEx || !CIEy || !lux) {
+    return false;
+  }
+
+  // Only the channels with coefficients are read, X, Y and Z with the
+  // datasheet matrix
+  uint32_t values[4];
+  if (!getChannelsRaw(_calibration.xyzChannels | _calibration.luxChannels,
+                      values)) {
+    return false;
+  }
+
+  return opt4048_calculateCIE(values, &_calibration, CIEx, CIEy, lux);
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux in single precision
+ *
+ * Same as the double version of getCIE(), but does the math in float, which
+ * is much faster on MCUs whose FPU (if any) only handles single precision.
+ *
+ * @param CIEx Pointer to store the calculated CIE x coordinate
+ * @param CIEy Pointer to store the calculated CIE y coordinate
+ * @param lux Pointer to store the calculated illuminance in lux
+ * @return True if calculation succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::getCIE(float* CIEx, float* CIEy, float* lux) {
+  OPT4048_TRACE(OPT4048_CALL_GET_CIE);
   if (!i2c_dev || !CIEx || !CIEy || !lux) {
     return false;
   }
 
-  // Read all four channels
-  uint32_t ch0, ch1, ch2, ch3;
-  if (!getChannelsRaw(&ch0, &ch1, &ch2, &ch3)) {
+  uint32_t values[4];
+  if (!getChannelsRaw(_calibration.xyzChannels | _calibration.luxChannels,
+                      values)) {
+    return false;
+  }
+
+  return opt4048_calculateCIE(values, &_calibration, CIEx, CIEy, lux);
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux in fixed point
+ *
+ * Integer-only version of getCIE() for MCUs without an FPU. See
+ * opt4048_calculateCIEFixed() for the error bounds.
+ *
+ * @param CIEx Pointer to store CIE x as an unsigned Q16 fraction (x * 65536)
+ * @param CIEy Pointer to store CIE y as an unsigned Q16 fraction (y * 65536)
+ * @param milliLux Pointer to store the illuminance in thousandths of a lux
+ * @return True if calculation succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::getCIEFixed(uint16_t* CIEx, uint16_t* CIEy,
+                                   uint32_t* milliLux) {
+  OPT4048_TRACE(OPT4048_CALL_GET_CIE_FIXED);
+  if (!i2c_dev || !CIEx || !CIEy || !milliLux) {
+    return false;
+  }
+
+  uint32_t values[4];
+  if (!getChannelsRaw(_calibration.xyzChannels | _calibration.luxChannels,
+                      values)) {
     return false;
   }
 
-  // Matrix multiplication coefficients (from datasheet)
-  const double m0x = 2.34892992e-04;
-  const double m0y = -1.89652390e-05;
-  const double m0z = 1.20811684e-05;
-  const double m0l = 0;
-
-  const double m1x = 4.07467441e-05;
-  const double m1y = 1.98958202e-04;
-  const double m1z = -1.58848115e-05;
-  const double m1l = 2.15e-3;
-
-  const double m2x = 9.28619404e-05;
-  const double m2y = -1.69739553e-05;
-  const double m2z = 6.74021520e-04;
-  const double m2l = 0;
-
-  const double m3x = 0;
-  const double m3y = 0;
-  const double m3z = 0;
-  const double m3l = 0;
-
-  // The equation from the datasheet is a matrix multiplication:
-  // [ch0 ch1 ch2 ch3] * [m0x m0y m0z m0l] = [X Y Z Lux]
-  //                     [m1x m1y m1z m1l]
-  //                     [m2x m2y m2z m2l]
-  //                     [m3x m3y m3z m3l]
-  double X = ch0 * m0x + ch1 * m1x + ch2 * m2x + ch3 * m3x;
-  double Y = ch0 * m0y + ch1 * m1y + ch2 * m2y + ch3 * m3y;
-  double Z = ch0 * m0z + ch1 * m1z + ch2 * m2z + ch3 * m3z;
-  double L = ch0 * m0l + ch1 * m1l + ch2 * m2l + ch3 * m3l;
-
-  // Set illuminance in lux
-  *lux = L;
-
-  // Calculate CIE x, y chromaticity coordinates
-  double sum = X + Y + Z;
-  if (sum <= 0) {
-    // Avoid division by zero
-    *CIEx = 0;
-    *CIEy = 0;
-    *lux = 0;
+  return opt4048_calculateCIEFixed(values, &_calibration, CIEx, CIEy,
+                                   milliLux);
+}
+
+/**
+ * @brief Read only the channels lux depends on and calculate the illuminance
+ *
+ * With the datasheet matrix lux depends only on channel 1, so this needs a
+ * 4 byte transfer instead of the 12 byte read done by getCIE().
+ *
+ * @param lux Pointer to store the calculated illuminance in lux
+ * @return True if the read succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::getLux(double* lux) {
+  OPT4048_TRACE(OPT4048_CALL_GET_LUX);
+  if (!i2c_dev || !lux) {
     return false;
   }
 
-  *CIEx = X / sum;
-  *CIEy = Y / sum;
+  // A calibration without lux coefficients always gives 0 lux
+  uint32_t values[4] = {0, 0, 0, 0};
+  if (_calibration.luxChannels &&
+      !getChannelsRaw(_calibration.luxChannels, values)) {
+    return false;
+  }
 
+  *lux = opt4048_calculateLux(values, &_calibration);
   return true;
 }
 
+/**
+ * @brief Read one sample and derive every requested color metric from it
+ *
+ * All metrics come from the same conversion in one bus transaction, unlike
+ * calling getCIE(), getLux() and the CCT functions one after another. See
+ * opt4048_calculateMetrics() for the details.
+ *
+ * @param metrics Pointer to store the metrics in
+ * @param mask OPT4048_METRIC_* bits of the metrics wanted besides X, Y, Z
+ * and lux, all by default
+ * @param white X, Y and Z of the reference white for L*a*b* and sRGB, or
+ * nullptr for D65 at the sample's luminance
+ * @return true if successful, false otherwise
+ */
+bool Adafruit_OPT4048::getMetrics(opt4048_metrics_t* metrics, uint8_t mask,
+                                  const float* white) {
+  OPT4048_TRACE(OPT4048_CALL_GET_METRICS);
+  if (!metrics) {
+    return false;
+  }
+
+  uint32_t values[4];
+  if (!getChannelsRaw(_calibration.xyzChannels | _calibration.luxChannels,
+                      values)) {
+    return false;
+  }
+
+  return opt4048_calculateMetrics(values, &_calibration, mask, white, metrics);
+}
+
 /**
  * @brief Calculate the correlated color temperature (CCT) in Kelvin
  *
@@ -1057,17 +1699,437 @@ bool Adafruit_OPT4048::getCIE(double* CIEx, double* CIEy, double* lux) {
  * @return The calculated color temperature in Kelvin
  */
 double Adafruit_OPT4048::calculateColorTemperature(double CIEx, double CIEy) {
-  // Check for invalid coordinates
-  if (CIEx == 0 && CIEy == 0) {
-    return 0.0;
+  return opt4048_calculateColorTemperature(CIEx, CIEy);
+}
+
+#ifdef OPT4048_INSTRUMENTATION
+/**
+ * @brief Start tracing a method, unless another traced method called it
+ *
+ * @param sensor The sensor whose statistics to update
+ * @param call The method being entered
+ */
+Adafruit_OPT4048::CallTrace::CallTrace(Adafruit_OPT4048* sensor,
+                                       opt4048_call_t call) {
+  _sensor = sensor;
+  _outer = sensor->_active_call == OPT4048_CALL_COUNT;
+  if (_outer) {
+    sensor->_active_call = call;
+    sensor->_call_start = micros();
+  }
+}
+
+/**
+ * @brief Finish tracing, adding the call and its duration to the stats
+ */
+Adafruit_OPT4048::CallTrace::~CallTrace() {
+  if (!_outer) {
+    return;
+  }
+
+  uint32_t elapsed = micros() - _sensor->_call_start;
+  opt4048_call_stats_t* stats = &_sensor->_call_stats[_sensor->_active_call];
+  _sensor->_active_call = OPT4048_CALL_COUNT;
+
+  uint8_t bucket = 0;
+  while ((elapsed >>= 1) && bucket < OPT4048_LATENCY_BUCKETS - 1) {
+    bucket++;
+  }
+  stats->calls++;
+  if (stats->latency[bucket] != 0xFFFF) {
+    stats->latency[bucket]++;
+  }
+}
+#endif
+
+/**
+ * @brief Run one I2C transfer, the only place the driver touches the bus
+ *
+ * @param out Bytes to write, starting with the register address
+ * @param outLen Number of bytes to write
+ * @param in Buffer for the bytes read back after a repeated start
+ * @param inLen Number of bytes to read, 0 for a plain write
+ * @return true if the transfer succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::transfer(const uint8_t* out, size_t outLen,
+                                uint8_t* in, size_t inLen) {
+  bool ok = inLen ? i2c_dev->write_then_read(out, outLen, in, inLen)
+                  : i2c_dev->write(out, outLen);
+
+#ifdef OPT4048_INSTRUMENTATION
+  if (_active_call != OPT4048_CALL_COUNT) {
+    opt4048_call_stats_t* stats = &_call_stats[_active_call];
+    stats->transactions++;
+    stats->bytesWritten += outLen;
+    if (ok) {
+      stats->bytesRead += inLen;
+    } else {
+      stats->failedTransfers++;
+    }
+  }
+#endif
+  return ok;
+}
+
+/**
+ * @brief Record a channel that failed its CRC check
+ */
+void Adafruit_OPT4048::crcError(void) {
+#ifdef OPT4048_INSTRUMENTATION
+  if (_active_call != OPT4048_CALL_COUNT) {
+    _call_stats[_active_call].crcErrors++;
+  }
+#endif
+}
+
+/**
+ * @brief Burst read consecutive 16-bit registers
+ *
+ * @param reg The first register address to read
+ * @param values Array to store the register values in
+ * @param count Number of registers to read (at most 8)
+ * @return true if the transfer succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::readRegisters(uint8_t reg, uint16_t* values,
+                                     uint8_t count) {
+  uint8_t buf[16];
+  if (count > 8 || !transfer(&reg, 1, buf, 2 * count)) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    values[i] = ((uint16_t)buf[2 * i] << 8) | buf[2 * i + 1];
+  }
+  return true;
+}
+
+/**
+ * @brief Burst write consecutive 16-bit registers
+ *
+ * @param reg The first register address to write
+ * @param values Array of register values to write
+ * @param count Number of registers to write (at most 8)
+ * @return true if the transfer succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::writeRegisters(uint8_t reg, const uint16_t* values,
+                                      uint8_t count) {
+  uint8_t buf[1 + 16];
+  if (count > 8) {
+    return false;
+  }
+
+  buf[0] = reg;
+  for (uint8_t i = 0; i < count; i++) {
+    buf[1 + 2 * i] = values[i] >> 8;
+    buf[2 + 2 * i] = values[i] & 0xFF;
+  }
+  return transfer(buf, 1 + 2 * count, nullptr, 0);
+}
+
+/**
+ * @brief Update a bit field of a cached register and write it to the device
+ *
+ * The cached copy is only modified once the write has succeeded, so it never
+ * holds a value the device did not accept.
+ *
+ * @param reg The register address to write
+ * @param shadow Pointer to the cached copy of the register
+ * @param bits Width of the field in bits
+ * @param shift Position of the field's least significant bit
+ * @param value The new field value
+ * @return true if the write succeeded, false otherwise
+ */
+bool Adafruit_OPT4048::writeShadowBits(uint8_t reg, uint16_t* shadow,
+                                       uint8_t bits, uint8_t shift,
+                                       uint16_t value) {
+  uint16_t mask = ((1 << bits) - 1) << shift;
+  uint16_t updated = (*shadow & ~mask) | ((value << shift) & mask);
+
+  if (!writeRegisters(reg, &updated, 1)) {
+    return false;
+  }
+
+  *shadow = updated;
+  return true;
+}
+
+/**
+ * @brief Burst read a set of channels of one conversion and track its
+ * sample counter
+ *
+ * @param channels Bitmask of OPT4048_CHANNEL_* values to read
+ * @param values Array of 4 ADC codes indexed by channel number
+ * @param onlyNew If true, stop and return false when the data is a
+ * duplicate of the previously read conversion
+ * @return true if read succeeds and all CRC checks pass, false otherwise.
+ */
+bool Adafruit_OPT4048::readChannels(uint8_t channels, uint32_t* values,
+                                    bool onlyNew) {
+  channels &= OPT4048_CHANNEL_ALL;
+  if (!i2c_dev || !values || !channels) {
+    return false;
+  }
+
+  // Find the span of channels to burst read
+  uint8_t first = 0;
+  while (!(channels & (1 << first))) {
+    first++;
+  }
+  uint8_t last = 3;
+  while (!(channels & (1 << last))) {
+    last--;
+  }
+
+  uint8_t buf[16];
+  uint8_t reg = OPT4048_REG_CH0_MSB + 2 * first;
+  uint8_t counter;
+  for (uint8_t attempt = 0;; attempt++) {
+    if (!transfer(&reg, 1, buf, 4 * (last - first + 1))) {
+      return false;
+    }
+
+    // The first channel carries the counter used to classify the sample
+    if (!decodeChannel(first, buf, &values[first], &counter, -1)) {
+      return false;
+    }
+
+    // A duplicate is known from the first channel, the rest isn't needed
+    if (onlyNew && counter == _last_counter) {
+      trackSample(counter);
+      return false;
+    }
+
+    // The sensor stores each channel as soon as it is converted, so a read
+    // during a conversion mixes two of them. Every channel has to carry the
+    // first one's counter; torn is the first that doesn't.
+    uint8_t torn = 0;
+    for (uint8_t ch = first + 1; ch <= last; ch++) {
+      if (!(channels & (1 << ch))) {
+        continue;
+      }
+      uint8_t count;
+      if (!decodeChannel(ch, &buf[4 * (ch - first)], &values[ch], &count,
+                         counter)) {
+        return false;
+      }
+      if (count != counter && !torn) {
+        torn = ch;
+      }
+    }
+    if (!torn) {
+      break;
+    }
+
+    // readIfNew() callers come back later anyway. Other reads only wait, for
+    // the channels from torn on to be stored, when that fits the deadline
+    // set by setCRCRetry(); the wait ends before the next conversion's first
+    // channel lands, so they are all read again.
+    uint32_t wait = getMeasurementTime() / 4 * (last - torn + 1);
+    if (onlyNew || attempt || !_crc_deadline || wait > _crc_deadline) {
+      return false;
+    }
+    delay(wait / 1000);
+    delayMicroseconds(wait % 1000);
+  }
+
+  // Only now is the conversion seen, so one that failed a channel is
+  // still new to the next read
+  trackSample(counter);
+
+  // A window that fails to move is tried again with the next sample
+  if (_track_band && (channels & (1 << _track_channel))) {
+    moveWindow(values[_track_channel]);
+  }
+  return true;
+}
+
+/**
+ * @brief Decode one channel, re-reading it if it fails the CRC check
+ *
+ * Only the 4 bytes of the failed channel are read again, up to the limit
+ * set by setCRCRetry(). A re-read that passes the CRC but belongs to a
+ * different conversion than the rest of the sample is not used, since
+ * mixing two conversions would skew the color.
+ *
+ * @param ch Channel number, 0-3
+ * @param buf The channel's 4 bytes as read, overwritten by re-reads
+ * @param value Pointer to store the ADC code in
+ * @param counter Pointer to store the sample counter in, or nullptr
+ * @param expected Counter a re-read must carry, or -1 to accept any
+ * @return true if the channel was decoded, false otherwise
+ */
+bool Adafruit_OPT4048::decodeChannel(uint8_t ch, uint8_t* buf,
+                                     uint32_t* value, uint8_t* counter,
+                                     int8_t expected) {
+  uint8_t count;
+  if (opt4048_decodeChannel(buf, value, &count)) {
+    if (counter) {
+      *counter = count;
+    }
+    return true;
+  }
+  crcError();
+  if (!_crc_retry_limit) {
+    return false;
+  }
+
+  uint8_t reg = OPT4048_REG_CH0_MSB + 2 * ch;
+  uint32_t start = micros();
+  for (uint8_t i = 0; i < _crc_retry_limit; i++) {
+    if (_crc_deadline && micros() - start >= _crc_deadline) {
+      break;
+    }
+    _crc_retry_count++;
+    if (!transfer(&reg, 1, buf, 4)) {
+      break;
+    }
+    if (!opt4048_decodeChannel(buf, value, &count)) {
+      crcError();
+      continue;
+    }
+    // A different counter means the sensor has moved on to the next
+    // conversion, which can't be mixed with the rest of the sample
+    if (expected >= 0 && count != expected) {
+      break;
+    }
+    if (counter) {
+      *counter = count;
+    }
+    return true;
+  }
+
+  _crc_give_up_count++;
+  return false;
+}
+
+/**
+ * @brief Forget everything known about earlier samples
+ *
+ * Used when the sensor is (re)initialized by begin() or resume().
+ */
+void Adafruit_OPT4048::resetState(void) {
+  _last_counter = -1;
+  _total_missed_samples = 0;
+  _crc_retry_count = 0;
+  _crc_give_up_count = 0;
+  _async_channels = 0;
+  _async_ready = false;
+  _int_pending = false;
+  _have_dup = false;
+  resetTimingStats();
+  _track_band = 0;
+}
+
+/**
+ * @brief Classify a sample by its counter and update the sample statistics
+ *
+ * @param counter Sample counter of the conversion that was read
+ */
+void Adafruit_OPT4048::trackSample(uint8_t counter) {
+  if (_last_counter < 0) {
+    _sample_status = OPT4048_SAMPLE_NEW;
+    _missed_samples = 0;
+  } else if (counter == _last_counter) {
+    _sample_status = OPT4048_SAMPLE_DUPLICATE;
+    _missed_samples = 0;
+  } else {
+    _missed_samples = (counter - _last_counter - 1) & 0x0F;
+    _total_missed_samples += _missed_samples;
+    _sample_status =
+        _missed_samples ? OPT4048_SAMPLE_MISSED : OPT4048_SAMPLE_NEW;
+  }
+  _last_counter = counter;
+
+  uint32_t now = micros();
+  if (_sample_status == OPT4048_SAMPLE_DUPLICATE) {
+    _dup_time = now;
+    _have_dup = true;
+  } else {
+    trackSampleTime(now);
+  }
+}
+
+/**
+ * @brief Timestamp a new sample and add its interval to the statistics
+ *
+ * @param now micros() at the read that returned the sample
+ */
+void Adafruit_OPT4048::trackSampleTime(uint32_t now) {
+  noInterrupts();
+  bool fromInt = _int_pending;
+  uint32_t intTime = _int_time;
+  _int_pending = false;
+  interrupts();
+
+  uint32_t ready = now;
+  if (fromInt) {
+    ready = intTime;
+  } else if (_have_dup) {
+    ready = _dup_time + (now - _dup_time) / 2;
+  }
+  _have_dup = false;
+
+  if (_have_sample_time) {
+    uint32_t interval = (ready - _sample_time) / (_missed_samples + 1);
+    if (interval < _interval_min) {
+      _interval_min = interval;
+    }
+    if (interval > _interval_max) {
+      _interval_max = interval;
+    }
+
+    // Welford's running mean and variance, stable in single precision
+    _interval_count++;
+    float delta = interval - _interval_mean;
+    _interval_mean += delta / _interval_count;
+    _interval_m2 += delta * (interval - _interval_mean);
   }
 
-  // Calculate using McCamy's formula from spreadsheet
-  // n = (x - 0.3320) / (0.1858 - y)
-  double n = (CIEx - 0.3320) / (0.1858 - CIEy);
+  _sample_time = ready;
+  _have_sample_time = true;
+}
+
+/**
+ * @brief Compute the threshold words of a window around a value
+ *
+ * The low threshold is rounded down and the high one up, so the window
+ * never gets narrower than requested.
+ *
+ * @param value ADC code to center the window on
+ * @param band Half width of the window relative to value, in Q16
+ * @param window Array to store the low and high threshold words in
+ */
+void Adafruit_OPT4048::windowAround(uint32_t value, uint16_t band,
+                                    uint16_t* window) {
+  // value * band >> 16, split so that no product overflows 32 bits
+  uint32_t delta = (value >> 16) * band + (((value & 0xFFFF) * band) >> 16);
+  window[0] = opt4048_encodeThreshold(value - delta);
+  window[1] = opt4048_encodeThreshold(value + delta, true);
+}
+
+/**
+ * @brief Center the change tracking window on a new value
+ *
+ * @param value ADC code of the tracked channel
+ * @return true if the window is in place, false if writing it failed
+ */
+bool Adafruit_OPT4048::moveWindow(uint32_t value) {
+  uint16_t window[2];
+  windowAround(value, _track_band, window);
+  if (window[0] == _track_window[0] && window[1] == _track_window[1]) {
+    return true;
+  }
 
-  // CCT = 437 * n^3 + 3601 * n^2 + 6861 * n + 5517
-  double cct = (437.0 * n * n * n) + (3601.0 * n * n) + (6861.0 * n) + 5517.0;
+  // 0x08 and 0x09 are adjacent, so both thresholds move in one burst.
+  // Reading the status register then clears the latched flags, and with
+  // them INT, so the next sample outside the new window asserts it again.
+  uint16_t status;
+  if (!writeRegisters(OPT4048_REG_THRESHOLD_LOW, window, 2) ||
+      !readRegisters(OPT4048_REG_STATUS, &status, 1)) {
+    return false;
+  }
 
-  return cct;
+  _track_window[0] = window[0];
+  _track_window[1] = window[1];
+  return true;
 }
@@ -24,6 +24,7 @@
 #include <Adafruit_I2CDevice.h>
 #include <Wire.h>
 
+#include "Adafruit_OPT4048_Math.h"
 #include "Arduino.h"
 
 #define OPT4048_DEFAULT_ADDR \
@@ -102,6 +103,131 @@ typedef enum {
   OPT4048_INT_CFG_DATA_READY_ALL = 3   ///< INT Pin data ready for all channels
 } opt4048_int_cfg_t;
 
+/**
+ * @brief Freshness of a sample, derived from the per-channel sample counter
+ */
+typedef enum {
+  OPT4048_SAMPLE_NEW = 0,       ///< The conversion following the last read
+  OPT4048_SAMPLE_DUPLICATE = 1, ///< Same conversion as the last read
+  OPT4048_SAMPLE_MISSED = 2     ///< New, but conversions were skipped
+} opt4048_sample_status_t;
+
+/**
+ * @brief Statistics of the interval between consecutive samples
+ *
+ * Intervals that span missed samples are divided by the number of
+ * conversions they cover, so they stay comparable to the nominal interval.
+ */
+typedef struct {
+  uint32_t count;   ///< Number of intervals measured
+  uint32_t nominal; ///< Interval expected from the conversion time in us
+  uint32_t min;     ///< Shortest interval in us
+  uint32_t max;     ///< Longest interval in us
+  float mean;       ///< Mean interval in us
+  float stddev;     ///< Standard deviation of the interval in us
+} opt4048_timing_t;
+
+/**
+ * @brief Complete sensor configuration, applied in a single bus transaction
+ *
+ * Holds every field of the configuration (0x0A) and threshold configuration
+ * (0x0B) registers. See setConfig() and getConfig().
+ */
+typedef struct {
+  opt4048_range_t range;              ///< Full-scale light level range
+  opt4048_conversion_time_t convTime; ///< Conversion time per channel
+  opt4048_mode_t mode;                ///< Operating mode
+  bool quickWake;                     ///< Quick Wake-up from standby
+  bool interruptLatch;                ///< Latched (true) or transparent
+  bool interruptActiveHigh;           ///< INT pin polarity
+  opt4048_fault_count_t faultCount;   ///< Faults needed to trigger an INT
+  uint8_t thresholdChannel;           ///< Channel (0-3) for thresholds
+  bool interruptDirection;            ///< INT_DIR bit
+  opt4048_int_cfg_t interruptConfig;  ///< Interrupt mechanism
+} opt4048_config_t;
+
+// Uncomment, or define in the build flags, to count the bus traffic of each
+// method with getCallStats(). Costs about 1.8 KB of RAM per sensor, 56 bytes
+// for each of the OPT4048_CALL_COUNT methods, so it is off by default.
+// #define OPT4048_INSTRUMENTATION
+
+#ifdef OPT4048_INSTRUMENTATION
+/**
+ * @brief Public methods that access the bus, for getCallStats()
+ *
+ * Traffic of methods called from another one, such as the setters called by
+ * begin() or the channel read done by getCIE(), is counted against the
+ * outermost call.
+ */
+typedef enum {
+  OPT4048_CALL_BEGIN = 0,               ///< begin()
+  OPT4048_CALL_RESYNC,                  ///< resync()
+  OPT4048_CALL_RESUME,                  ///< resume()
+  OPT4048_CALL_SUSPEND,                 ///< suspend()
+  OPT4048_CALL_SET_CONFIG,              ///< setConfig()
+  OPT4048_CALL_SET_CONFIG_WORDS,        ///< setConfigWords(), setConfig<>()
+  OPT4048_CALL_GET_CHANNELS_RAW,        ///< getChannelsRaw()
+  OPT4048_CALL_READ_IF_NEW,             ///< readIfNew()
+  OPT4048_CALL_GET_FRAME_RAW,           ///< getFrameRaw()
+  OPT4048_CALL_START_MEASUREMENT,       ///< startMeasurement()
+  OPT4048_CALL_POLL,                    ///< poll()
+  OPT4048_CALL_GET_THRESHOLD_LOW,       ///< getThresholdLow()
+  OPT4048_CALL_SET_THRESHOLD_LOW,       ///< setThresholdLow()
+  OPT4048_CALL_GET_THRESHOLD_HIGH,      ///< getThresholdHigh()
+  OPT4048_CALL_SET_THRESHOLD_HIGH,      ///< setThresholdHigh()
+  OPT4048_CALL_SET_QUICK_WAKE,          ///< setQuickWake()
+  OPT4048_CALL_SET_RANGE,               ///< setRange()
+  OPT4048_CALL_SET_CONVERSION_TIME,     ///< setConversionTime()
+  OPT4048_CALL_SET_MODE,                ///< setMode()
+  OPT4048_CALL_GET_MODE,                ///< getMode()
+  OPT4048_CALL_SET_INTERRUPT_LATCH,     ///< setInterruptLatch()
+  OPT4048_CALL_SET_INTERRUPT_POLARITY,  ///< setInterruptPolarity()
+  OPT4048_CALL_SET_FAULT_COUNT,         ///< setFaultCount()
+  OPT4048_CALL_SET_THRESHOLD_CHANNEL,   ///< setThresholdChannel()
+  OPT4048_CALL_SET_INTERRUPT_DIRECTION, ///< setInterruptDirection()
+  OPT4048_CALL_SET_INTERRUPT_CONFIG,    ///< setInterruptConfig()
+  OPT4048_CALL_GET_FLAGS,               ///< getFlags()
+  OPT4048_CALL_START_CHANGE_TRACKING,   ///< startChangeTracking()
+  OPT4048_CALL_STOP_CHANGE_TRACKING,    ///< stopChangeTracking()
+  OPT4048_CALL_GET_CIE,                 ///< getCIE()
+  OPT4048_CALL_GET_CIE_FIXED,           ///< getCIEFixed()
+  OPT4048_CALL_GET_LUX,                 ///< getLux()
+  OPT4048_CALL_GET_METRICS,             ///< getMetrics()
+  OPT4048_CALL_COUNT                    ///< Number of traced methods
+} opt4048_call_t;
+
+#define OPT4048_LATENCY_BUCKETS 16 //!< Buckets of the latency histogram
+
+/**
+ * @brief Bus traffic and latency of one method, see getCallStats()
+ *
+ * Latency bucket 0 counts calls that took under 2us, bucket n > 0 calls that
+ * took 2^n to 2^(n+1)-1 us, and the last bucket everything longer. The
+ * buckets saturate instead of wrapping.
+ */
+typedef struct {
+  uint32_t calls;                            ///< Number of calls
+  uint32_t transactions;                     ///< I2C transfers started
+  uint32_t bytesRead;                        ///< Bytes read from the sensor
+  uint32_t bytesWritten;                     ///< Bytes written incl. address
+  uint32_t crcErrors;                        ///< Channels that failed CRC
+  uint32_t failedTransfers;                  ///< Transfers that failed
+  uint16_t latency[OPT4048_LATENCY_BUCKETS]; ///< log2 histogram of call time
+} opt4048_call_stats_t;
+#endif
+
+class Adafruit_OPT4048;
+
+/**
+ * @brief Callback invoked by poll() when an asynchronous measurement is ready
+ *
+ * @param sensor The sensor that produced the sample
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels passed to startMeasurement() are valid
+ */
+typedef void (*opt4048_callback_t)(Adafruit_OPT4048* sensor,
+                                   const uint32_t* values);
+
 // Register addresses
 #define OPT4048_REG_CH0_MSB 0x00        //!< X channel MSB register
 #define OPT4048_REG_CH0_LSB 0x01        //!< X channel LSB register
@@ -118,6 +244,14 @@ typedef enum {
 #define OPT4048_REG_STATUS 0x0C         //!< Status register
 #define OPT4048_REG_DEVICE_ID 0x11      //!< Device ID register
 
+// Channel masks for getChannelsRaw()
+#define OPT4048_CHANNEL_X 0x01   //!< Channel 0 (X)
+#define OPT4048_CHANNEL_Y 0x02   //!< Channel 1 (Y), the only one used for lux
+#define OPT4048_CHANNEL_Z 0x04   //!< Channel 2 (Z)
+#define OPT4048_CHANNEL_W 0x08   //!< Channel 3 (W)
+#define OPT4048_CHANNEL_XYZ 0x07 //!< Channels needed for CIE x,y
+#define OPT4048_CHANNEL_ALL 0x0F //!< All four channels
+
 // Status register (0x0C) bit flags
 #define OPT4048_FLAG_L 0x01 //!< Flag low - measurement smaller than threshold
 #define OPT4048_FLAG_H 0x02 //!< Flag high - measurement larger than threshold
@@ -142,6 +276,36 @@ class Adafruit_OPT4048 {
    */
   bool begin(uint8_t addr = OPT4048_DEFAULT_ADDR, TwoWire* wire = &Wire);
 
+  /**
+   * @brief Re-read the cached configuration registers from the device
+   *
+   * @return true on success, false on failure
+   */
+  bool resync(void);
+  bool resume(const uint16_t* words, uint8_t addr = OPT4048_DEFAULT_ADDR,
+              TwoWire* wire = &Wire, bool checkID = false);
+  bool suspend(uint16_t* words, bool quickWake = true);
+  TwoWire* getWire(void);
+
+  bool setConfig(const opt4048_config_t* config);
+  bool getConfig(opt4048_config_t* config);
+  bool setConfigWords(const uint16_t* words);
+
+  /**
+   * @brief Apply a configuration encoded at compile time
+   *
+   * Writes the thresholds and both configuration registers in one burst,
+   * see Adafruit_OPT4048_Config.
+   *
+   * @tparam CONFIG An Adafruit_OPT4048_Config type
+   * @return true if the configuration was written, false otherwise
+   */
+  template <typename CONFIG> bool setConfig(void) {
+    const uint16_t words[4] = {CONFIG::thresholdLow, CONFIG::thresholdHigh,
+                               CONFIG::config, CONFIG::thresholdConfig};
+    return setConfigWords(words);
+  }
+
   /**
    * @brief Read all four channels, verify CRC, and return raw ADC code values
    *
@@ -153,6 +317,34 @@ class Adafruit_OPT4048 {
    */
   bool getChannelsRaw(uint32_t* ch0, uint32_t* ch1, uint32_t* ch2,
                       uint32_t* ch3);
+  bool getChannelsRaw(uint8_t channels, uint32_t* values);
+  bool readIfNew(uint8_t channels, uint32_t* values);
+  bool getFrameRaw(uint8_t* buf);
+  opt4048_sample_status_t getSampleStatus(void);
+  uint8_t getMissedSamples(void);
+  uint32_t getTotalMissedSamples(void);
+  void setCRCRetry(uint8_t retries, uint32_t deadline = 0);
+  uint32_t getCRCRetries(void);
+  uint32_t getCRCGiveUps(void);
+  void notifyDataReady(void);
+  uint32_t getSampleTime(void);
+  bool getTimingStats(opt4048_timing_t* stats);
+  void resetTimingStats(void);
+
+  bool startMeasurement(uint8_t channels = OPT4048_CHANNEL_ALL);
+  void stopMeasurement(void);
+  bool poll(void);
+  bool isMeasuring(void);
+  uint32_t getNextPoll(void);
+  bool ready(void);
+  bool getMeasurement(uint32_t* values);
+  void setCallback(opt4048_callback_t callback);
+  uint32_t getMeasurementTime(void);
+
+#ifdef OPT4048_INSTRUMENTATION
+  bool getCallStats(opt4048_call_t call, opt4048_call_stats_t* stats);
+  void resetCallStats(void);
+#endif
 
   bool setThresholdLow(uint32_t thl);
   uint32_t getThresholdLow(void);
@@ -179,7 +371,17 @@ class Adafruit_OPT4048 {
   bool setInterruptConfig(opt4048_int_cfg_t config);
   opt4048_int_cfg_t getInterruptConfig(void);
   uint8_t getFlags(void);
+  bool startChangeTracking(uint8_t channel = 1, float band = 0.05f);
+  bool stopChangeTracking(void);
+  bool isTrackingChange(void);
+  bool setCalibration(const float matrix[4][4]);
+  const opt4048_calibration_t* getCalibration(void);
   bool getCIE(double* CIEx, double* CIEy, double* lux);
+  bool getCIE(float* CIEx, float* CIEy, float* lux);
+  bool getCIEFixed(uint16_t* CIEx, uint16_t* CIEy, uint32_t* milliLux);
+  bool getLux(double* lux);
+  bool getMetrics(opt4048_metrics_t* metrics, uint8_t mask = OPT4048_METRIC_ALL,
+                  const float* white = nullptr);
 
   /**
    * @brief Calculate the correlated color temperature (CCT) in Kelvin
@@ -196,7 +398,72 @@ class Adafruit_OPT4048 {
 
  private:
   Adafruit_I2CDevice* i2c_dev;
-  void encodeValue(uint32_t value, uint8_t* exp, uint32_t* mant);
+  TwoWire* _wire;                         ///< Bus of i2c_dev, nullptr if none
+  uint16_t _config_reg;                   ///< Cached CONFIG (0x0A)
+  uint16_t _threshold_cfg_reg;            ///< Cached THRESHOLD_CFG (0x0B)
+  int8_t _last_counter;                   ///< Last sample counter, -1 if none
+  opt4048_sample_status_t _sample_status; ///< Freshness of the last read
+  uint8_t _missed_samples;                ///< Conversions skipped before it
+  uint32_t _total_missed_samples;         ///< Skipped conversions in total
+  uint8_t _crc_retry_limit;               ///< Re-reads of a bad channel
+  uint32_t _crc_deadline;                 ///< Time for them in us, 0 = any
+  uint32_t _crc_retry_count;              ///< Re-reads done in total
+  uint32_t _crc_give_up_count;            ///< Channels dropped after them
+  uint8_t _async_channels;                ///< Channels polled, 0 when idle
+  bool _async_ready;                      ///< Unclaimed sample available
+  uint32_t _async_due;                    ///< micros() of next bus poll
+  uint32_t _async_values[4];              ///< Last asynchronous sample
+  opt4048_callback_t _callback;           ///< Called when a sample is ready
+  opt4048_calibration_t _calibration;     ///< Matrix used by getCIE() etc.
+  volatile uint32_t _int_time;            ///< micros() of the last INT edge
+  volatile bool _int_pending;             ///< INT seen since the last sample
+  uint32_t _dup_time;                     ///< Last read that saw no change
+  bool _have_dup;                         ///< _dup_time brackets the sample
+  uint32_t _sample_time;                  ///< When the last sample was ready
+  bool _have_sample_time;                 ///< _sample_time is valid
+  uint32_t _interval_count;               ///< Intervals in the statistics
+  uint32_t _interval_min;                 ///< Shortest interval
+  uint32_t _interval_max;                 ///< Longest interval
+  float _interval_mean;                   ///< Running mean interval
+  float _interval_m2;                     ///< Running sum of squared deviations
+  uint16_t _track_band;                   ///< Dead-band in Q16, 0 = off
+  uint8_t _track_channel;                 ///< Channel the window follows
+  uint16_t _track_window[2];              ///< Threshold words last written
+  bool _track_latch;                      ///< LATCH to restore when stopped
+  opt4048_int_cfg_t _track_int_cfg;       ///< INT_CFG to restore when stopped
+#ifdef OPT4048_INSTRUMENTATION
+  /**
+   * @brief Times a traced method and routes its bus traffic to its stats
+   */
+  class CallTrace {
+   public:
+    CallTrace(Adafruit_OPT4048* sensor, opt4048_call_t call);
+    ~CallTrace();
+
+   private:
+    Adafruit_OPT4048* _sensor; ///< Sensor whose stats are updated
+    bool _outer;               ///< Outermost traced call, records the stats
+  };
+
+  opt4048_call_stats_t _call_stats[OPT4048_CALL_COUNT]; ///< Per method
+
+  opt4048_call_t _active_call; ///< Call being traced, COUNT if none
+  uint32_t _call_start;        ///< micros() when it started
+#endif
+  bool transfer(const uint8_t* out, size_t outLen, uint8_t* in, size_t inLen);
+  void crcError(void);
+  bool readChannels(uint8_t channels, uint32_t* values, bool onlyNew);
+  bool decodeChannel(uint8_t ch, uint8_t* buf, uint32_t* value,
+                     uint8_t* counter, int8_t expected);
+  void resetState(void);
+  void trackSample(uint8_t counter);
+  void trackSampleTime(uint32_t now);
+  static void windowAround(uint32_t value, uint16_t band, uint16_t* window);
+  bool moveWindow(uint32_t value);
+  bool readRegisters(uint8_t reg, uint16_t* values, uint8_t count);
+  bool writeRegisters(uint8_t reg, const uint16_t* values, uint8_t count);
+  bool writeShadowBits(uint8_t reg, uint16_t* shadow, uint8_t bits,
+                       uint8_t shift, uint16_t value);
 };
 
 #endif // ADAFRUIT_OPT4048_H
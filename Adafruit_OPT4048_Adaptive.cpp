@@ -0,0 +1,160 @@
+/*!
+ * @file Adafruit_OPT4048_Adaptive.cpp
+ *
+ * Software controller that adapts the OPT4048 conversion time and range to
+ * the light level.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048_Adaptive.h"
+
+/**
+ * @brief Construct a controller for a sensor
+ *
+ * Defaults to a target SNR of 1000 (about 60 dB), the full span of
+ * conversion times and 4 stable samples before speeding up.
+ *
+ * @param sensor The sensor to control, already begun
+ */
+Adafruit_OPT4048_Adaptive::Adafruit_OPT4048_Adaptive(Adafruit_OPT4048* sensor) {
+  _sensor = sensor;
+  _target_snr = 1000;
+  _fastest = OPT4048_CONVERSION_TIME_600US;
+  _slowest = OPT4048_CONVERSION_TIME_800MS;
+  _stable_needed = 4;
+  _stable_count = 0;
+  _last_weakest = 0;
+}
+
+/**
+ * @brief Set the signal to noise ratio to aim for
+ *
+ * The SNR is the signal of the weakest channel in effective LSBs, i.e. the
+ * quantization limited SNR at the current conversion time.
+ *
+ * @param snr Minimum wanted SNR as a plain ratio
+ */
+void Adafruit_OPT4048_Adaptive::setTargetSNR(uint16_t snr) {
+  _target_snr = snr;
+}
+
+/**
+ * @brief Restrict the conversion times the controller may choose
+ *
+ * @param fastest Shortest allowed conversion time
+ * @param slowest Longest allowed conversion time
+ */
+void Adafruit_OPT4048_Adaptive::setLimits(opt4048_conversion_time_t fastest,
+                                          opt4048_conversion_time_t slowest) {
+  _fastest = fastest;
+  _slowest = slowest;
+}
+
+/**
+ * @brief Set how many steady samples are needed before speeding up
+ *
+ * A sample counts as steady if its weakest channel is within 1/8 of the
+ * previous one.
+ *
+ * @param samples Number of consecutive steady samples
+ */
+void Adafruit_OPT4048_Adaptive::setStableSamples(uint8_t samples) {
+  _stable_needed = samples;
+}
+
+/**
+ * @brief Feed a decoded sample and adjust the sensor if needed
+ *
+ * Only changes the cached configuration through setConversionTime() and
+ * setRange(), so it costs one register write when something changes and no
+ * bus traffic otherwise.
+ *
+ * @param values Array of 4 ADC codes indexed by channel number
+ * @param channels Bitmask of the OPT4048_CHANNEL_* values that are valid
+ * @param flags Status flags from getFlags(), if read; only
+ * OPT4048_FLAG_OVERLOAD is used
+ * @return true if the configuration was changed, false otherwise
+ */
+bool Adafruit_OPT4048_Adaptive::update(const uint32_t* values,
+                                       uint8_t channels, uint8_t flags) {
+  if (!_sensor || !values || !(channels & OPT4048_CHANNEL_ALL)) {
+    return false;
+  }
+
+  uint32_t weakest = 0xFFFFFFFF;
+  uint32_t strongest = 0;
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    if (channels & (1 << ch)) {
+      if (values[ch] < weakest) {
+        weakest = values[ch];
+      }
+      if (values[ch] > strongest) {
+        strongest = values[ch];
+      }
+    }
+  }
+
+  uint8_t range = _sensor->getRange();
+  uint8_t convTime = _sensor->getConversionTime();
+
+  // ADC code = mantissa << exponent with a 20 bit mantissa. In a fixed range
+  // the exponent is the range; in auto range the sensor keeps the mantissa
+  // as large as possible, so the exponent is what lifts the code past 20 bits
+  uint8_t exponent = 0;
+  if (range <= OPT4048_RANGE_144K_LUX) {
+    exponent = range;
+  } else {
+    while ((strongest >> exponent) > 0xFFFFF) {
+      exponent++;
+    }
+  }
+
+  // Adjust a fixed range first, the conversion time decision depends on it
+  if (range <= OPT4048_RANGE_144K_LUX) {
+    uint32_t peak = strongest >> exponent;
+    int8_t step = 0;
+    if (((flags & OPT4048_FLAG_OVERLOAD) || peak >= 0xF0000) &&
+        range < OPT4048_RANGE_144K_LUX) {
+      step = 1;
+    } else if (peak < 0x20000 && range > OPT4048_RANGE_2K_LUX) {
+      step = -1;
+    }
+    if (step) {
+      _stable_count = 0;
+      _last_weakest = weakest;
+      return _sensor->setRange((opt4048_range_t)(range + step));
+    }
+  }
+
+  // Effective LSBs: 9 bits at 600us plus one per conversion time step
+  uint32_t snr = (weakest >> exponent) >> (11 - convTime);
+
+  // |weakest - last| <= last / 8, folded into one unsigned comparison
+  if (weakest - _last_weakest + (_last_weakest >> 3) <= (_last_weakest >> 2)) {
+    if (_stable_count < 255) {
+      _stable_count++;
+    }
+  } else {
+    _stable_count = 0;
+  }
+  _last_weakest = weakest;
+
+  int8_t step = 0;
+  if (snr < _target_snr && convTime < _slowest) {
+    step = 1;
+  } else if (snr >= 4 * (uint32_t)_target_snr && convTime > _fastest &&
+             _stable_count >= _stable_needed) {
+    step = -1;
+  }
+  if (!step) {
+    return false;
+  }
+
+  _stable_count = 0;
+  return _sensor->setConversionTime(
+      (opt4048_conversion_time_t)(convTime + step));
+}
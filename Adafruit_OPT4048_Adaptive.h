@@ -0,0 +1,56 @@
+/*!
+ * @file Adafruit_OPT4048_Adaptive.h
+ *
+ * Software controller that adapts the OPT4048 conversion time and range to
+ * the light level.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_ADAPTIVE_H
+#define ADAFRUIT_OPT4048_ADAPTIVE_H
+
+#include "Adafruit_OPT4048.h"
+
+/**
+ * @brief Picks the fastest conversion time that still meets a target SNR
+ *
+ * The sensor resolves 9 effective bits at 600us per channel and one more
+ * bit for every doubling of the conversion time, up to 20 bits at 800ms.
+ * Feed every decoded sample to update(): the signal of the weakest channel,
+ * counted in effective LSBs of the current conversion time, is compared to
+ * the target SNR.
+ *
+ * - Too dim: the conversion time is lengthened at once.
+ * - At least four times the target for several stable samples in a row:
+ *   the conversion time is shortened one step. The signal then still has
+ *   twice the target, so the two rules can't oscillate.
+ *
+ * With a fixed range, the range is stepped up on overload or near full
+ * scale, and down below 1/8 of full scale. With OPT4048_RANGE_AUTO, the
+ * range is left to the sensor.
+ */
+class Adafruit_OPT4048_Adaptive {
+ public:
+  Adafruit_OPT4048_Adaptive(Adafruit_OPT4048* sensor);
+
+  void setTargetSNR(uint16_t snr);
+  void setLimits(opt4048_conversion_time_t fastest,
+                 opt4048_conversion_time_t slowest);
+  void setStableSamples(uint8_t samples);
+  bool update(const uint32_t* values, uint8_t channels, uint8_t flags = 0);
+
+ private:
+  Adafruit_OPT4048* _sensor;    ///< The sensor being controlled
+  uint16_t _target_snr;         ///< Wanted signal in effective LSBs
+  uint8_t _fastest;             ///< Shortest allowed conversion time
+  uint8_t _slowest;             ///< Longest allowed conversion time
+  uint8_t _stable_needed;       ///< Stable samples before speeding up
+  uint8_t _stable_count;        ///< Consecutive stable samples so far
+  uint32_t _last_weakest;       ///< Weakest channel of the last sample
+};
+
+#endif // ADAFRUIT_OPT4048_ADAPTIVE_H
@@ -0,0 +1,168 @@
+/*!
+ * @file Adafruit_OPT4048_CCTTable.h
+ *
+ * Planckian locus table for opt4048_calculateCCT(), generated by
+ * extras/opt4048_cct with "opt4048_cct -g". Do not edit.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_CCTTABLE_H
+#define ADAFRUIT_OPT4048_CCTTABLE_H
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+/**
+ * @brief One isotemperature line of the locus, in CIE 1960 u,v
+ */
+typedef struct {
+  float mired; ///< Temperature in mired (1e6 / K)
+  float u;     ///< u of the locus
+  float v;     ///< v of the locus
+  float tu;    ///< u of the unit tangent towards lower K
+  float tv;    ///< v of the unit tangent towards lower K
+} opt4048_cct_entry_t;
+
+#define OPT4048_CCT_ENTRIES 128 //!< Entries in opt4048_cctTable
+
+// 100000K to 1000K in steps of 3.69%
+static const opt4048_cct_entry_t opt4048_cctTable[] PROGMEM = {
+    {10, 0.180638269, 0.265950332, 0.247575963, 0.968868486},
+    {10.3692664, 0.180661596, 0.266041538, 0.248002631, 0.968759359},
+    {10.7521685, 0.180685899, 0.266136382, 0.248448294, 0.968645159},
+    {11.14921, 0.180711223, 0.266235016, 0.248913897, 0.968525618},
+    {11.5609128, 0.180737615, 0.266337601, 0.249400437, 0.968400445},
+    {11.9878185, 0.180765126, 0.266444305, 0.249908968, 0.968269336},
+    {12.4304883, 0.180793807, 0.266555305, 0.250440604, 0.968131966},
+    {12.8895044, 0.180823715, 0.266670785, 0.250996522, 0.967987989},
+    {13.3654705, 0.180854909, 0.266790936, 0.251577967, 0.967837035},
+    {13.8590124, 0.180887449, 0.266915961, 0.252186255, 0.967678713},
+    {14.3707791, 0.180921403, 0.267046071, 0.252822781, 0.967512605},
+    {14.9014437, 0.180956838, 0.267181486, 0.253489017, 0.967338265},
+    {15.4517039, 0.180993829, 0.267322437, 0.254186525, 0.967155215},
+    {16.0222834, 0.181032451, 0.267469168, 0.254916955, 0.96696295},
+    {16.6139325, 0.181072788, 0.267621931, 0.255682059, 0.966760924},
+    {17.2274291, 0.181114926, 0.267780991, 0.256483689, 0.966548559},
+    {17.8635802, 0.181158956, 0.267946628, 0.257323809, 0.966325234},
+    {18.5232222, 0.181204977, 0.268119132, 0.258204501, 0.966090283},
+    {19.2072225, 0.18125309, 0.268298808, 0.259127969, 0.965842997},
+    {19.9164806, 0.181303406, 0.268485976, 0.260096554, 0.965582613},
+    {20.6519293, 0.181356041, 0.26868097, 0.261112734, 0.965308314},
+    {21.4145356, 0.181411119, 0.268884141, 0.262179139, 0.965019222},
+    {22.2053025, 0.18146877, 0.269095857, 0.263298558, 0.964714398},
+    {23.0252696, 0.181529135, 0.269316502, 0.264473951, 0.964392829},
+    {23.8755154, 0.181592361, 0.269546478, 0.265708456, 0.96405343},
+    {24.7571579, 0.181658608, 0.269786207, 0.267005403, 0.963695032},
+    {25.6713566, 0.181728043, 0.27003613, 0.268368326, 0.963316377},
+    {26.6193135, 0.181800846, 0.27029671, 0.269800974, 0.96291611},
+    {27.6022752, 0.181877208, 0.27056843, 0.271307324, 0.962492772},
+    {28.6215345, 0.181957335, 0.270851795, 0.272891597, 0.962044789},
+    {29.6784315, 0.182041443, 0.271147334, 0.274558271, 0.961570463},
+    {30.7743562, 0.182129766, 0.2714556, 0.276312097, 0.961067961},
+    {31.9107497, 0.182222553, 0.27177717, 0.278158112, 0.960535301},
+    {33.0891064, 0.18232007, 0.272112646, 0.28010166, 0.959970343},
+    {34.3109759, 0.182422602, 0.27246266, 0.282148406, 0.959370771},
+    {35.5779649, 0.182530454, 0.272827865, 0.284304356, 0.958734078},
+    {36.8917395, 0.182643951, 0.273208948, 0.286575874, 0.95805755},
+    {38.2540275, 0.182763444, 0.273606618, 0.288969698, 0.957338244},
+    {39.6666201, 0.182889307, 0.274021618, 0.291492968, 0.956572971},
+    {41.131375, 0.183021941, 0.274454717, 0.294153234, 0.955758272},
+    {42.6502184, 0.183161777, 0.274906715, 0.296958485, 0.954890391},
+    {44.2251476, 0.183309278, 0.275378439, 0.299917163, 0.953965249},
+    {45.8582337, 0.183464939, 0.275870747, 0.303038184, 0.952978415},
+    {47.5516241, 0.183629293, 0.276384525, 0.306330957, 0.951925073},
+    {49.3075457, 0.18380291, 0.276920688, 0.309805402, 0.950799986},
+    {51.1283076, 0.183986404, 0.277480176, 0.313471964, 0.949597456},
+    {53.0163041, 0.184180434, 0.278063956, 0.317341629, 0.948311283},
+    {54.974018, 0.184385708, 0.27867302, 0.321425939, 0.946934721},
+    {57.0040237, 0.184602986, 0.27930838, 0.325736995, 0.945460422},
+    {59.1089906, 0.184833084, 0.279971069, 0.330287471, 0.943880388},
+    {61.291687, 0.185076878, 0.280662134, 0.335090606, 0.942185908},
+    {63.5549829, 0.185335309, 0.281382636, 0.340160207, 0.940367499},
+    {65.9018548, 0.185609388, 0.282133643, 0.345510635, 0.938414834},
+    {68.3353887, 0.185900197, 0.282916226, 0.351156788, 0.936316672},
+    {70.8587849, 0.1862089, 0.283731452, 0.357114068, 0.934060781},
+    {73.4753616, 0.18653674, 0.284580381, 0.363398349, 0.931633855},
+    {76.1885597, 0.186885053, 0.285464052, 0.370025922, 0.92902143},
+    {79.0019471, 0.187255268, 0.286383481, 0.377013427, 0.926207793},
+    {81.9192234, 0.187648912, 0.287339647, 0.384377774, 0.923175891},
+    {84.944225, 0.188067617, 0.288333486, 0.392136043, 0.919907237},
+    {88.0809297, 0.188513128, 0.289365877, 0.400305354, 0.916381811},
+    {91.3334623, 0.188987303, 0.290437632, 0.40890273, 0.912577973},
+    {94.7061, 0.189492123, 0.29154948, 0.417944916, 0.90847237},
+    {98.2032779, 0.190029692, 0.292702059, 0.427448182, 0.904039851},
+    {101.829595, 0.190602249, 0.293895895, 0.437428088, 0.899253395},
+    {105.589819, 0.191212164, 0.295131395, 0.447899215, 0.894084052},
+    {109.488897, 0.191861951, 0.296408824, 0.458874867, 0.888500904},
+    {113.531953, 0.192554262, 0.297728295, 0.470366723, 0.882471045},
+    {117.724307, 0.193291898, 0.299089751, 0.482384462, 0.875959606},
+    {122.07147, 0.194077807, 0.30049295, 0.494935344, 0.868929805},
+    {126.579159, 0.194915085, 0.301937449, 0.508023754, 0.861343059},
+    {131.253301, 0.19580698, 0.303422591, 0.521650714, 0.853159149},
+    {136.100045, 0.196756887, 0.304947487, 0.535813362, 0.84433645},
+    {141.125762, 0.197768353, 0.30651101, 0.550504414, 0.834832253},
+    {146.337062, 0.198845066, 0.308111775, 0.565711604, 0.824603166},
+    {151.740797, 0.199990862, 0.309748135, 0.581417133, 0.813605628},
+    {157.344075, 0.201209713, 0.31141817, 0.59759713, 0.801796526},
+    {163.154263, 0.202505722, 0.313119679, 0.614221152, 0.789133941},
+    {169.179001, 0.203883123, 0.314850178, 0.631251738, 0.775578006},
+    {175.426213, 0.205346267, 0.316606895, 0.648644057, 0.761091905},
+    {181.904113, 0.206899616, 0.318386771, 0.666345672, 0.745642974},
+    {188.621221, 0.208547733, 0.320186464, 0.684296455, 0.729203923},
+    {195.586368, 0.210295275, 0.322002351, 0.702428683, 0.711754132},
+    {202.808715, 0.212146974, 0.323830534, 0.720667358, 0.69328101},
+    {210.297759, 0.214107634, 0.325666857, 0.738930767, 0.67378136},
+    {218.063349, 0.21618211, 0.327506911, 0.757131318, 0.653262709},
+    {226.115695, 0.218375297, 0.329346055, 0.775176654, 0.631744534},
+    {234.465388, 0.220692113, 0.33117943, 0.792971051, 0.609259314},
+    {243.123406, 0.223137483, 0.333001986, 0.810417087, 0.585853348},
+    {252.101136, 0.225716321, 0.334808501, 0.827417533, 0.561587238},
+    {261.410384, 0.228433508, 0.336593612, 0.843877433, 0.536536},
+    {271.06339, 0.231293873, 0.338351844, 0.859706272, 0.51078873},
+    {281.07285, 0.234302171, 0.340077646, 0.874820169, 0.4844478},
+    {291.451926, 0.237463056, 0.341765428, 0.889143974, 0.457627571},
+    {302.214266, 0.240781061, 0.343409598, 0.902613165, 0.430452638},
+    {313.374022, 0.244260564, 0.345004613, 0.915175458, 0.40305568},
+    {324.945872, 0.247905768, 0.346545015, 0.926792019, 0.375574964},
+    {336.94503, 0.251720668, 0.348025491, 0.937438233, 0.348151634},
+    {349.387277, 0.25570902, 0.349440914, 0.947103972, 0.320926885},
+    {362.288975, 0.259874316, 0.3507864, 0.955793371, 0.294039167},
+    {375.667089, 0.26421975, 0.352057358, 0.963524116, 0.267621519},
+    {389.539212, 0.26874819, 0.353249541, 0.970326318, 0.241799165},
+    {403.923585, 0.273462146, 0.354359098, 0.976241032, 0.21668744},
+    {418.839125, 0.278363742, 0.355382617, 0.981318522, 0.192390119},
+    {434.305446, 0.283454687, 0.356317174, 0.985616365, 0.168998169},
+    {450.342886, 0.288736243, 0.357160363, 0.989197494, 0.14658894},
+    {466.972535, 0.294209203, 0.357910335, 0.992128271, 0.125225769},
+    {484.216261, 0.299873854, 0.358565818, 0.99447666, 0.104957958},
+    {502.09674, 0.305729955, 0.359126139, 0.996310566, 0.0858210717},
+    {520.637485, 0.311776702, 0.359591225, 0.997696383, 0.0678375112},
+    {539.862877, 0.318012703, 0.35996161, 0.99869777, 0.0510172841},
+    {559.798198, 0.324435937, 0.36023842, 0.999374677, 0.035358933},
+    {580.469663, 0.331043725, 0.360423358, 0.999782603, 0.020850562},
+    {601.904457, 0.337832691, 0.360518675, 0.999972092, 0.00747092389},
+    {624.130765, 0.344798721, 0.360527138, 0.999988434, -0.00480946712},
+    {647.177816, 0.351936917, 0.360451986, 0.999871556, -0.0160272226},
+    {671.075917, 0.359241554, 0.360296885, 0.999656066, -0.0262249852},
+    {695.856495, 0.366706029, 0.360065876, 0.999371438, -0.0354503667},
+    {721.552136, 0.374322814, 0.35976332, 0.999042295, -0.0437549255},
+    {748.196631, 0.382083402, 0.359393844, 0.998688769, -0.0511931924},
+    {775.825017, 0.389978262, 0.358962284, 0.998326923, -0.0578217478},
+    {804.473627, 0.397996793, 0.35847363, 0.997969198, -0.0636983562},
+    {834.180133, 0.406127284, 0.357932972, 0.997624872, -0.0688811611},
+    {864.983601, 0.414356885, 0.357345454, 0.997300525, -0.0734279464},
+    {896.924538, 0.422671583, 0.356716226, 0.997000472, -0.0773954681},
+    {930.044946, 0.4310562, 0.356050403, 0.996727184, -0.0808388616},
+    {964.388379, 0.439494396, 0.355353034, 0.996481658, -0.0838111294},
+    {1000, 0.447968699, 0.354629068, 0.996263761, -0.0863627114},
+};
+
+#endif // ADAFRUIT_OPT4048_CCTTABLE_H
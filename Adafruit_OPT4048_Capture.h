@@ -0,0 +1,206 @@
+/*!
+ * @file Adafruit_OPT4048_Capture.h
+ *
+ * Interrupt driven capture of raw OPT4048 samples into a lock-free ring
+ * buffer, so a busy main loop drains samples in batches instead of losing
+ * them.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_CAPTURE_H
+#define ADAFRUIT_OPT4048_CAPTURE_H
+
+#include "Adafruit_OPT4048.h"
+
+#if defined(__AVR__)
+// Single core, only the compiler needs to be kept from reordering
+#define OPT4048_MEMORY_BARRIER() asm volatile("" ::: "memory")
+#else
+#define OPT4048_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+/**
+ * @brief One raw sample as captured from the bus
+ */
+typedef struct {
+  uint32_t timestamp; ///< micros() when the INT pin signalled data ready
+  uint8_t data[16];   ///< Channel registers 0x00-0x07, undecoded
+} opt4048_frame_t;
+
+/**
+ * @brief Decode a captured frame into ADC codes
+ *
+ * @param frame The frame to decode
+ * @param values Array of 4 ADC codes indexed by channel number
+ * @param counter Optional pointer to store the sample counter of channel 0
+ * @return true if all four channels passed the CRC check, false otherwise
+ */
+inline bool opt4048_decodeFrame(const opt4048_frame_t* frame, uint32_t* values,
+                                uint8_t* counter = nullptr) {
+  if (!opt4048_decodeChannel(frame->data, &values[0], counter)) {
+    return false;
+  }
+  for (uint8_t ch = 1; ch < 4; ch++) {
+    if (!opt4048_decodeChannel(&frame->data[4 * ch], &values[ch])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Single-producer/single-consumer ring of raw frames fed by INT
+ *
+ * interrupt() is called from the INT pin ISR and only records a timestamp,
+ * since I2C can't be used from an interrupt on most cores. service() then
+ * fetches the frame in a single 16 byte burst read; it is the only producer
+ * and can run from loop(), a timer task or another core. read() is the only
+ * consumer and drains any number of frames at once. The indices are single
+ * bytes written by one side each, so no locking is needed between service()
+ * and read() as long as each is only ever called from one context.
+ *
+ * Data ready interrupts that arrive before service() got to the previous
+ * one are counted by getMissed(), frames that arrive while the ring is full
+ * are dropped and counted by getOverflows().
+ *
+ * @tparam N Number of frames, a power of two no larger than 128
+ */
+template <uint8_t N>
+class Adafruit_OPT4048_Capture {
+  static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0,
+                "N must be a power of two no larger than 128");
+
+ public:
+  /**
+   * @brief Construct a capture ring for a sensor
+   *
+   * @param sensor The sensor to fetch frames from, already begun
+   */
+  Adafruit_OPT4048_Capture(Adafruit_OPT4048* sensor)
+      : _sensor(sensor), _head(0), _tail(0), _pending(0), _pending_time(0),
+        _overflows(0), _missed(0) {}
+
+  /**
+   * @brief Configure the sensor's INT pin for data ready on all channels
+   *
+   * @return true if the sensor accepted the configuration, false otherwise
+   */
+  bool begin(void) {
+    return _sensor->setInterruptConfig(OPT4048_INT_CFG_DATA_READY_ALL);
+  }
+
+  /**
+   * @brief Record a data ready event, call this from the INT pin ISR
+   */
+  void interrupt(void) {
+    _pending_time = micros();
+    if (_pending < 255) {
+      _pending++;
+    }
+  }
+
+  /**
+   * @brief Fetch the pending frame into the ring, if there is one
+   *
+   * @return true if a frame was added, false if nothing was pending, the
+   * read failed or the ring was full
+   */
+  bool service(void) {
+    noInterrupts();
+    uint8_t pending = _pending;
+    uint32_t timestamp = _pending_time;
+    _pending = 0;
+    interrupts();
+
+    if (!pending) {
+      return false;
+    }
+    // Only the latest conversion is still in the result registers
+    _missed += pending - 1;
+
+    uint8_t head = _head;
+    if ((uint8_t)(head - _tail) == N) {
+      _overflows++;
+      return false;
+    }
+
+    opt4048_frame_t* frame = &_frames[head & (N - 1)];
+    if (!_sensor->getFrameRaw(frame->data)) {
+      return false;
+    }
+    frame->timestamp = timestamp;
+
+    // Publish the frame only after its contents are written
+    OPT4048_MEMORY_BARRIER();
+    _head = head + 1;
+    return true;
+  }
+
+  /**
+   * @brief Remove frames from the ring
+   *
+   * @param frames Array to copy the oldest frames into
+   * @param max Size of the array
+   * @return Number of frames copied
+   */
+  uint8_t read(opt4048_frame_t* frames, uint8_t max) {
+    uint8_t tail = _tail;
+    uint8_t count = _head - tail;
+    OPT4048_MEMORY_BARRIER();
+
+    if (count > max) {
+      count = max;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      frames[i] = _frames[(uint8_t)(tail + i) & (N - 1)];
+    }
+
+    // Hand the slots back only after they have been copied out
+    OPT4048_MEMORY_BARRIER();
+    _tail = tail + count;
+    return count;
+  }
+
+  /**
+   * @brief Get the number of frames waiting to be read
+   *
+   * @return Frames in the ring
+   */
+  uint8_t available(void) {
+    return (uint8_t)(_head - _tail);
+  }
+
+  /**
+   * @brief Get the number of frames dropped because the ring was full
+   *
+   * @return Overflow count since construction
+   */
+  uint32_t getOverflows(void) {
+    return _overflows;
+  }
+
+  /**
+   * @brief Get the number of data ready events service() was too late for
+   *
+   * @return Missed conversion count since construction
+   */
+  uint32_t getMissed(void) {
+    return _missed;
+  }
+
+ private:
+  Adafruit_OPT4048* _sensor;       ///< Sensor frames are fetched from
+  opt4048_frame_t _frames[N];      ///< Ring storage
+  volatile uint8_t _head;          ///< Next slot to fill, producer owned
+  volatile uint8_t _tail;          ///< Next slot to read, consumer owned
+  volatile uint8_t _pending;       ///< Interrupts since the last service()
+  volatile uint32_t _pending_time; ///< Timestamp of the latest interrupt
+  uint32_t _overflows;             ///< Frames dropped on a full ring
+  uint32_t _missed;                ///< Conversions never fetched
+};
+
+#endif // ADAFRUIT_OPT4048_CAPTURE_H
@@ -0,0 +1,106 @@
+/*!
+ * @file Adafruit_OPT4048_Config.h
+ *
+ * OPT4048 configurations that are checked and encoded at compile time.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_CONFIG_H
+#define ADAFRUIT_OPT4048_CONFIG_H
+
+#include "Adafruit_OPT4048.h"
+
+/**
+ * @brief A complete sensor configuration as register words built by the
+ * compiler
+ *
+ * Holds the same fields as opt4048_config_t plus both thresholds, as
+ * template parameters. Invalid settings fail to compile, and the threshold
+ * (0x08, 0x09), configuration (0x0A) and threshold configuration (0x0B)
+ * words are constants, so applying one with Adafruit_OPT4048::setConfig()
+ * is a single 9 byte burst write with no encoding done at run time:
+ *
+ *   typedef Adafruit_OPT4048_Config<OPT4048_RANGE_AUTO,
+ *                                   OPT4048_CONVERSION_TIME_100MS,
+ *                                   OPT4048_MODE_CONTINUOUS>
+ *       MyConfig;
+ *   sensor.setConfig<MyConfig>();
+ *
+ * Reserved bits get their reset values. Thresholds are ADC codes, as
+ * returned by getChannelsRaw(); the low one is rounded down and the high
+ * one up to the nearest value the registers can hold.
+ *
+ * @tparam RANGE Full-scale light level range
+ * @tparam CONV_TIME Conversion time per channel
+ * @tparam MODE Operating mode
+ * @tparam QUICK_WAKE Quick Wake-up from standby, one-shot modes only
+ * @tparam LATCH Latched (true) or transparent interrupts
+ * @tparam INT_ACTIVE_HIGH INT pin polarity
+ * @tparam FAULT_COUNT Faults needed to trigger an INT
+ * @tparam THRESHOLD_CHANNEL Channel (0-3) compared against the thresholds
+ * @tparam INT_DIR INT pin is an output (true) or a one-shot trigger input
+ * @tparam INT_CFG Interrupt mechanism, must be OPT4048_INT_CFG_SMBUS_ALERT
+ * when INT is an input
+ * @tparam THRESHOLD_LOW Low threshold ADC code
+ * @tparam THRESHOLD_HIGH High threshold ADC code, the reset value by default
+ */
+template <opt4048_range_t RANGE, opt4048_conversion_time_t CONV_TIME,
+          opt4048_mode_t MODE, bool QUICK_WAKE = false, bool LATCH = true,
+          bool INT_ACTIVE_HIGH = true,
+          opt4048_fault_count_t FAULT_COUNT = OPT4048_FAULT_COUNT_1,
+          uint8_t THRESHOLD_CHANNEL = 0, bool INT_DIR = true,
+          opt4048_int_cfg_t INT_CFG = OPT4048_INT_CFG_DATA_READY_ALL,
+          uint32_t THRESHOLD_LOW = 0, uint32_t THRESHOLD_HIGH = 0x7FF80000>
+struct Adafruit_OPT4048_Config {
+  static_assert(RANGE <= OPT4048_RANGE_144K_LUX || RANGE == OPT4048_RANGE_AUTO,
+                "RANGE is not a valid range");
+  static_assert(CONV_TIME <= OPT4048_CONVERSION_TIME_800MS,
+                "CONV_TIME is not a valid conversion time");
+  static_assert(MODE <= OPT4048_MODE_CONTINUOUS, "MODE is not a valid mode");
+  static_assert(!QUICK_WAKE || MODE == OPT4048_MODE_ONESHOT ||
+                    MODE == OPT4048_MODE_AUTO_ONESHOT,
+                "QUICK_WAKE only applies to the one-shot modes");
+  static_assert(FAULT_COUNT <= OPT4048_FAULT_COUNT_8,
+                "FAULT_COUNT is not a valid fault count");
+  static_assert(THRESHOLD_CHANNEL <= 3, "THRESHOLD_CHANNEL must be 0 to 3");
+  static_assert(INT_CFG == OPT4048_INT_CFG_SMBUS_ALERT ||
+                    INT_CFG == OPT4048_INT_CFG_DATA_READY_NEXT ||
+                    INT_CFG == OPT4048_INT_CFG_DATA_READY_ALL,
+                "INT_CFG is not a valid interrupt configuration");
+  static_assert(INT_DIR || INT_CFG == OPT4048_INT_CFG_SMBUS_ALERT,
+                "INT can't signal data ready while it is an input");
+  static_assert(THRESHOLD_LOW <= THRESHOLD_HIGH,
+                "THRESHOLD_LOW must not be above THRESHOLD_HIGH");
+
+  /** Low threshold register (0x08) */
+  static constexpr uint16_t thresholdLow =
+      opt4048_encodeThreshold(THRESHOLD_LOW);
+
+  /** High threshold register (0x09) */
+  static constexpr uint16_t thresholdHigh =
+      opt4048_encodeThreshold(THRESHOLD_HIGH, true);
+
+  /**
+   * Configuration register (0x0A): QWAKE[15] RANGE[13:10]
+   * CONVERSION_TIME[9:6] OPERATING_MODE[5:4] LATCH[3] INT_POL[2]
+   * FAULT_COUNT[1:0]
+   */
+  static constexpr uint16_t config =
+      (uint16_t)QUICK_WAKE << 15 | (uint16_t)RANGE << 10 |
+      (uint16_t)CONV_TIME << 6 | (uint16_t)MODE << 4 | (uint16_t)LATCH << 3 |
+      (uint16_t)INT_ACTIVE_HIGH << 2 | (uint16_t)FAULT_COUNT;
+
+  /**
+   * Threshold configuration register (0x0B): reserved bit 15 set,
+   * THRESHOLD_CH_SEL[6:5] INT_DIR[4] INT_CFG[3:2] I2C_BURST[0] set
+   */
+  static constexpr uint16_t thresholdConfig =
+      0x8001 | (uint16_t)THRESHOLD_CHANNEL << 5 | (uint16_t)INT_DIR << 4 |
+      (uint16_t)INT_CFG << 2;
+};
+
+#endif // ADAFRUIT_OPT4048_CONFIG_H
@@ -0,0 +1,237 @@
+/*!
+ * @file Adafruit_OPT4048_Filter.h
+ *
+ * Streaming filters for raw OPT4048 channel codes.
+ *
+ * Smoothing the four integer ADC codes before a single color conversion is
+ * much cheaper than smoothing CIE x, y, lux or CCT after it, and averaging
+ * tristimulus values is the physically correct way to average light. Each
+ * filter takes the same array of 4 ADC codes returned by getChannelsRaw()
+ * and uses a fixed amount of memory set by its template parameter.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_FILTER_H
+#define ADAFRUIT_OPT4048_FILTER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Moving average over the last N samples, O(1) per sample
+ *
+ * Keeps a running sum per channel, so each sample costs one add and one
+ * subtract regardless of N. Until N samples have been seen, the average is
+ * over the samples so far.
+ *
+ * @tparam N Window length, at most 64 so the sums of 26 bit codes fit in 32
+ * bits
+ */
+template <uint8_t N>
+class Adafruit_OPT4048_Boxcar {
+  static_assert(N > 0 && N <= 64, "N must be between 1 and 64");
+
+ public:
+  /**
+   * @brief Construct an empty filter
+   */
+  Adafruit_OPT4048_Boxcar() {
+    reset();
+  }
+
+  /**
+   * @brief Forget all samples
+   */
+  void reset(void) {
+    _next = 0;
+    _count = 0;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      _sum[ch] = 0;
+    }
+  }
+
+  /**
+   * @brief Add a sample and get the filtered one
+   *
+   * @param in Array of 4 ADC codes indexed by channel number
+   * @param out Array to store the 4 averaged codes in, may be the same as in
+   */
+  void update(const uint32_t* in, uint32_t* out) {
+    bool full = _count == N;
+    if (!full) {
+      _count++;
+    }
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      uint32_t oldest = full ? _window[_next][ch] : 0;
+      _sum[ch] += in[ch] - oldest;
+      _window[_next][ch] = in[ch];
+      out[ch] = (_sum[ch] + _count / 2) / _count;
+    }
+    _next = _next + 1 == N ? 0 : _next + 1;
+  }
+
+ private:
+  uint32_t _window[N][4]; ///< Last N samples
+  uint32_t _sum[4];       ///< Running sum of the window per channel
+  uint8_t _next;          ///< Slot the next sample goes into
+  uint8_t _count;         ///< Samples in the window
+};
+
+/**
+ * @brief Integer exponential moving average, O(1) per sample
+ *
+ * Computes y += (x - y) / 2^SHIFT with SHIFT fractional bits of state and
+ * no multiply or divide, and stays within about one code of the exact
+ * average. The first sample initializes the average. The time constant is
+ * about 2^SHIFT samples.
+ *
+ * @tparam SHIFT Smoothing, 1 to 6; 6 keeps 26 bit codes within 32 bits
+ */
+template <uint8_t SHIFT>
+class Adafruit_OPT4048_EMA {
+  static_assert(SHIFT > 0 && SHIFT <= 6, "SHIFT must be between 1 and 6");
+
+ public:
+  /**
+   * @brief Construct an empty filter
+   */
+  Adafruit_OPT4048_EMA() {
+    reset();
+  }
+
+  /**
+   * @brief Forget all samples
+   */
+  void reset(void) {
+    _primed = false;
+  }
+
+  /**
+   * @brief Add a sample and get the filtered one
+   *
+   * @param in Array of 4 ADC codes indexed by channel number
+   * @param out Array to store the 4 averaged codes in, may be the same as in
+   */
+  void update(const uint32_t* in, uint32_t* out) {
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      if (!_primed) {
+        _acc[ch] = in[ch] << SHIFT;
+      } else {
+        _acc[ch] = _acc[ch] - (_acc[ch] >> SHIFT) + in[ch];
+      }
+      out[ch] = (_acc[ch] + (1 << (SHIFT - 1))) >> SHIFT;
+    }
+    _primed = true;
+  }
+
+ private:
+  uint32_t _acc[4]; ///< Average per channel with SHIFT fractional bits
+  bool _primed;     ///< Set once the first sample was seen
+};
+
+/**
+ * @brief Sliding median over the last N samples
+ *
+ * Rejects single-sample spikes, e.g. from flicker or a passing shadow,
+ * that would drag an average along. Each channel keeps its window sorted;
+ * the outgoing and incoming codes are located by binary search, so a
+ * sample costs O(log N) compares plus one short memory move per channel.
+ * Until N samples have been seen, the median is over the samples so far.
+ *
+ * @tparam N Window length, odd and at most 31
+ */
+template <uint8_t N>
+class Adafruit_OPT4048_Median {
+  static_assert(N > 0 && N <= 31 && (N & 1), "N must be odd and at most 31");
+
+ public:
+  /**
+   * @brief Construct an empty filter
+   */
+  Adafruit_OPT4048_Median() {
+    reset();
+  }
+
+  /**
+   * @brief Forget all samples
+   */
+  void reset(void) {
+    _next = 0;
+    _count = 0;
+  }
+
+  /**
+   * @brief Add a sample and get the filtered one
+   *
+   * @param in Array of 4 ADC codes indexed by channel number
+   * @param out Array to store the 4 median codes in, may be the same as in
+   */
+  void update(const uint32_t* in, uint32_t* out) {
+    bool full = _count == N;
+
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      uint32_t* sorted = _sorted[ch];
+      uint8_t size = _count;
+
+      if (full) {
+        // Drop the oldest sample, closing the gap it leaves
+        uint8_t pos = lowerBound(sorted, size, _window[_next][ch]);
+        for (uint8_t i = pos; i + 1 < size; i++) {
+          sorted[i] = sorted[i + 1];
+        }
+        size--;
+      }
+
+      // Insert the new one, opening a gap for it
+      uint8_t pos = lowerBound(sorted, size, in[ch]);
+      for (uint8_t i = size; i > pos; i--) {
+        sorted[i] = sorted[i - 1];
+      }
+      sorted[pos] = in[ch];
+      _window[_next][ch] = in[ch];
+      size++;
+
+      // Upper median while the window is still filling with an even count
+      out[ch] = sorted[size / 2];
+    }
+
+    if (!full) {
+      _count++;
+    }
+    _next = _next + 1 == N ? 0 : _next + 1;
+  }
+
+ private:
+  uint32_t _window[N][4]; ///< Last N samples in arrival order
+  uint32_t _sorted[4][N]; ///< Same samples, sorted per channel
+  uint8_t _next;          ///< Slot the next sample goes into
+  uint8_t _count;         ///< Samples in the window
+
+  /**
+   * @brief Find where a code goes in a sorted window
+   *
+   * @param sorted Codes in ascending order
+   * @param size Number of codes in sorted
+   * @param value The code to look for
+   * @return Index of the first code not less than value, size if none
+   */
+  static uint8_t lowerBound(const uint32_t* sorted, uint8_t size,
+                            uint32_t value) {
+    uint8_t lo = 0;
+    while (size) {
+      uint8_t half = size / 2;
+      if (sorted[lo + half] < value) {
+        lo += half + 1;
+        size -= half + 1;
+      } else {
+        size = half;
+      }
+    }
+    return lo;
+  }
+};
+
+#endif // ADAFRUIT_OPT4048_FILTER_H
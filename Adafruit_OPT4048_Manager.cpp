@@ -0,0 +1,249 @@
+/*!
+ * @file Adafruit_OPT4048_Manager.cpp
+ *
+ * Scheduler for several OPT4048 sensors on one or more I2C buses.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048_Manager.h"
+
+/**
+ * @brief Construct an empty manager
+ */
+Adafruit_OPT4048_Manager::Adafruit_OPT4048_Manager() {
+  _sensor_count = 0;
+  _bus_count = 0;
+  _begin_time = 0;
+}
+
+/**
+ * @brief Hand a sensor over to the manager
+ *
+ * The sensor must already be begun and configured; its conversion time and
+ * operating mode at the time of begin() determine the schedule. Sensors in
+ * power-down are run in forced auto-range one-shot mode. Sensors begun on
+ * the same TwoWire instance share a bus schedule.
+ *
+ * @param sensor The sensor to manage
+ * @param channels Bitmask of OPT4048_CHANNEL_* values to read per sample
+ * @return true if the sensor was added, false if it was not begun or the
+ * manager is full
+ */
+bool Adafruit_OPT4048_Manager::add(Adafruit_OPT4048* sensor,
+                                   uint8_t channels) {
+  if (!sensor || _sensor_count >= OPT4048_MANAGER_MAX_SENSORS) {
+    return false;
+  }
+  TwoWire* wire = sensor->getWire();
+  if (!wire) {
+    return false;
+  }
+
+  uint8_t bus = 0;
+  while (bus < _bus_count && _buses[bus].wire != wire) {
+    bus++;
+  }
+  if (bus == _bus_count) {
+    _buses[bus].wire = wire;
+    _buses[bus].busyUs = 0;
+    _bus_count++;
+  }
+
+  managed_sensor_t* ms = &_sensors[_sensor_count++];
+  ms->sensor = sensor;
+  ms->bus = bus;
+  ms->channels = channels;
+  ms->continuous = false;
+  ms->started = false;
+  ms->start = 0;
+  return true;
+}
+
+/**
+ * @brief Work out the staggered schedule and start measuring
+ *
+ * On each bus, the sensors are started one slot apart, where a slot is the
+ * shortest measurement time on that bus divided by the number of sensors on
+ * it. Continuous mode sensors are powered down here and put back into
+ * continuous mode at their slot, which fixes the phase of their
+ * conversions. The first sensor on each bus starts right away, the others
+ * from update().
+ *
+ * The sensors only stay a slot apart if they share a measurement time.
+ * Sensors with different ones convert at their own rates and drift through
+ * each other's slots, so their reads sometimes fall due together; update()
+ * then serves them one after the other, earliest first, which delays the
+ * later one by a single transaction.
+ *
+ * @return true if all sensors could be set up, false otherwise
+ */
+bool Adafruit_OPT4048_Manager::begin(void) {
+  _begin_time = micros();
+
+  for (uint8_t b = 0; b < _bus_count; b++) {
+    _buses[b].busyUs = 0;
+
+    uint8_t count = 0;
+    uint32_t period = 0xFFFFFFFF;
+    for (uint8_t i = 0; i < _sensor_count; i++) {
+      if (_sensors[i].bus == b) {
+        uint32_t t = _sensors[i].sensor->getMeasurementTime();
+        if (t < period) {
+          period = t;
+        }
+        count++;
+      }
+    }
+
+    uint32_t slot = period / count;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < _sensor_count; i++) {
+      managed_sensor_t* ms = &_sensors[i];
+      if (ms->bus != b) {
+        continue;
+      }
+
+      ms->continuous = ms->sensor->getMode() == OPT4048_MODE_CONTINUOUS;
+      if (ms->continuous && !ms->sensor->setMode(OPT4048_MODE_POWERDOWN)) {
+        return false;
+      }
+      ms->started = false;
+      ms->start = _begin_time + slot * n++;
+    }
+  }
+
+  update();
+  return true;
+}
+
+/**
+ * @brief Start sensors that are due and read sensors that are done
+ *
+ * Call this from loop() as often as possible. Sensors are only accessed
+ * once their measurement time has passed, in order of how long they have
+ * been due, so idle calls cause no bus traffic at all. A one-shot sensor
+ * that fails to be retriggered is started again on the next call.
+ *
+ * @return Number of sensors that produced a new sample in this call
+ */
+uint8_t Adafruit_OPT4048_Manager::update(void) {
+  uint8_t samples = 0;
+  uint32_t now = micros();
+
+  for (uint8_t i = 0; i < _sensor_count; i++) {
+    managed_sensor_t* ms = &_sensors[i];
+    if (!ms->started && (int32_t)(now - ms->start) >= 0) {
+      ms->started = startSensor(ms);
+    }
+  }
+
+  // Serve due sensors earliest first, so one that has waited longest is
+  // never held up behind one that just became due
+  uint8_t served = 0;
+  while (served < _sensor_count) {
+    managed_sensor_t* next = nullptr;
+    int32_t lateness = -1;
+    now = micros();
+
+    for (uint8_t i = 0; i < _sensor_count; i++) {
+      managed_sensor_t* ms = &_sensors[i];
+      if (!ms->started || !ms->sensor->isMeasuring()) {
+        continue;
+      }
+      int32_t late = (int32_t)(now - ms->sensor->getNextPoll());
+      if (late > lateness) {
+        lateness = late;
+        next = ms;
+      }
+    }
+    if (!next) {
+      break;
+    }
+
+    uint32_t t0 = micros();
+    bool done = next->sensor->poll();
+    if (done && !next->continuous &&
+        !next->sensor->startMeasurement(next->channels)) {
+      // Not measuring any more, so retry the start on the next update()
+      next->started = false;
+      next->start = micros();
+    }
+    _buses[next->bus].busyUs += micros() - t0;
+
+    if (done) {
+      samples++;
+    }
+    served++;
+  }
+
+  return samples;
+}
+
+/**
+ * @brief Get the number of sensors added
+ *
+ * @return The sensor count
+ */
+uint8_t Adafruit_OPT4048_Manager::getSensorCount(void) {
+  return _sensor_count;
+}
+
+/**
+ * @brief Get a managed sensor by the order it was added in
+ *
+ * @param index Position of the sensor, starting at 0
+ * @return The sensor, or nullptr if index is out of range
+ */
+Adafruit_OPT4048* Adafruit_OPT4048_Manager::getSensor(uint8_t index) {
+  if (index >= _sensor_count) {
+    return nullptr;
+  }
+  return _sensors[index].sensor;
+}
+
+/**
+ * @brief Get the share of time a bus spent on sensor transactions
+ *
+ * Measured with micros() around every bus access made by the manager since
+ * begin(), so it includes driver overhead and any time the transfer itself
+ * was stretched by the bus or the sensor.
+ *
+ * @param wire The bus to report on
+ * @return Busy time as a fraction from 0 to 1, or 0 for an unknown bus
+ */
+float Adafruit_OPT4048_Manager::getBusUtilization(TwoWire* wire) {
+  uint32_t elapsed = micros() - _begin_time;
+  if (!elapsed) {
+    return 0;
+  }
+
+  for (uint8_t b = 0; b < _bus_count; b++) {
+    if (_buses[b].wire == wire) {
+      return (float)_buses[b].busyUs / elapsed;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Start a sensor's first measurement at its staggered slot
+ *
+ * @param ms The sensor to start
+ * @return true if the sensor was started, false otherwise
+ */
+bool Adafruit_OPT4048_Manager::startSensor(managed_sensor_t* ms) {
+  uint32_t t0 = micros();
+  bool ok = true;
+
+  if (ms->continuous) {
+    ok = ms->sensor->setMode(OPT4048_MODE_CONTINUOUS);
+  }
+  ok = ok && ms->sensor->startMeasurement(ms->channels);
+
+  _buses[ms->bus].busyUs += micros() - t0;
+  return ok;
+}
@@ -0,0 +1,75 @@
+/*!
+ * @file Adafruit_OPT4048_Manager.h
+ *
+ * Scheduler for several OPT4048 sensors on one or more I2C buses.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_MANAGER_H
+#define ADAFRUIT_OPT4048_MANAGER_H
+
+#include "Adafruit_OPT4048.h"
+
+#define OPT4048_MANAGER_MAX_SENSORS 8 //!< Sensors one manager can own
+
+/**
+ * @brief Runs the non-blocking measurements of several sensors
+ *
+ * Sensors that share a bus are started at staggered times, so their
+ * conversions finish evenly spread over the measurement period and their
+ * result reads don't queue up behind each other. This holds for sensors
+ * with the same measurement time; see begin() for mixed ones. update() then
+ * only talks to sensors whose conversion time has passed, earliest first, so
+ * every sensor is read as soon as its sample can be ready. Sensors in a
+ * one-shot mode are retriggered right after each read; sensors in
+ * continuous mode keep running.
+ *
+ * New samples are delivered through each sensor's ready()/getMeasurement()
+ * and callback, exactly as with a single sensor.
+ */
+class Adafruit_OPT4048_Manager {
+ public:
+  Adafruit_OPT4048_Manager();
+
+  bool add(Adafruit_OPT4048* sensor, uint8_t channels = OPT4048_CHANNEL_ALL);
+  bool begin(void);
+  uint8_t update(void);
+  uint8_t getSensorCount(void);
+  Adafruit_OPT4048* getSensor(uint8_t index);
+  float getBusUtilization(TwoWire* wire);
+
+ private:
+  /**
+   * @brief Scheduling state of one managed sensor
+   */
+  typedef struct {
+    Adafruit_OPT4048* sensor; ///< The sensor
+    uint8_t bus;              ///< Index into _buses
+    uint8_t channels;         ///< Channels read on each sample
+    bool continuous;          ///< Free running rather than retriggered
+    bool started;             ///< Started, false again to retry a restart
+    uint32_t start;           ///< micros() of the (next) start attempt
+  } managed_sensor_t;
+
+  /**
+   * @brief Accounting for one I2C bus
+   */
+  typedef struct {
+    TwoWire* wire;   ///< The bus
+    uint32_t busyUs; ///< Time spent in transactions since begin()
+  } managed_bus_t;
+
+  managed_sensor_t _sensors[OPT4048_MANAGER_MAX_SENSORS]; ///< Sensors
+  managed_bus_t _buses[OPT4048_MANAGER_MAX_SENSORS];      ///< Buses in use
+  uint8_t _sensor_count;                                  ///< Sensors added
+  uint8_t _bus_count;                                     ///< Buses in use
+  uint32_t _begin_time;                                   ///< micros() at begin
+
+  bool startSensor(managed_sensor_t* ms);
+};
+
+#endif // ADAFRUIT_OPT4048_MANAGER_H
@@ -0,0 +1,959 @@
+/*!
+ * @file Adafruit_OPT4048_Math.cpp
+ *
+ * Hardware independent decode and color math for the OPT4048 sensor. This
+ * file deliberately only depends on the C library so that it can be built
+ * and benchmarked off-target.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution
+ */
+
+#include "Adafruit_OPT4048_Math.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "Adafruit_OPT4048_CCTTable.h"
+
+// Matrix multiplication coefficients (from datasheet)
+static constexpr double m0x = 2.34892992e-04;
+static constexpr double m0y = -1.89652390e-05;
+static constexpr double m0z = 1.20811684e-05;
+static constexpr double m0l = 0;
+
+static constexpr double m1x = 4.07467441e-05;
+static constexpr double m1y = 1.98958202e-04;
+static constexpr double m1z = -1.58848115e-05;
+static constexpr double m1l = 2.15e-3;
+
+static constexpr double m2x = 9.28619404e-05;
+static constexpr double m2y = -1.69739553e-05;
+static constexpr double m2z = 6.74021520e-04;
+static constexpr double m2l = 0;
+
+static constexpr double m3x = 0;
+static constexpr double m3y = 0;
+static constexpr double m3z = 0;
+static constexpr double m3l = 0;
+
+/**
+ * @brief Convert a coefficient to signed Q28 fixed point, rounding to nearest
+ *
+ * @param v The coefficient
+ * @return v * 2^28, rounded
+ */
+static constexpr int32_t toQ28(double v) {
+  return (int32_t)(v * 268435456.0 + (v < 0 ? -0.5 : 0.5));
+}
+
+/**
+ * @brief Convert a coefficient to signed Q24 fixed point, rounding to nearest
+ *
+ * @param v The coefficient
+ * @return v * 2^24, rounded
+ */
+static constexpr int32_t toQ24(double v) {
+  return (int32_t)(v * 16777216.0 + (v < 0 ? -0.5 : 0.5));
+}
+
+// X, Y and Z columns of the matrix in Q28, generated at compile time. The
+// W row and the lux column are left out since they only hold zeros apart
+// from m1l, which is exactly 43/20 mlux per code.
+static constexpr int32_t q0x = toQ28(m0x);
+static constexpr int32_t q0y = toQ28(m0y);
+static constexpr int32_t q0z = toQ28(m0z);
+static constexpr int32_t q1x = toQ28(m1x);
+static constexpr int32_t q1y = toQ28(m1y);
+static constexpr int32_t q1z = toQ28(m1z);
+static constexpr int32_t q2x = toQ28(m2x);
+static constexpr int32_t q2y = toQ28(m2y);
+static constexpr int32_t q2z = toQ28(m2z);
+
+// X + Y + Z per code of each channel, for the datasheet path of the
+// calibrated conversions
+static constexpr double m0s = m0x + m0y + m0z;
+static constexpr double m1s = m1x + m1y + m1z;
+static constexpr double m2s = m2x + m2y + m2z;
+
+/**
+ * @brief Compute the 4-bit CRC of one channel's output registers
+ *
+ * Implements the CRC formula from the datasheet:
+ * R[19:0]=(RESULT_MSB_CHx[11:0]<<8)+RESULT_LSB_CHx[7:0]
+ * X[0]=XOR(EXPONENT_CHx[3:0],R[19:0],COUNTER_CHx[3:0])
+ * X[1]=XOR(COUNTER_CHx[1],COUNTER_CHx[3],R[1],R[3],...,R[19],E[1],E[3])
+ * X[2]=XOR(COUNTER_CHx[3],R[3],R[7],R[11],R[15],R[19],E[3])
+ * X[3]=XOR(R[3],R[11],R[19])
+ *
+ * Instead of walking the bits one at a time, the 28 input bits are folded
+ * with XOR into a single nibble. Folding keeps every bit at its position
+ * modulo 4, and X[0..2] only ever combine bits that share such a position
+ * class, so each of them is the parity of some bits of that nibble. X[3]
+ * uses positions modulo 8, so the mantissa is folded into a byte for it.
+ *
+ * @param exp The 4-bit exponent
+ * @param mant The 20-bit mantissa
+ * @param counter The 4-bit sample counter
+ * @return The expected 4-bit CRC value
+ */
+uint8_t opt4048_calculateCRC(uint8_t exp, uint32_t mant, uint8_t counter) {
+  // 0x6996 is a 16-entry lookup table of nibble parities packed in a word
+  const uint16_t parity = 0x6996;
+
+  uint16_t m8 = (uint16_t)(mant ^ (mant >> 16));
+  m8 ^= m8 >> 8;
+  uint8_t nibble = (m8 ^ (m8 >> 4) ^ exp ^ counter) & 0x0F;
+
+  uint8_t x0 = (parity >> nibble) & 1;
+  uint8_t x1 = (parity >> (nibble & 0x0A)) & 1;
+  uint8_t x2 = (nibble >> 3) & 1;
+  uint8_t x3 = (m8 >> 3) & 1;
+
+  return (x3 << 3) | (x2 << 2) | (x1 << 1) | x0;
+}
+
+/**
+ * @brief Decode one channel's 4 output bytes into a 20-bit ADC code
+ *
+ * The bytes are laid out as read from RESULT_MSB_CHx and RESULT_LSB_CHx:
+ * EXPONENT[15:12] RESULT_MSB[11:0], RESULT_LSB[15:8] COUNTER[7:4] CRC[3:0].
+ *
+ * @param buf Pointer to the 4 bytes read for the channel
+ * @param code Pointer to store the ADC code (mantissa << exponent)
+ * @param counter Optional pointer to store the 4-bit sample counter
+ * @return true if the CRC matches, false otherwise
+ */
+bool opt4048_decodeChannel(const uint8_t* buf, uint32_t* code,
+                           uint8_t* counter) {
+  uint8_t exp = buf[0] >> 4;
+  uint32_t mant = ((uint32_t)(buf[0] & 0x0F) << 16) |
+                  ((uint32_t)buf[1] << 8) | buf[2];
+  uint8_t count = buf[3] >> 4;
+  uint8_t crc = buf[3] & 0x0F;
+
+  if (crc != opt4048_calculateCRC(exp, mant, count)) {
+    return false;
+  }
+
+  if (counter) {
+    *counter = count;
+  }
+
+  // Convert to 20-bit mantissa << exponent format
+  // This is safe because the sensor only uses exponents 0-6 in actual
+  // measurements (even when auto-range mode (12) is enabled in the
+  // configuration register)
+  *code = mant << exp;
+  return true;
+}
+
+/**
+ * @brief Encode an ADC code into one channel's 4 output bytes
+ *
+ * The inverse of opt4048_decodeChannel(): picks the smallest exponent that
+ * lets the mantissa fit in 20 bits and appends a valid CRC. This produces
+ * the same bytes the sensor would, which is useful for feeding recorded or
+ * synthetic samples through the decode path without hardware.
+ *
+ * @param code The ADC code to encode (at most 0xFFFFF << 15)
+ * @param counter The 4-bit sample counter to embed
+ * @param buf Pointer to 4 bytes to store the encoded channel in
+ */
+void opt4048_encodeChannel(uint32_t code, uint8_t counter, uint8_t* buf) {
+  uint8_t exp = 0;
+  while (code > 0xFFFFF && exp < 15) {
+    code >>= 1;
+    exp++;
+  }
+  uint32_t mant = code & 0xFFFFF;
+  counter &= 0x0F;
+
+  buf[0] = (exp << 4) | ((mant >> 16) & 0x0F);
+  buf[1] = (mant >> 8) & 0xFF;
+  buf[2] = mant & 0xFF;
+  buf[3] = (counter << 4) | opt4048_calculateCRC(exp, mant, counter);
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux from raw ADC codes
+ *
+ * Instantiated for double and float. On FPUs that only handle single
+ * precision, such as the Cortex-M4F, the float version avoids software
+ * emulated double math; on AVR both are the same since double is 32 bits.
+ *
+ * @param ch0 Channel 0 (X) ADC code
+ * @param ch1 Channel 1 (Y) ADC code
+ * @param ch2 Channel 2 (Z) ADC code
+ * @param ch3 Channel 3 (W) ADC code
+ * @param CIEx Pointer to store the calculated CIE x coordinate
+ * @param CIEy Pointer to store the calculated CIE y coordinate
+ * @param lux Pointer to store the calculated illuminance in lux
+ * @return True if calculation succeeded, false otherwise
+ */
+template <typename T>
+bool opt4048_calculateCIE(uint32_t ch0, uint32_t ch1, uint32_t ch2,
+                          uint32_t ch3, T* CIEx, T* CIEy, T* lux) {
+  // The equation from the datasheet is a matrix multiplication:
+  // [ch0 ch1 ch2 ch3] * [m0x m0y m0z m0l] = [X Y Z Lux]
+  //                     [m1x m1y m1z m1l]
+  //                     [m2x m2y m2z m2l]
+  //                     [m3x m3y m3z m3l]
+  T X = ch0 * (T)m0x + ch1 * (T)m1x + ch2 * (T)m2x + ch3 * (T)m3x;
+  T Y = ch0 * (T)m0y + ch1 * (T)m1y + ch2 * (T)m2y + ch3 * (T)m3y;
+  T Z = ch0 * (T)m0z + ch1 * (T)m1z + ch2 * (T)m2z + ch3 * (T)m3z;
+  T L = ch0 * (T)m0l + ch1 * (T)m1l + ch2 * (T)m2l + ch3 * (T)m3l;
+
+  // Set illuminance in lux
+  *lux = L;
+
+  // Calculate CIE x, y chromaticity coordinates
+  T sum = X + Y + Z;
+  if (sum <= 0) {
+    // Avoid division by zero
+    *CIEx = 0;
+    *CIEy = 0;
+    *lux = 0;
+    return false;
+  }
+
+  *CIEx = X / sum;
+  *CIEy = Y / sum;
+
+  return true;
+}
+
+template bool opt4048_calculateCIE<double>(uint32_t, uint32_t, uint32_t,
+                                           uint32_t, double*, double*,
+                                           double*);
+template bool opt4048_calculateCIE<float>(uint32_t, uint32_t, uint32_t,
+                                          uint32_t, float*, float*, float*);
+
+/**
+ * @brief Prepare a calibration matrix for the per-sample conversions
+ *
+ * The matrix has the same layout as the datasheet one used by
+ * opt4048_calculateCIE(): one row per channel, with the X, Y, Z and lux
+ * coefficients in that order. All the work that doesn't depend on the
+ * sample is done here, so the calibrated conversions skip zero terms and
+ * never compute Z, and cost no more than the datasheet versions.
+ *
+ * @param matrix The 4x4 calibration matrix, or nullptr for the datasheet one
+ * @param cal Pointer to store the prepared calibration in
+ * @return true on success, false if a coefficient is out of range (X, Y and
+ * X+Y+Z per code at most 8, lux per code at most 0.128) or no channel
+ * contributes to X, Y or Z
+ */
+bool opt4048_prepareCalibration(const float matrix[4][4],
+                                opt4048_calibration_t* cal) {
+  static const float datasheet[4][4] = {{m0x, m0y, m0z, m0l},
+                                        {m1x, m1y, m1z, m1l},
+                                        {m2x, m2y, m2z, m2l},
+                                        {m3x, m3y, m3z, m3l}};
+  if (!cal) {
+    return false;
+  }
+  if (!matrix) {
+    matrix = datasheet;
+  }
+
+  opt4048_calibration_t prepared;
+  prepared.datasheet = memcmp(matrix, datasheet, sizeof(datasheet)) == 0;
+  prepared.luxTerms = 0;
+  prepared.xyzChannels = 0;
+  prepared.luxChannels = 0;
+
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    const float* row = matrix[ch];
+    float k[3] = {row[0], row[1], row[0] + row[1] + row[2]};
+
+    for (uint8_t r = 0; r < 3; r++) {
+      // Also rejects NaN
+      if (!(k[r] > -8 && k[r] < 8)) {
+        return false;
+      }
+      prepared.xys[r][ch] = k[r];
+      prepared.xysFixed[r][ch] = toQ28(k[r]);
+    }
+    if (row[0] != 0 || row[1] != 0 || row[2] != 0) {
+      prepared.xyzChannels |= 1 << ch;
+    }
+
+    if (row[3] != 0) {
+      if (!(row[3] > -0.128f && row[3] < 0.128f)) {
+        return false;
+      }
+      uint8_t t = prepared.luxTerms++;
+      prepared.lux[t] = row[3];
+      prepared.luxFixed[t] = toQ24(row[3] * 1000.0);
+      prepared.luxChannel[t] = ch;
+      prepared.luxChannels |= 1 << ch;
+    }
+  }
+
+  if (!prepared.xyzChannels) {
+    return false;
+  }
+  *cal = prepared;
+  return true;
+}
+
+/**
+ * @brief Sum the X, Y and X+Y+Z terms of a prepared calibration
+ *
+ * Only the channels in cal->xyzChannels are read, so the others may be left
+ * uninitialized by the caller.
+ *
+ * @param values Array of 4 ADC codes indexed by channel number
+ * @param cal Calibration from opt4048_prepareCalibration()
+ * @param X Pointer to store X in
+ * @param Y Pointer to store Y in
+ * @return X + Y + Z
+ */
+template <typename T>
+static T calibratedXYZ(const uint32_t* values, const opt4048_calibration_t* cal,
+                       T* X, T* Y) {
+  T x = 0, y = 0, sum = 0;
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    if (cal->xyzChannels & (1 << ch)) {
+      T c = values[ch];
+      x += c * cal->xys[0][ch];
+      y += c * cal->xys[1][ch];
+      sum += c * cal->xys[2][ch];
+    }
+  }
+  *X = x;
+  *Y = y;
+  return sum;
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux with a calibration
+ *
+ * Same as the datasheet version, but with the coefficients of a matrix
+ * prepared by opt4048_prepareCalibration(). x and y are X and Y divided by
+ * the folded X+Y+Z row, and unused channels and zero lux terms are skipped.
+ * The datasheet matrix keeps its exact coefficients, in double precision
+ * for the double version.
+ *
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels in cal->xyzChannels and cal->luxChannels are used
+ * @param cal Calibration from opt4048_prepareCalibration()
+ * @param CIEx Pointer to store the calculated CIE x coordinate
+ * @param CIEy Pointer to store the calculated CIE y coordinate
+ * @param lux Pointer to store the calculated illuminance in lux
+ * @return True if calculation succeeded, false otherwise
+ */
+template <typename T>
+bool opt4048_calculateCIE(const uint32_t* values,
+                          const opt4048_calibration_t* cal, T* CIEx, T* CIEy,
+                          T* lux) {
+  T X, Y, sum, L;
+  if (cal->datasheet) {
+    T c0 = values[0], c1 = values[1], c2 = values[2];
+    X = c0 * (T)m0x + c1 * (T)m1x + c2 * (T)m2x;
+    Y = c0 * (T)m0y + c1 * (T)m1y + c2 * (T)m2y;
+    sum = c0 * (T)m0s + c1 * (T)m1s + c2 * (T)m2s;
+    L = c1 * (T)m1l;
+  } else {
+    sum = calibratedXYZ(values, cal, &X, &Y);
+    L = 0;
+    for (uint8_t i = 0; i < cal->luxTerms; i++) {
+      L += (T)values[cal->luxChannel[i]] * cal->lux[i];
+    }
+  }
+
+  if (sum <= 0) {
+    // Avoid division by zero
+    *CIEx = 0;
+    *CIEy = 0;
+    *lux = 0;
+    return false;
+  }
+
+  *lux = L;
+  *CIEx = X / sum;
+  *CIEy = Y / sum;
+  return true;
+}
+
+template bool opt4048_calculateCIE<double>(const uint32_t*,
+                                           const opt4048_calibration_t*,
+                                           double*, double*, double*);
+template bool opt4048_calculateCIE<float>(const uint32_t*,
+                                          const opt4048_calibration_t*,
+                                          float*, float*, float*);
+
+/**
+ * @brief Divide Q28 scaled X and Y by their X + Y + Z sum in 32 bits
+ *
+ * @param X X scaled by 2^28
+ * @param Y Y scaled by 2^28
+ * @param sum X + Y + Z scaled by 2^28
+ * @param CIEx Pointer to store CIE x as an unsigned Q16 fraction
+ * @param CIEy Pointer to store CIE y as an unsigned Q16 fraction
+ * @return false if sum is not positive, true otherwise
+ */
+static bool fixedChromaticity(int64_t X, int64_t Y, int64_t sum,
+                              uint16_t* CIEx, uint16_t* CIEy) {
+  if (sum <= 0) {
+    // Avoid division by zero
+    *CIEx = 0;
+    *CIEy = 0;
+    return false;
+  }
+
+  // Scale so that sum uses at most 16 bits, keeping as many as possible
+  while (sum >= ((int64_t)1 << 32)) {
+    sum >>= 16;
+    X >>= 16;
+    Y >>= 16;
+  }
+  uint32_t s = (uint32_t)sum;
+  uint8_t shift = 0;
+  while ((s >> shift) >= 0x10000) {
+    shift++;
+  }
+  s >>= shift;
+  int32_t x = (int32_t)(X >> shift);
+  int32_t y = (int32_t)(Y >> shift);
+
+  // A negative Y or Z can push a coordinate outside [0, 1), so clamp
+  x = x < 0 ? 0 : (x >= (int32_t)s ? (int32_t)s - 1 : x);
+  y = y < 0 ? 0 : (y >= (int32_t)s ? (int32_t)s - 1 : y);
+
+  *CIEx = (((uint32_t)x << 16) + s / 2) / s;
+  *CIEy = (((uint32_t)y << 16) + s / 2) / s;
+  return true;
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux in fixed point
+ *
+ * Integer-only version of opt4048_calculateCIE() for MCUs without an FPU.
+ * X, Y and Z are accumulated in 64 bits with Q28 coefficients, then scaled
+ * down together so the divisions for x and y are 32 bit.
+ *
+ * Error bounds against the double version, for any codes where X+Y+Z > 0 and
+ * x, y lie in [0, 1): x and y are within 3 LSB (4.6e-5), and lux is
+ * truncated to a whole mlux.
+ * The W channel has no coefficients, so it is not an input.
+ *
+ * @param ch0 Channel 0 (X) ADC code
+ * @param ch1 Channel 1 (Y) ADC code
+ * @param ch2 Channel 2 (Z) ADC code
+ * @param CIEx Pointer to store CIE x as an unsigned Q16 fraction
+ * @param CIEy Pointer to store CIE y as an unsigned Q16 fraction
+ * @param milliLux Pointer to store the illuminance in thousandths of a lux
+ * @return True if calculation succeeded, false otherwise
+ */
+bool opt4048_calculateCIEFixed(uint32_t ch0, uint32_t ch1, uint32_t ch2,
+                               uint16_t* CIEx, uint16_t* CIEy,
+                               uint32_t* milliLux) {
+  int64_t X = (int64_t)ch0 * q0x + (int64_t)ch1 * q1x + (int64_t)ch2 * q2x;
+  int64_t Y = (int64_t)ch0 * q0y + (int64_t)ch1 * q1y + (int64_t)ch2 * q2y;
+  int64_t Z = (int64_t)ch0 * q0z + (int64_t)ch1 * q1z + (int64_t)ch2 * q2z;
+
+  // m1l is 2.15e-3 lux per code, i.e. exactly 43/20 mlux. ch1 is at most
+  // 26 bits, so the product fits in 32 bits.
+  *milliLux = (ch1 * 43) / 20;
+
+  if (!fixedChromaticity(X, Y, X + Y + Z, CIEx, CIEy)) {
+    *milliLux = 0;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Calculate CIE chromaticity coordinates and lux with a calibration
+ *
+ * Fixed point version of the calibrated opt4048_calculateCIE(), using the
+ * Q28 and Q24 coefficients of the prepared calibration. The datasheet
+ * matrix goes through the 3 channel version, with the same error bounds.
+ *
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels in cal->xyzChannels and cal->luxChannels are used
+ * @param cal Calibration from opt4048_prepareCalibration()
+ * @param CIEx Pointer to store CIE x as an unsigned Q16 fraction
+ * @param CIEy Pointer to store CIE y as an unsigned Q16 fraction
+ * @param milliLux Pointer to store the illuminance in thousandths of a lux
+ * @return True if calculation succeeded, false otherwise
+ */
+bool opt4048_calculateCIEFixed(const uint32_t* values,
+                               const opt4048_calibration_t* cal,
+                               uint16_t* CIEx, uint16_t* CIEy,
+                               uint32_t* milliLux) {
+  // The datasheet matrix has an exact 32 bit lux multiply
+  if (cal->datasheet) {
+    return opt4048_calculateCIEFixed(values[0], values[1], values[2], CIEx,
+                                     CIEy, milliLux);
+  }
+
+  int64_t X = 0, Y = 0, sum = 0;
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    if (cal->xyzChannels & (1 << ch)) {
+      int64_t c = values[ch];
+      X += c * cal->xysFixed[0][ch];
+      Y += c * cal->xysFixed[1][ch];
+      sum += c * cal->xysFixed[2][ch];
+    }
+  }
+
+  int64_t L = 0;
+  for (uint8_t i = 0; i < cal->luxTerms; i++) {
+    L += (int64_t)values[cal->luxChannel[i]] * cal->luxFixed[i];
+  }
+  L >>= 24;
+  *milliLux = L <= 0 ? 0 : (L > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)L);
+
+  if (!fixedChromaticity(X, Y, sum, CIEx, CIEy)) {
+    *milliLux = 0;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Calculate illuminance from the channel 1 (Y) ADC code alone
+ *
+ * Only the channel 1 column of the datasheet matrix contributes to lux, so
+ * this gives the same result as opt4048_calculateCIE() without needing the
+ * other three channels.
+ *
+ * @param ch1 Channel 1 (Y) ADC code
+ * @return The illuminance in lux
+ */
+double opt4048_calculateLux(uint32_t ch1) {
+  return ch1 * m1l;
+}
+
+/**
+ * @brief Calculate illuminance with a calibration
+ *
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels in cal->luxChannels are used
+ * @param cal Calibration from opt4048_prepareCalibration()
+ * @return The illuminance in lux
+ */
+double opt4048_calculateLux(const uint32_t* values,
+                            const opt4048_calibration_t* cal) {
+  if (cal->datasheet) {
+    return opt4048_calculateLux(values[1]);
+  }
+
+  double L = 0;
+  for (uint8_t i = 0; i < cal->luxTerms; i++) {
+    L += (double)values[cal->luxChannel[i]] * cal->lux[i];
+  }
+  return L;
+}
+
+/**
+ * @brief Calculate the correlated color temperature (CCT) in Kelvin
+ *
+ * Uses McCamy's approximation formula to calculate CCT from CIE 1931 x,y
+ * coordinates. This is accurate for color temperatures between 2000K and
+ * 30000K.
+ *
+ * Formula:
+ * n = (x - 0.3320) / (0.1858 - y)
+ * CCT = 437 * n^3 + 3601 * n^2 + 6861 * n + 5517
+ *
+ * @param CIEx The CIE x chromaticity coordinate
+ * @param CIEy The CIE y chromaticity coordinate
+ * @return The calculated color temperature in Kelvin
+ */
+template <typename T>
+T opt4048_calculateColorTemperature(T CIEx, T CIEy) {
+  // Check for invalid coordinates
+  if (CIEx == 0 && CIEy == 0) {
+    return 0;
+  }
+
+  // Calculate using McCamy's formula from spreadsheet
+  // n = (x - 0.3320) / (0.1858 - y)
+  T n = (CIEx - (T)0.3320) / ((T)0.1858 - CIEy);
+
+  // CCT = 437 * n^3 + 3601 * n^2 + 6861 * n + 5517
+  T cct = ((T)437.0 * n * n * n) + ((T)3601.0 * n * n) + ((T)6861.0 * n) +
+          (T)5517.0;
+
+  return cct;
+}
+
+template double opt4048_calculateColorTemperature<double>(double, double);
+template float opt4048_calculateColorTemperature<float>(float, float);
+
+/**
+ * @brief Fetch one entry of the locus table, which is in flash on AVR
+ *
+ * @param i Index of the entry
+ * @param entry Pointer to store the entry in
+ */
+static void cctEntry(uint8_t i, opt4048_cct_entry_t* entry) {
+#if defined(__AVR__)
+  memcpy_P(entry, &opt4048_cctTable[i], sizeof(*entry));
+#else
+  memcpy(entry, &opt4048_cctTable[i], sizeof(*entry));
+#endif
+}
+
+/**
+ * @brief Signed distance of a point past an isotemperature line
+ *
+ * @param entry The table entry the line goes through
+ * @param u CIE 1960 u of the point
+ * @param v CIE 1960 v of the point
+ * @return Distance along the locus, positive on the side of higher K
+ */
+template <typename T>
+static T isothermDistance(const opt4048_cct_entry_t* entry, T u, T v) {
+  return (u - entry->u) * entry->tu + (v - entry->v) * entry->tv;
+}
+
+/**
+ * @brief CCT and Duv from CIE 1960 u,v, see opt4048_calculateCCT()
+ *
+ * @param u CIE 1960 u
+ * @param v CIE 1960 v
+ * @param CCT Pointer to store the correlated color temperature in Kelvin
+ * @param Duv Pointer to store the distance from the locus
+ * @return true on success, false if out of range
+ */
+template <typename T>
+static bool cctFromUV(T u, T v, T* CCT, T* Duv) {
+  *CCT = 0;
+  *Duv = 0;
+
+  // Distances fall from positive at the hot end to negative at the cold end
+  opt4048_cct_entry_t a, b;
+  cctEntry(0, &a);
+  cctEntry(OPT4048_CCT_ENTRIES - 1, &b);
+  if (isothermDistance(&a, u, v) < 0 || isothermDistance(&b, u, v) > 0) {
+    return false;
+  }
+
+  uint8_t lo = 0;
+  uint8_t hi = OPT4048_CCT_ENTRIES - 1;
+  while (hi - lo > 1) {
+    uint8_t mid = (lo + hi) / 2;
+    cctEntry(mid, &a);
+    if (isothermDistance(&a, u, v) >= 0) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  cctEntry(lo, &a);
+  cctEntry(hi, &b);
+
+  T d0 = isothermDistance(&a, u, v);
+  T d1 = isothermDistance(&b, u, v);
+  T f = d0 / (d0 - d1);
+
+  // Distance from the locus along each line's normal, rotated tangent
+  T e0 = (v - a.v) * a.tu - (u - a.u) * a.tv;
+  T e1 = (v - b.v) * b.tu - (u - b.u) * b.tv;
+  T duv = e0 + f * (e1 - e0);
+  if (duv > (T)0.05 || duv < (T)-0.05) {
+    return false;
+  }
+
+  *CCT = (T)1e6 / (a.mired + f * (b.mired - a.mired));
+  *Duv = duv;
+  return true;
+}
+
+/**
+ * @brief Calculate the correlated color temperature and Duv
+ *
+ * Uses Robertson's method on a table of the Planckian locus generated from
+ * the CIE 1931 color matching functions (see extras/opt4048_cct): a binary
+ * search finds the two isotemperature lines the point lies between, and
+ * the temperature in mired and the distance to the locus are interpolated
+ * between them. Works from 1000K to 100000K.
+ *
+ * Against the exact locus, CCT is within 0.02% and Duv within 3e-5 for
+ * |Duv| <= 0.02, see the accuracy report of extras/opt4048_cct. McCamy's
+ * formula in opt4048_calculateColorTemperature() is several times cheaper
+ * but off by up to 1% between 2000K and 10000K and far more outside, and
+ * doesn't give Duv.
+ *
+ * @param CIEx The CIE x chromaticity coordinate
+ * @param CIEy The CIE y chromaticity coordinate
+ * @param CCT Pointer to store the correlated color temperature in Kelvin
+ * @param Duv Pointer to store the distance from the locus in CIE 1960 u,v,
+ * positive above it (greenish) and negative below it (pinkish)
+ * @return true on success, false if the point is outside 1000K-100000K or
+ * more than 0.05 from the locus, where CCT is not meaningful
+ */
+template <typename T>
+bool opt4048_calculateCCT(T CIEx, T CIEy, T* CCT, T* Duv) {
+  T den = 12 * CIEy - 2 * CIEx + 3;
+  if (!(den > 0)) {
+    *CCT = 0;
+    *Duv = 0;
+    return false;
+  }
+  T inv = 1 / den;
+  return cctFromUV(4 * CIEx * inv, 6 * CIEy * inv, CCT, Duv);
+}
+
+template bool opt4048_calculateCCT<double>(double, double, double*, double*);
+template bool opt4048_calculateCCT<float>(float, float, float*, float*);
+
+/**
+ * @brief The CIE L*a*b* companding function
+ *
+ * @param t A tristimulus value relative to the reference white
+ * @return f(t)
+ */
+static float labF(float t) {
+  // (6/29)^3 and 1 / (3 * (6/29)^2)
+  return t > 0.008856452f ? cbrtf(t) : t * 7.787037f + 4.0f / 29;
+}
+
+/**
+ * @brief Clip a linear sRGB component to the gamut and gamma encode it
+ *
+ * @param c The linear component
+ * @return The encoded component, 0 to 1
+ */
+static float srgbEncode(float c) {
+  if (c <= 0.0031308f) {
+    return c > 0 ? 12.92f * c : 0;
+  }
+  if (c >= 1) {
+    return 1;
+  }
+  return 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+}
+
+/**
+ * @brief Calculate every requested color metric of a sample in one pass
+ *
+ * Replaces calling opt4048_calculateCIE(), a CCT function and separate
+ * conversions one after another. X + Y + Z comes straight from the
+ * prepared calibration, and its reciprocal and the u'v' denominator are
+ * each computed once and shared by all metrics that need them. Metrics not
+ * in mask are skipped along with their divisions and powers.
+ *
+ * L*a*b* and sRGB are relative to a reference white. Without one, the D65
+ * white point at the sample's own luminance is used, so L* is 100 and a*,
+ * b* and sRGB describe the color of the light regardless of its intensity.
+ *
+ * @param values Array of 4 ADC codes indexed by channel number; only the
+ * channels in cal->xyzChannels and cal->luxChannels are used
+ * @param cal Calibration from opt4048_prepareCalibration()
+ * @param mask OPT4048_METRIC_* bits of the metrics wanted
+ * @param white X, Y and Z of the reference white, e.g. measured from a white
+ * target, or nullptr for D65 at the sample's luminance
+ * @param metrics Pointer to store the metrics in; fields not in
+ * metrics->valid are left untouched
+ * @return true on success, false if X+Y+Z <= 0
+ */
+bool opt4048_calculateMetrics(const uint32_t* values,
+                              const opt4048_calibration_t* cal, uint8_t mask,
+                              const float* white, opt4048_metrics_t* metrics) {
+  metrics->valid = 0;
+
+  float X, Y;
+  float sum = calibratedXYZ(values, cal, &X, &Y);
+  if (sum <= 0) {
+    return false;
+  }
+  float Z = sum - X - Y;
+
+  float L = 0;
+  for (uint8_t i = 0; i < cal->luxTerms; i++) {
+    L += (float)values[cal->luxChannel[i]] * cal->lux[i];
+  }
+
+  metrics->X = X;
+  metrics->Y = Y;
+  metrics->Z = Z;
+  metrics->lux = L;
+
+  if (mask & OPT4048_METRIC_XY) {
+    float inv = 1 / sum;
+    metrics->CIEx = X * inv;
+    metrics->CIEy = Y * inv;
+    metrics->valid |= OPT4048_METRIC_XY;
+  }
+
+  if (mask & (OPT4048_METRIC_UV | OPT4048_METRIC_CCT)) {
+    // u' = 4X / (X + 15Y + 3Z) and v' = 9Y / (X + 15Y + 3Z); the CCT table
+    // is in CIE 1960 u,v, where u = u' and v = 2/3 v'
+    float den = X + 15 * Y + 3 * Z;
+    if (den > 0) {
+      float inv = 1 / den;
+      float u = 4 * X * inv;
+      float v = 9 * Y * inv;
+      if (mask & OPT4048_METRIC_UV) {
+        metrics->u = u;
+        metrics->v = v;
+        metrics->valid |= OPT4048_METRIC_UV;
+      }
+      if ((mask & OPT4048_METRIC_CCT) &&
+          cctFromUV(u, v * (2.0f / 3), &metrics->CCT, &metrics->Duv)) {
+        metrics->valid |= OPT4048_METRIC_CCT;
+      }
+    }
+  }
+
+  if (mask & (OPT4048_METRIC_LAB | OPT4048_METRIC_SRGB)) {
+    // Reference white normalized to Yn = 1, D65 by default
+    float Xn = 0.95047f, Zn = 1.08883f;
+    float scale = Y;
+    if (white) {
+      Xn = white[0] / white[1];
+      Zn = white[2] / white[1];
+      scale = white[1];
+    }
+    if (scale > 0) {
+      float inv = 1 / scale;
+      float xr = X * inv, yr = Y * inv, zr = Z * inv;
+
+      if (mask & OPT4048_METRIC_LAB) {
+        // Without a reference white yr is 1, and so is f(yr)
+        float fy = white ? labF(yr) : 1;
+        float fx = labF(xr / Xn), fz = labF(zr / Zn);
+        metrics->L = 116 * fy - 16;
+        metrics->a = 500 * (fx - fy);
+        metrics->b = 200 * (fy - fz);
+        metrics->valid |= OPT4048_METRIC_LAB;
+      }
+
+      if (mask & OPT4048_METRIC_SRGB) {
+        // IEC 61966-2-1 XYZ to linear sRGB, D65
+        metrics->R = srgbEncode(3.2406f * xr - 1.5372f * yr - 0.4986f * zr);
+        metrics->G = srgbEncode(-0.9689f * xr + 1.8758f * yr + 0.0415f * zr);
+        metrics->B = srgbEncode(0.0557f * xr - 0.2040f * yr + 1.0570f * zr);
+        metrics->valid |= OPT4048_METRIC_SRGB;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Calculate the correlated color temperature (CCT) in fixed point
+ *
+ * Integer-only version of McCamy's approximation, taking the Q16 x and y
+ * produced by opt4048_calculateCIEFixed(). Evaluated in Q16 with 64 bit
+ * intermediates. For 0.25 <= x <= 0.55 and y >= 0.25, which covers the
+ * Planckian locus between 2000K and 30000K, the result is within 0.05% of
+ * the double version fed with the same x and y.
+ *
+ * @param CIEx The CIE x chromaticity coordinate as an unsigned Q16 fraction
+ * @param CIEy The CIE y chromaticity coordinate as an unsigned Q16 fraction
+ * @return The calculated color temperature in Kelvin, 0 if out of range
+ */
+uint32_t opt4048_calculateColorTemperatureFixed(uint16_t CIEx, uint16_t CIEy) {
+  if (CIEx == 0 && CIEy == 0) {
+    return 0;
+  }
+
+  // n = (x - 0.3320) / (0.1858 - y), with 0.3320 and 0.1858 in Q16
+  int32_t den = 12177 - (int32_t)CIEy;
+  if (den == 0) {
+    return 0;
+  }
+  int64_t n = ((int64_t)((int32_t)CIEx - 21758) << 16) / den;
+
+  // CCT = ((437 * n + 3601) * n + 6861) * n + 5517, evaluated in Q16
+  int64_t cct = 437 * n + ((int64_t)3601 << 16);
+  cct = ((cct * n) >> 16) + ((int64_t)6861 << 16);
+  cct = ((cct * n) >> 16) + ((int64_t)5517 << 16);
+
+  if (cct <= 0 || cct >= ((int64_t)1 << 48)) {
+    return 0;
+  }
+  return (uint32_t)((cct + 0x8000) >> 16);
+}
+
+#if defined(__GNUC__)
+#define OPT4048_RESTRICT __restrict__
+#else
+#define OPT4048_RESTRICT
+#endif
+
+// The batch conversion runs in two passes because GCC gives up on a single
+// loop with ten array streams; each pass on its own vectorizes at -O3.
+static void convertBatchXYZ(const uint32_t* OPT4048_RESTRICT ch0,
+                            const uint32_t* OPT4048_RESTRICT ch1,
+                            const uint32_t* OPT4048_RESTRICT ch2, size_t count,
+                            float* OPT4048_RESTRICT outX,
+                            float* OPT4048_RESTRICT outY,
+                            float* OPT4048_RESTRICT outZ,
+                            float* OPT4048_RESTRICT outLux) {
+  for (size_t i = 0; i < count; i++) {
+    // ADC codes are at most 26 bits, so going through int32_t is exact and
+    // lets the compiler use the signed vector conversion instructions
+    float c0 = (float)(int32_t)ch0[i];
+    float c1 = (float)(int32_t)ch1[i];
+    float c2 = (float)(int32_t)ch2[i];
+
+    outX[i] = c0 * (float)m0x + c1 * (float)m1x + c2 * (float)m2x;
+    outY[i] = c0 * (float)m0y + c1 * (float)m1y + c2 * (float)m2y;
+    outZ[i] = c0 * (float)m0z + c1 * (float)m1z + c2 * (float)m2z;
+    outLux[i] = c1 * (float)m1l;
+  }
+}
+
+static void convertBatchCIE(size_t count, const float* OPT4048_RESTRICT X,
+                            const float* OPT4048_RESTRICT Y,
+                            const float* OPT4048_RESTRICT Z,
+                            float* OPT4048_RESTRICT outLux,
+                            float* OPT4048_RESTRICT outCIEx,
+                            float* OPT4048_RESTRICT outCIEy,
+                            float* OPT4048_RESTRICT outCCT) {
+  for (size_t i = 0; i < count; i++) {
+    // Invalid samples divide by 1 and are then scaled to zero, so the body
+    // has no branches and no division can produce inf or NaN
+    float sum = X[i] + Y[i] + Z[i];
+    float valid = sum > 0 ? 1.0f : 0.0f;
+    float inv = 1.0f / (sum + (1.0f - valid));
+    float x = X[i] * inv * valid;
+    float y = Y[i] * inv * valid;
+
+    // McCamy's formula, see opt4048_calculateColorTemperature()
+    float n = (x - 0.3320f) / (0.1858f - y);
+    float cct = ((437.0f * n + 3601.0f) * n + 6861.0f) * n + 5517.0f;
+
+    outLux[i] *= valid;
+    outCIEx[i] = x;
+    outCIEy[i] = y;
+    outCCT[i] = cct * valid;
+  }
+}
+
+/**
+ * @brief Convert arrays of raw samples to X, Y, Z, lux, CIE x,y and CCT
+ *
+ * Pure batch version of opt4048_calculateCIE() followed by
+ * opt4048_calculateColorTemperature(), using the same coefficients, for
+ * converting recorded samples in bulk. Inputs and outputs are structure of
+ * arrays and both passes are branch free single precision math, so
+ * compilers can auto-vectorize them (e.g. SSE/AVX or NEON at -O3).
+ *
+ * Samples where X+Y+Z <= 0 produce zero lux, x, y and CCT, matching the
+ * single-sample functions. The W channel has no coefficients and is not an
+ * input. No two arrays, input or output, may overlap.
+ *
+ * @param ch0 Array of channel 0 (X) ADC codes
+ * @param ch1 Array of channel 1 (Y) ADC codes
+ * @param ch2 Array of channel 2 (Z) ADC codes
+ * @param count Number of samples in each array
+ * @param out Output arrays, each with room for count values
+ */
+void opt4048_convertBatch(const uint32_t* ch0, const uint32_t* ch1,
+                          const uint32_t* ch2, size_t count,
+                          const opt4048_batch_t* out) {
+  convertBatchXYZ(ch0, ch1, ch2, count, out->X, out->Y, out->Z, out->lux);
+  convertBatchCIE(count, out->X, out->Y, out->Z, out->lux, out->CIEx,
+                  out->CIEy, out->CCT);
+}
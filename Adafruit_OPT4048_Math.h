@@ -0,0 +1,167 @@
+/*!
+ * @file Adafruit_OPT4048_Math.h
+ *
+ * Hardware independent decode and color math for the OPT4048 High Speed High
+ * Precision Tristimulus XYZ Color Sensor.
+ *
+ * Nothing in here touches the I2C bus or depends on the Arduino core, so the
+ * same code can be compiled and profiled on a workstation.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_MATH_H
+#define ADAFRUIT_OPT4048_MATH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Output arrays for opt4048_convertBatch()
+ */
+typedef struct {
+  float* X;    ///< CIE 1931 X tristimulus values
+  float* Y;    ///< CIE 1931 Y tristimulus values
+  float* Z;    ///< CIE 1931 Z tristimulus values
+  float* lux;  ///< Illuminance in lux
+  float* CIEx; ///< CIE x chromaticity coordinates
+  float* CIEy; ///< CIE y chromaticity coordinates
+  float* CCT;  ///< Correlated color temperature in Kelvin (McCamy)
+} opt4048_batch_t;
+
+/**
+ * @brief Calibration matrix prepared by opt4048_prepareCalibration()
+ *
+ * Holds only what x, y and lux need: Z only enters through X + Y + Z, so
+ * its row is folded into a sum row, the W channel is skipped when it has no
+ * X, Y or Z coefficients, and lux keeps only its nonzero terms. The
+ * datasheet matrix is flagged so the conversions can use its exact
+ * coefficients instead.
+ */
+typedef struct {
+  float xys[3][4];        ///< X, Y and X+Y+Z coefficients per channel
+  int32_t xysFixed[3][4]; ///< The same as signed Q28
+  float lux[4];           ///< Nonzero lux coefficients
+  int32_t luxFixed[4];    ///< The same in mlux per code as signed Q24
+  uint8_t luxChannel[4];  ///< Channel of each lux coefficient
+  uint8_t luxTerms;       ///< Number of lux coefficients
+  uint8_t xyzChannels;    ///< Bit n set if channel n is needed for x, y
+  uint8_t luxChannels;    ///< Bit n set if channel n is needed for lux
+  uint8_t datasheet;      ///< Nonzero if this is the datasheet matrix
+} opt4048_calibration_t;
+
+// Optional metrics for opt4048_calculateMetrics(); X, Y, Z and lux are
+// always filled in
+#define OPT4048_METRIC_XY 0x01   //!< CIE 1931 x, y
+#define OPT4048_METRIC_UV 0x02   //!< CIE 1976 u', v'
+#define OPT4048_METRIC_LAB 0x04  //!< CIE L*a*b*
+#define OPT4048_METRIC_SRGB 0x08 //!< sRGB, gamma encoded
+#define OPT4048_METRIC_CCT 0x10  //!< CCT and Duv from the locus table
+#define OPT4048_METRIC_ALL 0x1F  //!< Everything
+
+/**
+ * @brief Color metrics derived from one sample by opt4048_calculateMetrics()
+ */
+typedef struct {
+  uint8_t valid; ///< OPT4048_METRIC_* bits of the fields that were computed
+  float X;       ///< CIE 1931 X tristimulus value
+  float Y;       ///< CIE 1931 Y tristimulus value
+  float Z;       ///< CIE 1931 Z tristimulus value
+  float lux;     ///< Illuminance in lux
+  float CIEx;    ///< CIE 1931 x chromaticity
+  float CIEy;    ///< CIE 1931 y chromaticity
+  float u;       ///< CIE 1976 u' chromaticity
+  float v;       ///< CIE 1976 v' chromaticity
+  float L;       ///< CIE L*, 100 at the reference white's Y
+  float a;       ///< CIE a*
+  float b;       ///< CIE b*
+  float R;       ///< sRGB red, 0 to 1, clipped to the gamut
+  float G;       ///< sRGB green, 0 to 1, clipped to the gamut
+  float B;       ///< sRGB blue, 0 to 1, clipped to the gamut
+  float CCT;     ///< Correlated color temperature in Kelvin
+  float Duv;     ///< Distance from the Planckian locus in CIE 1960 u,v
+} opt4048_metrics_t;
+
+uint8_t opt4048_calculateCRC(uint8_t exp, uint32_t mant, uint8_t counter);
+bool opt4048_decodeChannel(const uint8_t* buf, uint32_t* code,
+                           uint8_t* counter = nullptr);
+void opt4048_encodeChannel(uint32_t code, uint8_t counter, uint8_t* buf);
+
+/**
+ * @brief Threshold RESULT field of an ADC code for a given exponent
+ *
+ * @param code The ADC code
+ * @param roundUp Round up instead of down
+ * @param exp The threshold exponent
+ * @return code / 2^(8 + exp), rounded; may exceed the 12 bit field
+ */
+constexpr uint32_t opt4048_thresholdResult(uint32_t code, bool roundUp,
+                                           uint8_t exp) {
+  return (code >> (8 + exp)) +
+         (roundUp && (code & ((1UL << (8 + exp)) - 1)) ? 1 : 0);
+}
+
+/**
+ * @brief Encode an ADC code as a threshold register word
+ *
+ * The threshold registers (0x08, 0x09) hold EXPONENT[15:12] RESULT[11:0]
+ * and are compared against ADC_CODES = RESULT << (8 + EXPONENT). The
+ * smallest exponent that fits the code is used, so the step between
+ * representable thresholds is at most 1/2048 of the value above 2^19.
+ *
+ * This is constexpr so that Adafruit_OPT4048_Config can encode thresholds
+ * at compile time; called at run time the recursion becomes a short loop.
+ *
+ * @param code The ADC code (mantissa << exponent)
+ * @param roundUp Round to the next representable threshold above code
+ * instead of the one below it, e.g. for a high threshold that must not
+ * trip at exactly code
+ * @param exp Smallest exponent to try, leave at 0
+ * @return The register word
+ */
+constexpr uint16_t opt4048_encodeThreshold(uint32_t code, bool roundUp = false,
+                                           uint8_t exp = 0) {
+  return opt4048_thresholdResult(code, roundUp, exp) <= 0xFFF || exp == 15
+             ? (uint16_t)(((uint16_t)exp << 12) |
+                          opt4048_thresholdResult(code, roundUp, exp))
+             : opt4048_encodeThreshold(code, roundUp, exp + 1);
+}
+
+// Instantiated for float and double in Adafruit_OPT4048_Math.cpp
+template <typename T>
+bool opt4048_calculateCIE(uint32_t ch0, uint32_t ch1, uint32_t ch2,
+                          uint32_t ch3, T* CIEx, T* CIEy, T* lux);
+template <typename T>
+bool opt4048_calculateCIE(const uint32_t* values,
+                          const opt4048_calibration_t* cal, T* CIEx, T* CIEy,
+                          T* lux);
+template <typename T>
+T opt4048_calculateColorTemperature(T CIEx, T CIEy);
+template <typename T>
+bool opt4048_calculateCCT(T CIEx, T CIEy, T* CCT, T* Duv);
+
+bool opt4048_prepareCalibration(const float matrix[4][4],
+                                opt4048_calibration_t* cal);
+bool opt4048_calculateMetrics(const uint32_t* values,
+                              const opt4048_calibration_t* cal, uint8_t mask,
+                              const float* white, opt4048_metrics_t* metrics);
+
+bool opt4048_calculateCIEFixed(uint32_t ch0, uint32_t ch1, uint32_t ch2,
+                               uint16_t* CIEx, uint16_t* CIEy,
+                               uint32_t* milliLux);
+bool opt4048_calculateCIEFixed(const uint32_t* values,
+                               const opt4048_calibration_t* cal,
+                               uint16_t* CIEx, uint16_t* CIEy,
+                               uint32_t* milliLux);
+uint32_t opt4048_calculateColorTemperatureFixed(uint16_t CIEx, uint16_t CIEy);
+double opt4048_calculateLux(uint32_t ch1);
+double opt4048_calculateLux(const uint32_t* values,
+                            const opt4048_calibration_t* cal);
+void opt4048_convertBatch(const uint32_t* ch0, const uint32_t* ch1,
+                          const uint32_t* ch2, size_t count,
+                          const opt4048_batch_t* out);
+
+#endif // ADAFRUIT_OPT4048_MATH_H
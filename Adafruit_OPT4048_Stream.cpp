@@ -0,0 +1,430 @@
+/*!
+ * @file Adafruit_OPT4048_Stream.cpp
+ *
+ * Compact binary framing for streaming OPT4048 samples over a serial link.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048_Stream.h"
+
+/**
+ * @brief Store a 16 bit value little endian
+ *
+ * @param buf Where to store the 2 bytes
+ * @param value The value
+ */
+static void putU16(uint8_t* buf, uint16_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+}
+
+/**
+ * @brief Store a 32 bit value little endian
+ *
+ * @param buf Where to store the 4 bytes
+ * @param value The value
+ */
+static void putU32(uint8_t* buf, uint32_t value) {
+  putU16(buf, value & 0xFFFF);
+  putU16(buf + 2, value >> 16);
+}
+
+/**
+ * @brief Load a little endian 16 bit value
+ *
+ * @param buf The 2 bytes
+ * @return The value
+ */
+static uint16_t getU16(const uint8_t* buf) {
+  return buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+/**
+ * @brief Load a little endian 32 bit value
+ *
+ * @param buf The 4 bytes
+ * @return The value
+ */
+static uint32_t getU32(const uint8_t* buf) {
+  return getU16(buf) | ((uint32_t)getU16(buf + 2) << 16);
+}
+
+/**
+ * @brief Calculate the CRC-16/CCITT-FALSE of a block of bytes
+ *
+ * Polynomial 0x1021, initial value 0xFFFF, processed a nibble at a time
+ * through a 16 entry table to stay small and fast on 8 bit MCUs.
+ *
+ * @param data Bytes to checksum
+ * @param len Number of bytes
+ * @return The CRC
+ */
+uint16_t opt4048_streamCRC(const uint8_t* data, size_t len) {
+  static const uint16_t table[16] = {
+      0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+      0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+  }
+  return crc;
+}
+
+/**
+ * @brief Pack an ADC code into the sensor's 24 bit exponent/mantissa form
+ *
+ * Uses the smallest exponent that fits the mantissa in 20 bits, which is
+ * lossless for every code the sensor produces. Codes with significant bits
+ * below that, e.g. from filtering, are truncated to 20 significant bits.
+ *
+ * @param code ADC code
+ * @return Exponent in bits 23:20, mantissa in bits 19:0
+ */
+uint32_t opt4048_packCode(uint32_t code) {
+  uint8_t exp = 0;
+  while ((code >> exp) > 0xFFFFF) {
+    exp++;
+  }
+  return ((uint32_t)exp << 20) | (code >> exp);
+}
+
+/**
+ * @brief Undo opt4048_packCode()
+ *
+ * @param packed Exponent in bits 23:20, mantissa in bits 19:0
+ * @return The ADC code
+ */
+uint32_t opt4048_unpackCode(uint32_t packed) {
+  return (packed & 0xFFFFF) << ((packed >> 20) & 0x0F);
+}
+
+/**
+ * @brief Construct an encoder that sends only key frames
+ */
+Adafruit_OPT4048_StreamEncoder::Adafruit_OPT4048_StreamEncoder() {
+  _seq = 0;
+  _delta = false;
+  _key_interval = 16;
+  _since_key = 0;
+  _have_last = false;
+  _last_time = 0;
+}
+
+/**
+ * @brief Enable or disable delta encoding of raw frames
+ *
+ * Delta frames are used whenever every channel and the time step fit in 16
+ * bits, with a key frame at least every keyInterval frames so a receiver
+ * that lost a frame can pick the stream up again.
+ *
+ * @param enable True to send delta frames where possible
+ * @param keyInterval Most delta frames in a row
+ */
+void Adafruit_OPT4048_StreamEncoder::setDelta(bool enable,
+                                              uint8_t keyInterval) {
+  _delta = enable;
+  _key_interval = keyInterval;
+  _have_last = false;
+}
+
+/**
+ * @brief Encode raw channels into a key or delta frame
+ *
+ * @param values Array of 4 ADC codes indexed by channel number
+ * @param timestamp Sample time in microseconds
+ * @param buf Buffer of at least OPT4048_STREAM_MAX_FRAME bytes
+ * @return Number of bytes in the frame
+ */
+size_t Adafruit_OPT4048_StreamEncoder::encodeRaw(const uint32_t* values,
+                                                 uint32_t timestamp,
+                                                 uint8_t* buf) {
+  uint32_t packed[4];
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    packed[ch] = opt4048_packCode(values[ch]);
+  }
+
+  bool delta = _delta && _have_last && _since_key < _key_interval &&
+               timestamp - _last_time <= 0xFFFF;
+  for (uint8_t ch = 0; ch < 4 && delta; ch++) {
+    int32_t d = (int32_t)(packed[ch] - _last_packed[ch]);
+    delta = d >= -32768 && d <= 32767;
+  }
+
+  size_t len = 4;
+  uint8_t type;
+  if (delta) {
+    type = OPT4048_STREAM_RAW_DELTA;
+    putU16(&buf[len], timestamp - _last_time);
+    len += 2;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      putU16(&buf[len], packed[ch] - _last_packed[ch]);
+      len += 2;
+    }
+    _since_key++;
+  } else {
+    type = OPT4048_STREAM_RAW;
+    putU32(&buf[len], timestamp);
+    len += 4;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      buf[len++] = packed[ch] & 0xFF;
+      buf[len++] = (packed[ch] >> 8) & 0xFF;
+      buf[len++] = packed[ch] >> 16;
+    }
+    _since_key = 0;
+  }
+
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    _last_packed[ch] = packed[ch];
+  }
+  _last_time = timestamp;
+  _have_last = true;
+  return finish(buf, type, len);
+}
+
+/**
+ * @brief Encode fixed point chromaticity and illuminance into a frame
+ *
+ * @param CIEx CIE x as an unsigned Q16 fraction
+ * @param CIEy CIE y as an unsigned Q16 fraction
+ * @param milliLux Illuminance in thousandths of a lux
+ * @param timestamp Sample time in microseconds
+ * @param buf Buffer of at least OPT4048_STREAM_MAX_FRAME bytes
+ * @return Number of bytes in the frame
+ */
+size_t Adafruit_OPT4048_StreamEncoder::encodeFixed(uint16_t CIEx, uint16_t CIEy,
+                                                   uint32_t milliLux,
+                                                   uint32_t timestamp,
+                                                   uint8_t* buf) {
+  putU32(&buf[4], timestamp);
+  putU16(&buf[8], CIEx);
+  putU16(&buf[10], CIEy);
+  putU32(&buf[12], milliLux);
+  return finish(buf, OPT4048_STREAM_FIXED, 16);
+}
+
+/**
+ * @brief Fill in the header and CRC around a frame body
+ *
+ * @param buf Frame buffer with the body starting at offset 4
+ * @param type Frame type
+ * @param len Frame length so far, header included
+ * @return Total frame length
+ */
+size_t Adafruit_OPT4048_StreamEncoder::finish(uint8_t* buf, uint8_t type,
+                                              size_t len) {
+  buf[0] = OPT4048_STREAM_SYNC0;
+  buf[1] = OPT4048_STREAM_SYNC1;
+  buf[2] = type;
+  buf[3] = _seq++;
+  putU16(&buf[len], opt4048_streamCRC(&buf[2], len - 2));
+  return len + 2;
+}
+
+/**
+ * @brief Get the total size of a frame from its type byte
+ *
+ * @param type Frame type
+ * @return Frame size in bytes, or 0 for an unknown type
+ */
+static uint8_t frameSize(uint8_t type) {
+  switch (type) {
+    case OPT4048_STREAM_RAW:
+      return 22;
+    case OPT4048_STREAM_RAW_DELTA:
+      return 16;
+    case OPT4048_STREAM_FIXED:
+      return 18;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Construct a decoder waiting for the first frame
+ */
+Adafruit_OPT4048_StreamDecoder::Adafruit_OPT4048_StreamDecoder() {
+  reset();
+}
+
+/**
+ * @brief Drop any partial frame and clear the statistics
+ */
+void Adafruit_OPT4048_StreamDecoder::reset(void) {
+  _len = 0;
+  _have_seq = false;
+  _last_seq = 0;
+  _have_base = false;
+  _base_time = 0;
+  _skipped = 0;
+  _crc_errors = 0;
+  _lost = 0;
+  _undecodable = 0;
+}
+
+/**
+ * @brief Feed the next byte of the stream
+ *
+ * @param byte The byte
+ * @param sample Where to store a sample when this byte completes a frame
+ * @return true if a sample was stored, false otherwise
+ */
+bool Adafruit_OPT4048_StreamDecoder::push(uint8_t byte,
+                                          opt4048_stream_sample_t* sample) {
+  _buf[_len++] = byte;
+
+  while (_len) {
+    if (_buf[0] != OPT4048_STREAM_SYNC0) {
+      drop(1);
+      _skipped++;
+      continue;
+    }
+    if (_len < 2) {
+      return false;
+    }
+    if (_buf[1] != OPT4048_STREAM_SYNC1) {
+      drop(1);
+      _skipped++;
+      continue;
+    }
+    if (_len < 3) {
+      return false;
+    }
+    uint8_t size = frameSize(_buf[2]);
+    if (!size) {
+      drop(1);
+      _skipped++;
+      continue;
+    }
+    if (_len < size) {
+      return false;
+    }
+
+    if (opt4048_streamCRC(&_buf[2], size - 4) != getU16(&_buf[size - 2])) {
+      // The sync bytes may have been data, look for a frame inside this one
+      _crc_errors++;
+      drop(1);
+      _skipped++;
+      continue;
+    }
+
+    // What is left after a frame is shorter than any frame, so at most one
+    // sample can complete per push()
+    bool decoded = decodeFrame(sample);
+    drop(size);
+    if (decoded) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Get the number of bytes that were not part of a valid frame
+ *
+ * @return Skipped byte count since reset()
+ */
+uint32_t Adafruit_OPT4048_StreamDecoder::getSkippedBytes(void) {
+  return _skipped;
+}
+
+/**
+ * @brief Get the number of candidate frames that failed the CRC check
+ *
+ * @return CRC error count since reset()
+ */
+uint32_t Adafruit_OPT4048_StreamDecoder::getCRCErrors(void) {
+  return _crc_errors;
+}
+
+/**
+ * @brief Get the number of frames missing from the sequence numbers
+ *
+ * Gaps are counted modulo 256, so a loss of exactly 256 frames goes
+ * unnoticed.
+ *
+ * @return Lost frame count since reset()
+ */
+uint32_t Adafruit_OPT4048_StreamDecoder::getLostFrames(void) {
+  return _lost;
+}
+
+/**
+ * @brief Get the number of delta frames dropped for lack of a key frame
+ *
+ * @return Undecodable frame count since reset()
+ */
+uint32_t Adafruit_OPT4048_StreamDecoder::getUndecodableFrames(void) {
+  return _undecodable;
+}
+
+/**
+ * @brief Remove bytes from the front of the frame buffer
+ *
+ * @param count Number of bytes to remove
+ */
+void Adafruit_OPT4048_StreamDecoder::drop(uint8_t count) {
+  for (uint8_t i = count; i < _len; i++) {
+    _buf[i - count] = _buf[i];
+  }
+  _len -= count;
+}
+
+/**
+ * @brief Decode the CRC checked frame at the start of the buffer
+ *
+ * @param sample Where to store the sample
+ * @return true if a sample was stored, false for an undecodable delta
+ */
+bool Adafruit_OPT4048_StreamDecoder::decodeFrame(
+    opt4048_stream_sample_t* sample) {
+  uint8_t type = _buf[2];
+  uint8_t seq = _buf[3];
+
+  if (_have_seq && seq != (uint8_t)(_last_seq + 1)) {
+    _lost += (uint8_t)(seq - _last_seq - 1);
+    _have_base = false;
+  }
+  _have_seq = true;
+  _last_seq = seq;
+
+  sample->type = type;
+  sample->seq = seq;
+
+  if (type == OPT4048_STREAM_FIXED) {
+    sample->timestamp = getU32(&_buf[4]);
+    sample->CIEx = getU16(&_buf[8]);
+    sample->CIEy = getU16(&_buf[10]);
+    sample->milliLux = getU32(&_buf[12]);
+    return true;
+  }
+
+  if (type == OPT4048_STREAM_RAW) {
+    _base_time = getU32(&_buf[4]);
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      const uint8_t* p = &_buf[8 + 3 * ch];
+      _base_packed[ch] = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    }
+    _have_base = true;
+  } else {
+    if (!_have_base) {
+      _undecodable++;
+      return false;
+    }
+    _base_time += getU16(&_buf[4]);
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      _base_packed[ch] += (int16_t)getU16(&_buf[6 + 2 * ch]);
+    }
+  }
+
+  sample->timestamp = _base_time;
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    sample->values[ch] = opt4048_unpackCode(_base_packed[ch]);
+  }
+  return true;
+}
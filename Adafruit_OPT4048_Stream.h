@@ -0,0 +1,126 @@
+/*!
+ * @file Adafruit_OPT4048_Stream.h
+ *
+ * Compact binary framing for streaming OPT4048 samples over a serial link.
+ *
+ * Like Adafruit_OPT4048_Math, nothing in here depends on the Arduino core,
+ * so the same code encodes frames on the microcontroller and can be built
+ * on a workstation.
+ *
+ * Every frame is little endian and starts with the two sync bytes, followed
+ * by a type byte, a sequence number that increments by one per frame, the
+ * type specific body and a CRC-16/CCITT-FALSE over everything after the sync
+ * bytes:
+ *
+ * | Type                      | Body                              | Size |
+ * |---------------------------|-----------------------------------|------|
+ * | OPT4048_STREAM_RAW        | u32 time, 4 x 24 bit channel      | 22   |
+ * | OPT4048_STREAM_RAW_DELTA  | u16 time delta, 4 x i16 delta     | 16   |
+ * | OPT4048_STREAM_FIXED      | u32 time, u16 x, u16 y, u32 mlux  | 18   |
+ *
+ * Times are in microseconds. A 24 bit channel is the ADC code packed as the
+ * sensor does, exponent in the top 4 bits and a 20 bit mantissa below, and a
+ * delta is the difference of two such packed values. Fixed frames carry the
+ * output of opt4048_calculateCIEFixed().
+ *
+ * At 115200 baud the delta frames fit more than 700 samples/s, more than
+ * the 417 samples/s the sensor produces at its 600us conversion time.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef ADAFRUIT_OPT4048_STREAM_H
+#define ADAFRUIT_OPT4048_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OPT4048_STREAM_SYNC0 0xA5     //!< First sync byte of every frame
+#define OPT4048_STREAM_SYNC1 0x48     //!< Second sync byte of every frame
+#define OPT4048_STREAM_RAW 0x01       //!< Key frame with packed raw channels
+#define OPT4048_STREAM_RAW_DELTA 0x02 //!< Raw channels relative to the last
+#define OPT4048_STREAM_FIXED 0x03     //!< Fixed point CIE x,y and lux
+#define OPT4048_STREAM_MAX_FRAME 22   //!< Largest frame size in bytes
+
+/**
+ * @brief One decoded stream frame
+ */
+typedef struct {
+  uint8_t type;       ///< OPT4048_STREAM_RAW, _RAW_DELTA or _FIXED
+  uint8_t seq;        ///< Sequence number
+  uint32_t timestamp; ///< Sample time in microseconds
+  uint32_t values[4]; ///< ADC codes, raw and raw delta frames only
+  uint16_t CIEx;      ///< CIE x as Q16, fixed frames only
+  uint16_t CIEy;      ///< CIE y as Q16, fixed frames only
+  uint32_t milliLux;  ///< Illuminance in thousandths of a lux, fixed only
+} opt4048_stream_sample_t;
+
+uint16_t opt4048_streamCRC(const uint8_t* data, size_t len);
+uint32_t opt4048_packCode(uint32_t code);
+uint32_t opt4048_unpackCode(uint32_t packed);
+
+/**
+ * @brief Builds stream frames from samples
+ */
+class Adafruit_OPT4048_StreamEncoder {
+ public:
+  Adafruit_OPT4048_StreamEncoder();
+
+  void setDelta(bool enable, uint8_t keyInterval = 16);
+  size_t encodeRaw(const uint32_t* values, uint32_t timestamp, uint8_t* buf);
+  size_t encodeFixed(uint16_t CIEx, uint16_t CIEy, uint32_t milliLux,
+                     uint32_t timestamp, uint8_t* buf);
+
+ private:
+  uint8_t _seq;             ///< Sequence number of the next frame
+  bool _delta;              ///< Delta frames enabled
+  uint8_t _key_interval;    ///< Most delta frames between key frames
+  uint8_t _since_key;       ///< Delta frames since the last key frame
+  bool _have_last;          ///< _last_packed and _last_time are valid
+  uint32_t _last_packed[4]; ///< Packed channels of the last raw frame
+  uint32_t _last_time;      ///< Timestamp of the last raw frame
+
+  size_t finish(uint8_t* buf, uint8_t type, size_t len);
+};
+
+/**
+ * @brief Turns a byte stream back into samples
+ *
+ * Bytes can come in any chunking. Anything that isn't a complete frame
+ * with a valid CRC, such as text printed before the stream started or a
+ * frame damaged on the line, is skipped one byte at a time until the next
+ * sync bytes that start a valid frame. Delta frames are only decoded when
+ * no frame was lost since the key frame they build on.
+ */
+class Adafruit_OPT4048_StreamDecoder {
+ public:
+  Adafruit_OPT4048_StreamDecoder();
+
+  void reset(void);
+  bool push(uint8_t byte, opt4048_stream_sample_t* sample);
+  uint32_t getSkippedBytes(void);
+  uint32_t getCRCErrors(void);
+  uint32_t getLostFrames(void);
+  uint32_t getUndecodableFrames(void);
+
+ private:
+  uint8_t _buf[OPT4048_STREAM_MAX_FRAME]; ///< Bytes of the frame so far
+  uint8_t _len;                           ///< Bytes in _buf
+  bool _have_seq;                         ///< _last_seq is valid
+  uint8_t _last_seq;                      ///< Sequence of the last frame
+  bool _have_base;                        ///< Delta base is valid
+  uint32_t _base_packed[4];               ///< Packed channels to add to
+  uint32_t _base_time;                    ///< Timestamp to add to
+  uint32_t _skipped;                      ///< Bytes outside valid frames
+  uint32_t _crc_errors;                   ///< Frames with a bad CRC
+  uint32_t _lost;                         ///< Frames missing by sequence
+  uint32_t _undecodable;                  ///< Deltas without a base
+
+  void drop(uint8_t count);
+  bool decodeFrame(opt4048_stream_sample_t* sample);
+};
+
+#endif // ADAFRUIT_OPT4048_STREAM_H
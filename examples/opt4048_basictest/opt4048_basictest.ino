@@ -37,6 +37,7 @@ void setup() {
   sensor.setRange(OPT4048_RANGE_AUTO);  // Set range to auto
   sensor.setConversionTime(OPT4048_CONVERSION_TIME_100MS); // Set conversion time to 100ms
   sensor.setMode(OPT4048_MODE_CONTINUOUS);  // Set operating mode to continuous
+  sensor.setCRCRetry(0, 300000); // Wait up to 300ms for a half stored conversion
 }
 
 void loop() {
@@ -110,6 +110,10 @@ void setup() {
   Serial.println(F("\nSetting operating mode to Continuous..."));
   sensor.setMode(OPT4048_MODE_CONTINUOUS);
 
+  // A read can land while a conversion is half stored. Let it wait up to
+  // 300ms, three 100ms channels, for the rest instead of failing.
+  sensor.setCRCRetry(0, 300000);
+
   // Read back operating mode setting
   opt4048_mode_t currentMode = sensor.getMode();
   Serial.print(F("Current operating mode: "));
@@ -9,9 +9,15 @@
 
 #include <Wire.h>
 #include "Adafruit_OPT4048.h"
+#include "Adafruit_OPT4048_Capture.h"
 
 Adafruit_OPT4048 sensor;
 
+// The INT pin ISR timestamps each sample, capture.service() fetches it into
+// this ring and loop() drains the ring in batches. On multi-core boards
+// service() can run from its own task so a busy loop() never drops samples.
+Adafruit_OPT4048_Capture<16> capture(&sensor);
+
 #define INT_PIN  2 // use any pin because we're just going to check the pin status!
 
 // we'll track time between data reads
@@ -41,22 +47,31 @@ void setup() {
   sensor.setRange(OPT4048_RANGE_AUTO);  // Set range to auto
   sensor.setConversionTime(OPT4048_CONVERSION_TIME_100MS); // Set conversion time to 100ms
   sensor.setMode(OPT4048_MODE_CONTINUOUS);  // Set operating mode to continuous
+  capture.begin(); // INT pin signals data ready for all channels
 
   pinMode(INT_PIN, INPUT_PULLUP);
   attachInterrupt(digitalPinToInterrupt(INT_PIN), optIRQ, RISING);
-  timestamp = millis();
+  timestamp = micros();
 }
 
-volatile bool newDataAvail = false;
 void optIRQ() {
-  newDataAvail = true;
+  capture.interrupt();
 }
 
 void loop() {
-  double CIEx, CIEy, lux;
+  // Fetch the frame the INT pin announced, this is quick
+  capture.service();
+
+  // Drain everything captured so far in one go
+  opt4048_frame_t frames[4];
+  uint8_t count = capture.read(frames, 4);
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t values[4];
+    double CIEx, CIEy, lux;
 
-  if (newDataAvail) {
-    if (! sensor.getCIE(&CIEx, &CIEy, &lux)) {
+    if (! opt4048_decodeFrame(&frames[i], values) ||
+        ! opt4048_calculateCIE(values, sensor.getCalibration(), &CIEx, &CIEy, &lux)) {
       Serial.println(F("Error reading sensor data"));
     } else {
       Serial.println(F("\nCIE Coordinates:"));
@@ -69,13 +84,15 @@ void loop() {
       Serial.print(F("Color Temperature: "));
       Serial.print(colorTemp, 2);
       Serial.println(F(" K"));
-      Serial.print("Time since last read: "); 
-      Serial.print(millis() - timestamp);
+      Serial.print("Time since last sample: "); 
+      Serial.print((frames[i].timestamp - timestamp) / 1000);
       Serial.println("ms");
-      timestamp = millis();
+      timestamp = frames[i].timestamp;
     }
-    newDataAvail = false;
   }
-   
-  delay(10); // a small delay
+
+  if (capture.getOverflows() || capture.getMissed()) {
+    Serial.print(F("Dropped samples: "));
+    Serial.println(capture.getOverflows() + capture.getMissed());
+  }
 }
@@ -0,0 +1,74 @@
+/*!
+ * @file opt4048_onchange.ino
+ *
+ * Report on change demo for the OPT4048 tristimulus XYZ color sensor
+ *
+ * Instead of reading every sample, the INT pin only fires when the light
+ * level has changed by more than 5% since the last reading. Between changes
+ * there is no I2C traffic at all, so the microcontroller could sleep.
+ */
+
+#include <Wire.h>
+#include "Adafruit_OPT4048.h"
+
+Adafruit_OPT4048 sensor;
+
+#define INT_PIN  2 // must be a pin that supports interrupts
+
+volatile bool changed = false;
+
+void setup() {
+  // Initialize serial communication
+  Serial.begin(115200);
+  
+  // Wait for serial monitor to open
+  while (!Serial) {
+    delay(10);
+  }
+
+  Serial.println(F("Adafruit OPT4048 Report On Change Test"));
+
+  // Initialize the sensor
+  if (!sensor.begin()) {
+    Serial.println(F("Failed to find OPT4048 chip"));
+    while (1) {
+      delay(10);
+    }
+  }
+  
+  Serial.println(F("OPT4048 sensor found!"));
+
+  sensor.setRange(OPT4048_RANGE_AUTO);  // Set range to auto
+  sensor.setConversionTime(OPT4048_CONVERSION_TIME_100MS); // Set conversion time to 100ms
+  sensor.setMode(OPT4048_MODE_CONTINUOUS);  // Thresholds are only checked in continuous mode
+
+  // Follow the Y channel, which is the illuminance, with a +/- 5% window
+  if (!sensor.startChangeTracking(1, 0.05)) {
+    Serial.println(F("Failed to start change tracking"));
+  }
+
+  pinMode(INT_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(INT_PIN), optIRQ, RISING);
+}
+
+void optIRQ() {
+  changed = true;
+}
+
+void loop() {
+  if (!changed) {
+    return; // Nothing changed, a good place to sleep
+  }
+  changed = false;
+
+  // Reading the sample also moves the window to the new light level
+  double CIEx, CIEy, lux;
+  if (!sensor.getCIE(&CIEx, &CIEy, &lux)) {
+    Serial.println(F("Error reading sensor data"));
+    return;
+  }
+
+  Serial.print(F("Light changed, lux: ")); Serial.print(lux, 4);
+  Serial.print(F(" CIE x: ")); Serial.print(CIEx, 6);
+  Serial.print(F(" CIE y: ")); Serial.println(CIEy, 6);
+}
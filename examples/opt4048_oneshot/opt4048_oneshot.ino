@@ -12,9 +12,6 @@
 
 Adafruit_OPT4048 sensor;
 
-// we'll track time between data reads
-uint32_t timestamp = 0;
-
 void setup() {
   // Initialize serial communication
   Serial.begin(115200);
@@ -40,17 +37,21 @@ void setup() {
   sensor.setConversionTime(OPT4048_CONVERSION_TIME_200MS); // Set conversion time to 200ms
   sensor.setMode(OPT4048_MODE_AUTO_ONESHOT);  // Set operating mode to auto-range one shot
 
-  timestamp = millis();
+  // Only read X, Y and Z, the W channel isn't needed for CIE x,y or lux.
+  // poll() won't touch the I2C bus until the conversion time has passed.
+  sensor.startMeasurement(OPT4048_CHANNEL_XYZ);
 }
 
 
 void loop() {
-  if (sensor.getMode() == OPT4048_MODE_POWERDOWN) {
+  if (sensor.poll()) {
     // ok we finished the reading!
-    double CIEx, CIEy, lux;
-  
-    if (! sensor.getCIE(&CIEx, &CIEy, &lux)) {
-      Serial.println(F("Error reading sensor data"));
+    uint32_t values[4];
+    float CIEx, CIEy, lux;
+
+    sensor.getMeasurement(values);
+    if (! opt4048_calculateCIE(values, sensor.getCalibration(), &CIEx, &CIEy, &lux)) {
+      Serial.println(F("Error calculating CIE coordinates"));
     } else {
       Serial.println(F("\nCIE Coordinates:"));
       Serial.print(F("CIE x: ")); Serial.println(CIEx, 8);
@@ -62,15 +63,24 @@ void loop() {
       Serial.print(F("Color Temperature: "));
       Serial.print(colorTemp, 2);
       Serial.println(F(" K"));
-      Serial.print("Time since last read: "); 
-      Serial.print(millis() - timestamp);
-      Serial.println("ms");
-      timestamp = millis();
+
+      // The driver timestamps every sample, compare the actual interval
+      // with what the conversion time alone would give
+      opt4048_timing_t timing;
+      if (sensor.getTimingStats(&timing)) {
+        Serial.print(F("Sample interval: "));
+        Serial.print(timing.mean / 1000, 2);
+        Serial.print(F(" ms mean, "));
+        Serial.print(timing.stddev / 1000, 2);
+        Serial.print(F(" ms std dev, "));
+        Serial.print(timing.nominal / 1000.0, 1);
+        Serial.println(F(" ms nominal"));
+      }
     }
 
     // start a new reading!
-    sensor.setMode(OPT4048_MODE_AUTO_ONESHOT);  // Set operating mode to auto-range one shot
+    sensor.startMeasurement(OPT4048_CHANNEL_XYZ);
   }
 
-  delay(10); // a small delay
+  // loop() is free to do other work here, no delay needed
 }
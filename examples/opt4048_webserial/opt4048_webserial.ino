@@ -9,13 +9,22 @@
  * This sketch works with the web interface in the /webserial directory of the
  * gh-pages branch: https://github.com/adafruit/Adafruit_OPT4048/tree/gh-pages,
  * which can be accessed at: https://adafruit.github.io/Adafruit_OPT4048/webserial/
+ *
+ * Set BINARY_STREAM to 1 to instead send every sample at the sensor's fastest
+ * rate as compact binary frames, see Adafruit_OPT4048_Stream.h. The web page
+ * doesn't understand these, they are meant for a host side decoder.
  */
 
 #include <Wire.h>
 #include "Adafruit_OPT4048.h"
+#include "Adafruit_OPT4048_Stream.h"
+
+// 0 for the human readable format the web page uses, 1 for binary frames
+#define BINARY_STREAM 0
 
 // Create sensor object
 Adafruit_OPT4048 sensor;
+Adafruit_OPT4048_StreamEncoder encoder;
 
 // Set how often to read data (in milliseconds)
 const unsigned long READ_INTERVAL = 100;
@@ -45,9 +54,30 @@ void setup() {
   sensor.setRange(OPT4048_RANGE_AUTO);           // Auto-range for best results across lighting conditions
   sensor.setConversionTime(OPT4048_CONVERSION_TIME_100MS); // 100ms conversion time
   sensor.setMode(OPT4048_MODE_CONTINUOUS);       // Continuous mode
+  sensor.setCRCRetry(0, 300000);                 // Wait up to 300ms for a half stored conversion
+
+#if BINARY_STREAM
+  // 600us per channel gives a new sample every 2.4ms. Delta frames are 16
+  // bytes, so even 115200 baud keeps up with that.
+  sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US);
+  encoder.setDelta(true);
+  sensor.startMeasurement(OPT4048_CHANNEL_ALL);
+#endif
 }
 
 void loop() {
+#if BINARY_STREAM
+  if (sensor.poll()) {
+    uint32_t values[4];
+    uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+
+    sensor.getMeasurement(values);
+    size_t len = encoder.encodeRaw(values, micros(), frame);
+    Serial.write(frame, len);
+  }
+  return;
+#endif
+
   // Only read at the specified interval
   unsigned long currentTime = millis();
   if (currentTime - lastReadTime >= READ_INTERVAL) {
@@ -0,0 +1,75 @@
+/*!
+ * @file host_test.cpp
+ *
+ * Runs the registered host tests. With an argument, runs only the tests
+ * whose names contain it.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "host_test.h"
+
+#include <string.h>
+
+HostTest* HostTest::head = nullptr;
+HostTest* HostTest::tail = nullptr;
+int HostTest::failures = 0;
+
+/**
+ * @brief Register a test
+ *
+ * @param name Test name
+ * @param test Test body
+ */
+HostTest::HostTest(const char* name, void (*test)(void)) {
+  _name = name;
+  _test = test;
+  _next = nullptr;
+  if (tail) {
+    tail->_next = this;
+  } else {
+    head = this;
+  }
+  tail = this;
+}
+
+/**
+ * @brief Run the registered tests in the order they were defined
+ *
+ * @param filter Substring of the names to run, nullptr for all
+ * @return Number of failed tests
+ */
+int HostTest::runAll(const char* filter) {
+  int run = 0, failed = 0;
+  for (HostTest* t = head; t; t = t->_next) {
+    if (filter && !strstr(t->_name, filter)) {
+      continue;
+    }
+    failures = 0;
+    t->_test();
+    run++;
+    if (failures) {
+      failed++;
+    }
+    printf("%s %s\n", failures ? "FAIL" : "ok  ", t->_name);
+  }
+  printf("%d tests, %d failed\n", run, failed);
+  return failed;
+}
+
+/**
+ * @brief Report a failed check
+ *
+ * @param expr Text of the check
+ * @param file Source file
+ * @param line Source line
+ */
+void HostTest::fail(const char* expr, const char* file, int line) {
+  printf("  %s:%d: CHECK(%s) failed\n", file, line, expr);
+  failures++;
+}
+
+int main(int argc, char** argv) {
+  return HostTest::runAll(argc > 1 ? argv[1] : nullptr) ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+/*!
+ * @file host_test.h
+ *
+ * Minimal test runner for the host tests. TEST() defines and registers a
+ * test, CHECK() records a failure and carries on, so one run reports every
+ * broken expectation.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_TEST_H
+#define OPT4048_HOST_TEST_H
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * @brief Adds a test to the list run by main()
+ */
+class HostTest {
+ public:
+  HostTest(const char* name, void (*test)(void));
+
+  static int runAll(const char* filter);
+  static void fail(const char* expr, const char* file, int line);
+
+ private:
+  const char* _name;     ///< Test name
+  void (*_test)(void);   ///< Test body
+  HostTest* _next;       ///< Next registered test
+  static HostTest* head; ///< First registered test
+  static HostTest* tail; ///< Last registered test
+  static int failures;   ///< Failed checks in the running test
+};
+
+/** Define a test that runs with the others */
+#define TEST(name)                          \
+  static void name(void);                   \
+  static HostTest name##_test(#name, name); \
+  static void name(void)
+
+/** Record a failure if cond is false */
+#define CHECK(cond)                              \
+  do {                                           \
+    if (!(cond)) {                               \
+      HostTest::fail(#cond, __FILE__, __LINE__); \
+    }                                            \
+  } while (0)
+
+/** Record a failure if a and b differ by more than tol */
+#define CHECK_NEAR(a, b, tol) CHECK(fabs((double)(a) - (double)(b)) <= (tol))
+
+#endif // OPT4048_HOST_TEST_H
@@ -0,0 +1,17 @@
+/*!
+ * @file Adafruit_BusIO_Register.h
+ *
+ * Stand-in for the Adafruit_BusIO register header on host builds. The
+ * OPT4048 library includes it but does all register access through
+ * Adafruit_I2CDevice, so nothing else is needed.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_BUSIO_REGISTER_H
+#define OPT4048_HOST_BUSIO_REGISTER_H
+
+#include "Adafruit_I2CDevice.h"
+
+#endif // OPT4048_HOST_BUSIO_REGISTER_H
@@ -0,0 +1,40 @@
+/*!
+ * @file Adafruit_I2CDevice.h
+ *
+ * Stand-in for the Adafruit_BusIO I2C device class on host builds, with the
+ * same signatures as the methods the OPT4048 library calls. Transfers go to
+ * the mock TwoWire in Wire.h.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_I2CDEVICE_H
+#define OPT4048_HOST_I2CDEVICE_H
+
+#include "Wire.h"
+
+/**
+ * @brief I2C target at a fixed address on a mock bus
+ */
+class Adafruit_I2CDevice {
+ public:
+  Adafruit_I2CDevice(uint8_t addr, TwoWire* theWire = &Wire);
+
+  bool begin(bool addr_detect = true);
+  bool detected(void);
+  uint8_t address(void);
+  bool read(uint8_t* buffer, size_t len, bool stop = true);
+  bool write(const uint8_t* buffer, size_t len, bool stop = true,
+             const uint8_t* prefix_buffer = nullptr, size_t prefix_len = 0);
+  bool write_then_read(const uint8_t* write_buffer, size_t write_len,
+                       uint8_t* read_buffer, size_t read_len,
+                       bool stop = false);
+
+ private:
+  uint8_t _addr;  ///< 7-bit address
+  TwoWire* _wire; ///< Bus the device is on
+  bool _begun;    ///< begin() succeeded
+};
+
+#endif // OPT4048_HOST_I2CDEVICE_H
@@ -0,0 +1,34 @@
+/*!
+ * @file Arduino.h
+ *
+ * Stand-in for the parts of the Arduino core used by the OPT4048 library,
+ * for building it on a Linux host. Time comes from a virtual clock that
+ * only moves when a test, a simulated device or a bus transfer advances it,
+ * so runs are deterministic. noInterrupts() takes a lock that
+ * mock_interrupt() also holds while it runs a handler, so a thread standing
+ * in for an interrupt can't preempt a critical section.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_ARDUINO_H
+#define OPT4048_HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts(void);
+void interrupts(void);
+
+void mock_setMicros(uint32_t us);
+void mock_advanceMicros(uint32_t us);
+void mock_interrupt(void (*isr)(void));
+
+#endif // OPT4048_HOST_ARDUINO_H
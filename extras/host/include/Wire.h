@@ -0,0 +1,91 @@
+/*!
+ * @file Wire.h
+ *
+ * Stand-in TwoWire for host builds. Instead of driving hardware it routes
+ * each transfer to a MockDevice attached at the target address, logs it,
+ * and can be told to fail transfers or charge them bus time on the virtual
+ * clock.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_WIRE_H
+#define OPT4048_HOST_WIRE_H
+
+#include <vector>
+
+#include "Arduino.h"
+
+/**
+ * @brief A target on the mock bus
+ */
+class MockDevice {
+ public:
+  virtual ~MockDevice() {}
+
+  /**
+   * @brief Handle the write phase of a transfer
+   *
+   * @param data Bytes written, the register address first
+   * @param len Number of bytes, 0 for an address probe
+   * @return false to NAK the transfer
+   */
+  virtual bool write(const uint8_t* data, size_t len) = 0;
+
+  /**
+   * @brief Handle the read phase of a transfer
+   *
+   * @param data Buffer for the bytes returned to the controller
+   * @param len Number of bytes requested
+   * @return false to NAK the transfer
+   */
+  virtual bool read(uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * @brief One transfer seen on the mock bus
+ */
+struct MockTransaction {
+  uint8_t addr;             ///< 7-bit target address
+  std::vector<uint8_t> out; ///< Bytes written
+  std::vector<uint8_t> in;  ///< Bytes read
+  uint32_t time;            ///< micros() when it started
+  bool ok;                  ///< false if it was NAKed or failed
+};
+
+/**
+ * @brief Mock I2C controller
+ */
+class TwoWire {
+ public:
+  TwoWire();
+
+  void begin(void);
+  void setClock(uint32_t hz);
+  void attach(uint8_t addr, MockDevice* device);
+  void detach(uint8_t addr);
+  void failNext(uint32_t count);
+  void setLogging(bool enable);
+  void clearLog(void);
+  const std::vector<MockTransaction>& getLog(void);
+  uint32_t getTransfers(void);
+  uint32_t getBytes(void);
+
+  bool transfer(uint8_t addr, const uint8_t* out, size_t outLen, uint8_t* in,
+                size_t inLen);
+
+ private:
+  MockDevice* _devices[128];         ///< Targets by address
+  uint32_t _clock;                   ///< Bus clock in Hz, 0 = free transfers
+  uint32_t _fail;                    ///< Transfers left to fail
+  bool _logging;                     ///< Keep a copy of each transfer
+  std::vector<MockTransaction> _log; ///< Transfers since clearLog()
+  uint32_t _transfers;               ///< Transfers since clearLog()
+  uint32_t _bytes;                   ///< Bytes moved since clearLog()
+};
+
+extern TwoWire Wire;  ///< Default bus
+extern TwoWire Wire1; ///< Second bus, for multi-bus tests
+
+#endif // OPT4048_HOST_WIRE_H
@@ -0,0 +1,332 @@
+/*!
+ * @file mock_arduino.cpp
+ *
+ * Virtual clock, interrupt lock, mock TwoWire and Adafruit_I2CDevice for
+ * host builds of the OPT4048 library.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <atomic>
+#include <mutex>
+
+#include "Adafruit_I2CDevice.h"
+#include "Arduino.h"
+#include "Wire.h"
+
+TwoWire Wire;
+TwoWire Wire1;
+
+static std::atomic<uint32_t> mock_micros(0);
+static std::mutex interrupt_lock;
+static thread_local bool interrupts_off = false;
+
+unsigned long micros(void) {
+  return mock_micros.load();
+}
+
+unsigned long millis(void) {
+  return mock_micros.load() / 1000;
+}
+
+void delay(unsigned long ms) {
+  mock_micros += (uint32_t)(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  mock_micros += us;
+}
+
+void noInterrupts(void) {
+  if (!interrupts_off) {
+    interrupt_lock.lock();
+    interrupts_off = true;
+  }
+}
+
+void interrupts(void) {
+  if (interrupts_off) {
+    interrupts_off = false;
+    interrupt_lock.unlock();
+  }
+}
+
+/**
+ * @brief Set the virtual clock
+ *
+ * @param us New micros() value
+ */
+void mock_setMicros(uint32_t us) {
+  mock_micros = us;
+}
+
+/**
+ * @brief Move the virtual clock forward
+ *
+ * @param us Microseconds to add
+ */
+void mock_advanceMicros(uint32_t us) {
+  mock_micros += us;
+}
+
+/**
+ * @brief Run an interrupt handler, waiting out any noInterrupts() section
+ *
+ * @param isr Handler to call
+ */
+void mock_interrupt(void (*isr)(void)) {
+  std::lock_guard<std::mutex> guard(interrupt_lock);
+  isr();
+}
+
+TwoWire::TwoWire() {
+  memset(_devices, 0, sizeof(_devices));
+  _clock = 0;
+  _fail = 0;
+  _logging = true;
+  _transfers = 0;
+  _bytes = 0;
+}
+
+void TwoWire::begin(void) {}
+
+/**
+ * @brief Set the bus clock used to charge transfers on the virtual clock
+ *
+ * Each byte costs 9 clocks, plus one byte for every address phase and one
+ * clock for every stop. With the default of 0, transfers take no time.
+ *
+ * @param hz Bus clock in Hz
+ */
+void TwoWire::setClock(uint32_t hz) {
+  _clock = hz;
+}
+
+/**
+ * @brief Attach a target to the bus
+ *
+ * @param addr 7-bit address
+ * @param device Target, or nullptr to leave the address empty
+ */
+void TwoWire::attach(uint8_t addr, MockDevice* device) {
+  _devices[addr & 0x7F] = device;
+}
+
+/**
+ * @brief Remove the target at an address
+ *
+ * @param addr 7-bit address
+ */
+void TwoWire::detach(uint8_t addr) {
+  _devices[addr & 0x7F] = nullptr;
+}
+
+/**
+ * @brief Make the next transfers fail as if the target NAKed them
+ *
+ * @param count Number of transfers to fail
+ */
+void TwoWire::failNext(uint32_t count) {
+  _fail = count;
+}
+
+/**
+ * @brief Keep or drop copies of the transfers
+ *
+ * Logging is on by default; benchmarks turn it off.
+ *
+ * @param enable true to log each transfer
+ */
+void TwoWire::setLogging(bool enable) {
+  _logging = enable;
+}
+
+/**
+ * @brief Forget the logged transfers and reset the counters
+ */
+void TwoWire::clearLog(void) {
+  _log.clear();
+  _transfers = 0;
+  _bytes = 0;
+}
+
+/**
+ * @brief Transfers logged since clearLog()
+ *
+ * @return The transfers, oldest first
+ */
+const std::vector<MockTransaction>& TwoWire::getLog(void) {
+  return _log;
+}
+
+/**
+ * @brief Number of transfers since clearLog(), logged or not
+ *
+ * @return Transfer count
+ */
+uint32_t TwoWire::getTransfers(void) {
+  return _transfers;
+}
+
+/**
+ * @brief Bytes written and read since clearLog(), without address bytes
+ *
+ * @return Byte count
+ */
+uint32_t TwoWire::getBytes(void) {
+  return _bytes;
+}
+
+/**
+ * @brief Run one transfer: an optional write, then an optional read after a
+ * repeated start
+ *
+ * @param addr 7-bit target address
+ * @param out Bytes to write
+ * @param outLen Number of bytes to write
+ * @param in Buffer for the bytes read
+ * @param inLen Number of bytes to read, 0 for a write only
+ * @return true if the target ACKed every phase
+ */
+bool TwoWire::transfer(uint8_t addr, const uint8_t* out, size_t outLen,
+                       uint8_t* in, size_t inLen) {
+  uint32_t start = micros();
+  MockDevice* device = _devices[addr & 0x7F];
+  bool ok = device != nullptr;
+  if (ok && _fail) {
+    _fail--;
+    ok = false;
+  }
+  if (ok && (outLen || !inLen)) {
+    ok = device->write(out, outLen);
+  }
+  if (ok && inLen) {
+    ok = device->read(in, inLen);
+  }
+  if (!ok && inLen) {
+    memset(in, 0xFF, inLen);
+  }
+
+  _transfers++;
+  _bytes += outLen + inLen;
+  if (_clock) {
+    uint32_t phases = (outLen || !inLen) + (inLen != 0);
+    uint64_t clocks = 9 * (uint64_t)(phases + outLen + inLen) + 1;
+    mock_micros += (uint32_t)((clocks * 1000000 + _clock - 1) / _clock);
+  }
+  if (_logging) {
+    MockTransaction t;
+    t.addr = addr;
+    t.out.assign(out, out + outLen);
+    if (inLen) {
+      t.in.assign(in, in + inLen);
+    }
+    t.time = start;
+    t.ok = ok;
+    _log.push_back(t);
+  }
+  return ok;
+}
+
+/**
+ * @brief Create a device handle, as Adafruit_BusIO does
+ *
+ * @param addr 7-bit address
+ * @param theWire Bus the device is on
+ */
+Adafruit_I2CDevice::Adafruit_I2CDevice(uint8_t addr, TwoWire* theWire) {
+  _addr = addr;
+  _wire = theWire;
+  _begun = false;
+}
+
+/**
+ * @brief Start the bus and optionally probe the address
+ *
+ * @param addr_detect Probe with an empty write
+ * @return true if the device answered, or no probe was requested
+ */
+bool Adafruit_I2CDevice::begin(bool addr_detect) {
+  _wire->begin();
+  _begun = true;
+  if (addr_detect) {
+    return detected();
+  }
+  return true;
+}
+
+/**
+ * @brief Probe the address with an empty write
+ *
+ * @return true if the device ACKed
+ */
+bool Adafruit_I2CDevice::detected(void) {
+  if (!_begun && !begin()) {
+    return false;
+  }
+  return _wire->transfer(_addr, nullptr, 0, nullptr, 0);
+}
+
+/**
+ * @brief The device address
+ *
+ * @return 7-bit address
+ */
+uint8_t Adafruit_I2CDevice::address(void) {
+  return _addr;
+}
+
+/**
+ * @brief Read from the device
+ *
+ * @param buffer Buffer for the bytes
+ * @param len Number of bytes
+ * @param stop Ignored, every transfer ends with a stop on the mock bus
+ * @return true on success
+ */
+bool Adafruit_I2CDevice::read(uint8_t* buffer, size_t len, bool stop) {
+  (void)stop;
+  return _wire->transfer(_addr, nullptr, 0, buffer, len);
+}
+
+/**
+ * @brief Write to the device, optionally after a prefix
+ *
+ * @param buffer Bytes to write
+ * @param len Number of bytes
+ * @param stop Ignored, every transfer ends with a stop on the mock bus
+ * @param prefix_buffer Bytes sent first, usually a register address
+ * @param prefix_len Number of prefix bytes
+ * @return true on success
+ */
+bool Adafruit_I2CDevice::write(const uint8_t* buffer, size_t len, bool stop,
+                               const uint8_t* prefix_buffer,
+                               size_t prefix_len) {
+  (void)stop;
+  if (!prefix_len) {
+    return _wire->transfer(_addr, buffer, len, nullptr, 0);
+  }
+  std::vector<uint8_t> out(prefix_buffer, prefix_buffer + prefix_len);
+  out.insert(out.end(), buffer, buffer + len);
+  return _wire->transfer(_addr, out.data(), out.size(), nullptr, 0);
+}
+
+/**
+ * @brief Write, then read after a repeated start
+ *
+ * @param write_buffer Bytes to write
+ * @param write_len Number of bytes to write
+ * @param read_buffer Buffer for the bytes read
+ * @param read_len Number of bytes to read
+ * @param stop Ignored, every transfer ends with a stop on the mock bus
+ * @return true on success
+ */
+bool Adafruit_I2CDevice::write_then_read(const uint8_t* write_buffer,
+                                         size_t write_len,
+                                         uint8_t* read_buffer,
+                                         size_t read_len, bool stop) {
+  (void)stop;
+  return _wire->transfer(_addr, write_buffer, write_len, read_buffer,
+                         read_len);
+}
@@ -0,0 +1,114 @@
+/*!
+ * @file opt4048_adaptive_test.cpp
+ *
+ * Host tests of Adafruit_OPT4048_Adaptive closing the loop through the
+ * virtual OPT4048: every sample is a real one-shot conversion of the
+ * simulated light at the range and conversion time the controller chose.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048_Adaptive.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+static const uint32_t bright[4] = {100000, 5000000, 50000, 30000};
+
+// Attach a simulator lit by level, start a quick wake sensor on it
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                  const uint32_t* level) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(level);
+  return sensor->begin() && sensor->setQuickWake(true);
+}
+
+// Convert one sample and feed it to the controller, return whether it
+// changed the configuration
+static bool step(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                 Adafruit_OPT4048_Adaptive* adaptive) {
+  uint32_t values[4];
+  CHECK(sensor->setMode(OPT4048_MODE_ONESHOT));
+  sim->advance(4 * sim->getConversionTime());
+  CHECK(sensor->getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  uint8_t flags = sensor->getFlags();
+  return adaptive->update(values, OPT4048_CHANNEL_ALL, flags);
+}
+
+// Step until the controller stops changing anything, return the steps taken
+static int settle(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                  Adafruit_OPT4048_Adaptive* adaptive) {
+  int steps = 0;
+  while (steps < 50 && step(sensor, sim, adaptive)) {
+    steps++;
+  }
+  // Still settled after more samples than a speed-up needs
+  for (int i = 0; i < 8; i++) {
+    CHECK(!step(sensor, sim, adaptive));
+  }
+  return steps;
+}
+
+TEST(adaptive_range_steps_out_of_overload_and_back) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, bright));
+  CHECK(sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US));
+  CHECK(sensor.setRange(OPT4048_RANGE_2K_LUX));
+  Adafruit_OPT4048_Adaptive adaptive(&sensor);
+  adaptive.setLimits(OPT4048_CONVERSION_TIME_600US,
+                     OPT4048_CONVERSION_TIME_600US);
+
+  // 5000000 saturates ranges 0 to 2 and is below 0xF0000 in range 3
+  CHECK(settle(&sensor, &sim, &adaptive) == 3);
+  CHECK(sensor.getRange() == OPT4048_RANGE_18K_LUX);
+  CHECK(!(sensor.getFlags() & OPT4048_FLAG_OVERLOAD));
+
+  // 200000 is below 1/8 of full scale in every range above 0
+  sim.setLight(light);
+  CHECK(settle(&sensor, &sim, &adaptive) == 3);
+  CHECK(sensor.getRange() == OPT4048_RANGE_2K_LUX);
+}
+
+TEST(adaptive_conversion_time_meets_the_target_snr) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, light));
+  CHECK(sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US));
+  CHECK(sensor.setRange(OPT4048_RANGE_2K_LUX));
+  Adafruit_OPT4048_Adaptive adaptive(&sensor);
+
+  // 30000 codes need 2^4 of 2^11 steps for an SNR of 1000
+  CHECK(settle(&sensor, &sim, &adaptive) == 7);
+  CHECK(sensor.getConversionTime() == OPT4048_CONVERSION_TIME_50MS);
+
+  // Four times the light gives 4x the target, so after the stable samples
+  // it speeds up one step, where 2x the target is left
+  const uint32_t four[4] = {400000, 800000, 200000, 120000};
+  sim.setLight(four);
+  int changes = 0;
+  for (int i = 0; i < 20; i++) {
+    changes += step(&sensor, &sim, &adaptive);
+  }
+  CHECK(changes == 1);
+  CHECK(sensor.getConversionTime() == OPT4048_CONVERSION_TIME_25MS);
+}
+
+TEST(adaptive_leaves_auto_range_to_the_sensor) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, bright));
+  CHECK(sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US));
+  CHECK(sensor.setRange(OPT4048_RANGE_AUTO));
+  Adafruit_OPT4048_Adaptive adaptive(&sensor);
+
+  // The sensor picks range 3 for 5000000, leaving 30000 >> 3 = 3750 codes
+  // for the weakest channel, which need 2^10 of 2^11 steps for 1000
+  settle(&sensor, &sim, &adaptive);
+  CHECK(sensor.getRange() == OPT4048_RANGE_AUTO);
+  CHECK(sensor.getConversionTime() == OPT4048_CONVERSION_TIME_400MS);
+}
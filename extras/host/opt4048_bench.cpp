@@ -0,0 +1,100 @@
+/*!
+ * @file opt4048_bench.cpp
+ *
+ * Micro-benchmarks of the driver's read and color paths on the host, with
+ * the bus mocked out, so regressions in decoding and math show up without
+ * hardware. Numbers are wall clock nanoseconds per call; compare runs on the
+ * same machine only.
+ *
+ * Usage: opt4048_bench [iterations]
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "Adafruit_OPT4048.h"
+#include "opt4048_mock.h"
+
+static volatile uint32_t sink; // Keeps results alive
+
+// Print the time per call of fn over n calls
+template <typename F>
+static void bench(const char* name, long n, F fn) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) {
+    fn(i);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-32s %10.1f ns/call\n", name, ns / n);
+}
+
+int main(int argc, char** argv) {
+  long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+  OPT4048Registers regs;
+  const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+  regs.setSample(sample, 1);
+  Wire.attach(OPT4048_DEFAULT_ADDR, &regs);
+  Wire.setLogging(false);
+
+  Adafruit_OPT4048 sensor;
+  if (!sensor.begin()) {
+    fprintf(stderr, "begin() failed\n");
+    return 1;
+  }
+
+  uint8_t frame[16];
+  sensor.getFrameRaw(frame);
+
+  bench("opt4048_decodeChannel", n, [&](long i) {
+    uint32_t code;
+    opt4048_decodeChannel(&frame[4 * (i & 3)], &code);
+    sink = code;
+  });
+  bench("getFrameRaw", n, [&](long) {
+    sensor.getFrameRaw(frame);
+    sink = frame[0];
+  });
+  bench("getChannelsRaw (all)", n, [&](long) {
+    uint32_t ch[4];
+    sensor.getChannelsRaw(&ch[0], &ch[1], &ch[2], &ch[3]);
+    sink = ch[0];
+  });
+  bench("getChannelsRaw (Y)", n, [&](long) {
+    uint32_t values[4];
+    sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values);
+    sink = values[1];
+  });
+  bench("getCIE (double)", n, [&](long) {
+    double x, y, lux;
+    sensor.getCIE(&x, &y, &lux);
+    sink = (uint32_t)(x * 65536);
+  });
+  bench("getCIE (float)", n, [&](long) {
+    float x, y, lux;
+    sensor.getCIE(&x, &y, &lux);
+    sink = (uint32_t)(x * 65536);
+  });
+  bench("getCIEFixed", n, [&](long) {
+    uint16_t x, y;
+    uint32_t mlux;
+    sensor.getCIEFixed(&x, &y, &mlux);
+    sink = x;
+  });
+  bench("getLux", n, [&](long) {
+    double lux;
+    sensor.getLux(&lux);
+    sink = (uint32_t)lux;
+  });
+  bench("calculateColorTemperature", n, [&](long i) {
+    double cct = sensor.calculateColorTemperature(0.3 + (i & 63) * 1e-3, 0.32);
+    sink = (uint32_t)cct;
+  });
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*!
+ * @file opt4048_capture_test.cpp
+ *
+ * Threaded producer/consumer tests of Adafruit_OPT4048_Capture: a producer
+ * thread raises data ready interrupts and services the ring while a
+ * consumer thread drains it, as service() and read() would run on two
+ * cores or from a task and loop().
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <thread>
+
+#include "Adafruit_OPT4048_Capture.h"
+#include "host_test.h"
+#include "opt4048_mock.h"
+
+#define CAPTURE_FRAMES 200000UL //!< Conversions produced per test
+
+static Adafruit_OPT4048_Capture<16>* capture;
+
+static void onInt(void) {
+  capture->interrupt();
+}
+
+// Conversion i, with its index spread over the channels and counter
+static void setConversion(OPT4048Registers* regs, uint32_t i) {
+  const uint32_t codes[4] = {i & 0xFFFFF, (i >> 4) ^ 0x5555, i * 3 & 0xFFFFF,
+                             0x80000};
+  regs->setSample(codes, i & 0x0F);
+}
+
+// Produce conversions, optionally waiting for room in the ring first
+static void produce(OPT4048Registers* regs, bool wait) {
+  for (uint32_t i = 0; i < CAPTURE_FRAMES; i++) {
+    while (wait && capture->available() == 16) {
+      std::this_thread::yield();
+    }
+    setConversion(regs, i);
+    mock_setMicros(i);
+    mock_interrupt(onInt);
+    capture->service();
+  }
+}
+
+// Drain the ring until the producer is done, counting frames received and
+// frames that are out of order or don't decode to what was produced
+static void consume(const bool* done, uint32_t* received, uint32_t* bad) {
+  opt4048_frame_t frames[8];
+  int32_t last = -1;
+  while (true) {
+    bool finished = *(volatile const bool*)done;
+    uint8_t count = capture->read(frames, 8);
+    for (uint8_t f = 0; f < count; f++) {
+      uint32_t i = frames[f].timestamp;
+      uint32_t values[4];
+      uint8_t counter;
+      if (!opt4048_decodeFrame(&frames[f], values, &counter) ||
+          (int32_t)i <= last || values[0] != (i & 0xFFFFF) ||
+          values[2] != (i * 3 & 0xFFFFF) || counter != (i & 0x0F)) {
+        (*bad)++;
+      }
+      last = i;
+    }
+    *received += count;
+    if (!count) {
+      if (finished) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Run a producer and a consumer thread on one ring
+static void run(bool wait, uint32_t* received, uint32_t* bad,
+                uint32_t* overflows) {
+  OPT4048Registers regs;
+  Wire.attach(OPT4048_DEFAULT_ADDR, &regs);
+  Wire.failNext(0);
+  Wire.setLogging(false);
+  Adafruit_OPT4048 sensor;
+  CHECK(sensor.begin());
+  Adafruit_OPT4048_Capture<16> ring(&sensor);
+  capture = &ring;
+  CHECK(ring.begin());
+
+  bool done = false;
+  *received = 0;
+  *bad = 0;
+  std::thread consumer(consume, &done, received, bad);
+  produce(&regs, wait);
+  __sync_synchronize();
+  *(volatile bool*)&done = true;
+  consumer.join();
+
+  *overflows = ring.getOverflows();
+  CHECK(ring.getMissed() == 0);
+  capture = nullptr;
+  Wire.setLogging(true);
+}
+
+TEST(capture_delivers_every_frame_in_order) {
+  uint32_t received, bad, overflows;
+  run(true, &received, &bad, &overflows);
+  CHECK(received == CAPTURE_FRAMES);
+  CHECK(bad == 0);
+  CHECK(overflows == 0);
+}
+
+TEST(capture_counts_every_frame_it_drops) {
+  uint32_t received, bad, overflows;
+  run(false, &received, &bad, &overflows);
+  CHECK(received + overflows == CAPTURE_FRAMES);
+  CHECK(bad == 0);
+}
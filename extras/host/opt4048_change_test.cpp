@@ -0,0 +1,251 @@
+/*!
+ * @file opt4048_change_test.cpp
+ *
+ * Host tests of change tracking: the threshold encoder, the register
+ * writes that start, move and stop the window, and the interrupts it gives
+ * on the virtual OPT4048 as the light rises and falls.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+
+// ADC code a threshold word is compared against
+static uint64_t thresholdCode(uint16_t word) {
+  return (uint64_t)(word & 0x0FFF) << (8 + (word >> 12));
+}
+
+// Check that code is bracketed by its low and high threshold words,
+// each within one step of it, return false at the first failure
+static bool brackets(uint32_t code) {
+  uint16_t low = opt4048_encodeThreshold(code);
+  uint16_t high = opt4048_encodeThreshold(code, true);
+  uint64_t lo = thresholdCode(low), hi = thresholdCode(high);
+  if (lo > code || hi < code) {
+    return false;
+  }
+  // Above 2^20 the step is at most 1/2048 of the code
+  if (code >= (1UL << 20) &&
+      ((code - lo) * 2048 > code || (hi - code) * 2048 > code)) {
+    return false;
+  }
+  return code - lo < (256ULL << (low >> 12)) &&
+         hi - code < (256ULL << (high >> 12));
+}
+
+// Attach registers holding sample and start a sensor on them
+static bool start(Adafruit_OPT4048* sensor, OPT4048Registers* regs) {
+  Wire.attach(OPT4048_DEFAULT_ADDR, regs);
+  Wire.failNext(0);
+  regs->setSample(sample, 1);
+  bool ok = sensor->begin();
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(threshold_encoder_brackets_every_code) {
+  uint32_t bad = 0;
+  for (uint32_t code = 0; code < (1UL << 21); code++) {
+    bad += !brackets(code);
+  }
+  uint32_t code = 1;
+  for (int i = 0; i < 1000000; i++) {
+    code = code * 1664525 + 1013904223;
+    bad += !brackets(code);
+  }
+  bad += !brackets(0xFFFFFFFF);
+  CHECK(bad == 0);
+
+  // Exact codes round to themselves either way
+  CHECK(opt4048_encodeThreshold(0xABC00) == 0x0ABC);
+  CHECK(opt4048_encodeThreshold(0xABC00, true) == 0x0ABC);
+  CHECK(opt4048_encodeThreshold(0xABC01, true) == 0x0ABD);
+  CHECK(opt4048_encodeThreshold(0x1000000) == 0x5800);
+}
+
+TEST(change_tracking_starts_with_one_read_and_one_burst) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  CHECK(sensor.setInterruptLatch(false));
+  Wire.clearLog();
+  uint16_t config = regs.regs[OPT4048_REG_CONFIG];
+  uint16_t thresholdCfg = regs.regs[OPT4048_REG_THRESHOLD_CFG];
+
+  CHECK(!sensor.startChangeTracking(4));
+  CHECK(!sensor.startChangeTracking(1, 0));
+  CHECK(!sensor.startChangeTracking(1, 1));
+  CHECK(Wire.getTransfers() == 0);
+
+  CHECK(sensor.startChangeTracking(1, 0.05f));
+  CHECK(sensor.isTrackingChange());
+  CHECK(Wire.getLog()[0].in.size() == 4);
+  const MockTransaction& burst = Wire.getLog()[1];
+  CHECK(burst.out.size() == 1 + 8);
+  CHECK(burst.out[0] == OPT4048_REG_THRESHOLD_LOW);
+  CHECK(Wire.getTransfers() == 3 &&
+        Wire.getLog()[2].out[0] == OPT4048_REG_STATUS);
+
+  // +/- 5% of channel 1, latch on, threshold interrupts on channel 1
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_LOW] ==
+        opt4048_encodeThreshold(190000));
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_HIGH] ==
+        opt4048_encodeThreshold(210000, true));
+  CHECK(regs.regs[OPT4048_REG_CONFIG] == (config | 0x0008));
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_CFG] ==
+        ((thresholdCfg & ~0x006C) | (1 << 5) | 0x0010));
+}
+
+TEST(change_tracking_moves_the_window_only_when_it_changes) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  CHECK(sensor.startChangeTracking(1, 0.05f));
+  Wire.clearLog();
+
+  // A new value of the tracked channel moves both thresholds in one write,
+  // then clears the latched flags
+  uint32_t values[4];
+  regs.setChannel(1, 300000, 2);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+  CHECK(Wire.getLog()[1].out.size() == 1 + 4);
+  CHECK(Wire.getLog()[1].out[0] == OPT4048_REG_THRESHOLD_LOW);
+  CHECK(Wire.getTransfers() == 3 &&
+        Wire.getLog()[2].out[0] == OPT4048_REG_STATUS);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_LOW] ==
+        opt4048_encodeThreshold(285000));
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_HIGH] ==
+        opt4048_encodeThreshold(315000, true));
+
+  // The same rounded window, or no tracked channel, writes nothing
+  Wire.clearLog();
+  regs.setChannel(1, 300001, 3);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_X, values));
+  CHECK(Wire.getTransfers() == 2);
+}
+
+TEST(change_tracking_stop_restores_the_interrupt_settings) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  CHECK(sensor.setInterruptLatch(false));
+  uint16_t config = regs.regs[OPT4048_REG_CONFIG];
+  uint16_t thresholdCfg = regs.regs[OPT4048_REG_THRESHOLD_CFG];
+  CHECK(sensor.startChangeTracking(1, 0.05f));
+  uint16_t low = regs.regs[OPT4048_REG_THRESHOLD_LOW];
+  Wire.clearLog();
+
+  // CONFIG and THRESHOLD_CFG in one write, the window is left alone
+  CHECK(sensor.stopChangeTracking());
+  CHECK(!sensor.isTrackingChange());
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].out.size() == 1 + 4);
+  CHECK(Wire.getLog()[0].out[0] == OPT4048_REG_CONFIG);
+  CHECK(regs.regs[OPT4048_REG_CONFIG] == config);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_CFG] ==
+        ((thresholdCfg & ~0x0060) | (1 << 5) | 0x0010));
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_LOW] == low);
+
+  // Stopping again, and reads after, touch nothing
+  uint32_t values[4];
+  regs.setChannel(1, 300000, 2);
+  CHECK(sensor.stopChangeTracking());
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+  CHECK(Wire.getTransfers() == 2);
+}
+
+// Advance to the end of the next conversion with channel 1 at level
+static void convertAt(OPT4048Simulator* sim, uint32_t level) {
+  const uint32_t light[4] = {100000, level, 50000, 30000};
+  sim->setLight(light);
+  sim->advance(4 * 600);
+}
+
+static uint32_t int_count;
+
+static void onInt(void) {
+  int_count++;
+}
+
+TEST(change_tracking_interrupts_on_falling_light) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  mock_setMicros(0);
+  CHECK(start(&sensor, &sim));
+  Wire.setClock(0);
+  CHECK(sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US));
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  convertAt(&sim, 200000);
+  CHECK(sensor.startChangeTracking(1, 0.05f));
+  int_count = 0;
+  sim.setInterruptHandler(onInt);
+
+  // Inside the window, nothing
+  convertAt(&sim, 205000);
+  CHECK(int_count == 0);
+
+  // Falling light interrupts once, however long it stays low
+  convertAt(&sim, 150000);
+  convertAt(&sim, 150000);
+  CHECK(int_count == 1);
+
+  // Reading the sample moves the window and rearms INT
+  uint32_t values[4];
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+  CHECK(values[1] == 150000);
+  CHECK(!(sim.regs[OPT4048_REG_STATUS] & OPT4048_FLAG_L));
+  convertAt(&sim, 150000);
+  CHECK(int_count == 1);
+  convertAt(&sim, 100000);
+  CHECK(int_count == 2);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+
+  // And rising light as well
+  convertAt(&sim, 130000);
+  CHECK(int_count == 3);
+  sim.setInterruptHandler(nullptr);
+}
+
+TEST(transparent_thresholds_are_a_hysteresis) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  mock_setMicros(0);
+  CHECK(start(&sensor, &sim));
+  Wire.setClock(0);
+  CHECK(sensor.setConversionTime(OPT4048_CONVERSION_TIME_600US));
+  CHECK(sensor.setInterruptLatch(false));
+  CHECK(sensor.setInterruptConfig(OPT4048_INT_CFG_SMBUS_ALERT));
+  CHECK(sensor.setThresholdChannel(1));
+  CHECK(sensor.setThresholdLow(150000));
+  CHECK(sensor.setThresholdHigh(250000));
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  int_count = 0;
+  sim.setInterruptHandler(onInt);
+  const uint16_t flags = OPT4048_FLAG_H | OPT4048_FLAG_L;
+
+  // FLAG_H is set above the window and stays set inside it
+  convertAt(&sim, 300000);
+  CHECK((sim.regs[OPT4048_REG_STATUS] & flags) == OPT4048_FLAG_H);
+  CHECK(int_count == 1);
+  convertAt(&sim, 200000);
+  CHECK((sensor.getFlags() & flags) == OPT4048_FLAG_H);
+
+  // Below it FLAG_H clears and FLAG_L is set, without an interrupt
+  convertAt(&sim, 100000);
+  CHECK((sim.regs[OPT4048_REG_STATUS] & flags) == OPT4048_FLAG_L);
+  convertAt(&sim, 200000);
+  CHECK((sim.regs[OPT4048_REG_STATUS] & flags) == OPT4048_FLAG_L);
+  CHECK(int_count == 1);
+
+  convertAt(&sim, 300000);
+  CHECK(int_count == 2);
+  sim.setInterruptHandler(nullptr);
+}
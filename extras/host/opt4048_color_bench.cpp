@@ -0,0 +1,173 @@
+/*!
+ * @file opt4048_color_bench.cpp
+ *
+ * Accuracy and speed of the float and Q16 fixed-point color pipelines
+ * against the double one, on random ADC codes.
+ *
+ * For every sample the report gives the worst difference from double:
+ * CIE x and y of the float and fixed versions, fixed lux, and fixed CCT fed
+ * with the fixed x and y, compared with double McCamy on the same x and y
+ * where 0.25 <= x <= 0.55 and y >= 0.25. The run fails if any of them is
+ * outside the bounds documented on the functions.
+ *
+ * opt4048_convertBatch() is checked the same way for x and y, and its
+ * throughput compared with converting the samples one at a time.
+ *
+ * Usage: opt4048_color_bench [samples]
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "Adafruit_OPT4048_Math.h"
+
+static volatile double sink; // Keeps results alive
+
+// Print the time per sample of fn over all samples
+template <typename F>
+static void bench(const char* name, size_t n, F fn) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i++) {
+    fn(i);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-32s %10.1f ns/sample\n", name, ns / n);
+}
+
+// Print a worst case against its bound, return whether it is within
+static bool report(const char* name, double worst, double bound) {
+  bool ok = worst <= bound;
+  printf("%-32s %12.3g (bound %.4g)%s\n", name, worst, bound,
+         ok ? "" : "  FAIL");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? atol(argv[1]) : 10000000;
+
+  // Mantissa and exponent drawn separately, as the sensor reports them
+  std::vector<uint32_t> codes(3 * n);
+  srand(1);
+  for (size_t i = 0; i < codes.size(); i++) {
+    uint32_t mant = (((uint32_t)rand() << 4) ^ rand()) & 0xFFFFF;
+    codes[i] = mant << (rand() % 7);
+  }
+
+  // The same samples as structure of arrays, for opt4048_convertBatch()
+  std::vector<uint32_t> ch[3];
+  for (int c = 0; c < 3; c++) {
+    ch[c].resize(n);
+    for (size_t i = 0; i < n; i++) {
+      ch[c][i] = codes[3 * i + c];
+    }
+  }
+  std::vector<float> outs[7];
+  for (int o = 0; o < 7; o++) {
+    outs[o].resize(n);
+  }
+  opt4048_batch_t batch = {&outs[0][0], &outs[1][0], &outs[2][0], &outs[3][0],
+                           &outs[4][0], &outs[5][0], &outs[6][0]};
+  opt4048_convertBatch(&ch[0][0], &ch[1][0], &ch[2][0], n, &batch);
+
+  double xf = 0, yf = 0, xb = 0, yb = 0, xq = 0, yq = 0, luxq = 0, cctq = 0;
+  size_t cctCount = 0;
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t* c = &codes[3 * i];
+    double x, y, lux;
+    float fx, fy, flux;
+    uint16_t qx, qy;
+    uint32_t mlux;
+    if (!opt4048_calculateCIE(c[0], c[1], c[2], 0, &x, &y, &lux) ||
+        x < 0 || x >= 1 || y < 0 || y >= 1) {
+      continue;
+    }
+    opt4048_calculateCIE(c[0], c[1], c[2], 0, &fx, &fy, &flux);
+    opt4048_calculateCIEFixed(c[0], c[1], c[2], &qx, &qy, &mlux);
+
+    xf = fmax(xf, fabs(fx - x));
+    yf = fmax(yf, fabs(fy - y));
+    xb = fmax(xb, fabs(batch.CIEx[i] - x));
+    yb = fmax(yb, fabs(batch.CIEy[i] - y));
+    xq = fmax(xq, fabs(qx - x * 65536));
+    yq = fmax(yq, fabs(qy - y * 65536));
+    // Truncation leaves 0 to 1 mlux below, plus rounding in the double
+    double below = lux * 1000 - mlux;
+    luxq = fmax(luxq, below < 0 ? 1 - below : below);
+
+    double dx = qx / 65536.0, dy = qy / 65536.0;
+    if (dx >= 0.25 && dx <= 0.55 && dy >= 0.25) {
+      double cct = opt4048_calculateColorTemperature(dx, dy);
+      uint32_t fixed = opt4048_calculateColorTemperatureFixed(qx, qy);
+      cctq = fmax(cctq, fabs(fixed - cct) / cct);
+      cctCount++;
+    }
+  }
+
+  printf("%zu samples, %zu in the CCT range\n\n", n, cctCount);
+  bool ok = true;
+  ok &= report("float x", xf, 2e-7);
+  ok &= report("float y", yf, 2e-7);
+  ok &= report("batch x", xb, 2e-7);
+  ok &= report("batch y", yb, 2e-7);
+  ok &= report("fixed x (Q16 LSB)", xq, 3);
+  ok &= report("fixed y (Q16 LSB)", yq, 3);
+  ok &= report("fixed lux (mlux)", luxq, 1.001);
+  ok &= report("fixed CCT (relative)", cctq, 5e-4);
+  printf("\n");
+
+  bench("calculateCIE double", n, [&](size_t i) {
+    const uint32_t* c = &codes[3 * i];
+    double x, y, lux;
+    opt4048_calculateCIE(c[0], c[1], c[2], 0, &x, &y, &lux);
+    sink = x + y + lux;
+  });
+  bench("calculateCIE float", n, [&](size_t i) {
+    const uint32_t* c = &codes[3 * i];
+    float x, y, lux;
+    opt4048_calculateCIE(c[0], c[1], c[2], 0, &x, &y, &lux);
+    sink = x + y + lux;
+  });
+  bench("calculateCIEFixed", n, [&](size_t i) {
+    const uint32_t* c = &codes[3 * i];
+    uint16_t x, y;
+    uint32_t mlux;
+    opt4048_calculateCIEFixed(c[0], c[1], c[2], &x, &y, &mlux);
+    sink = x + y + mlux;
+  });
+  bench("calculateColorTemperature", n, [&](size_t i) {
+    sink = opt4048_calculateColorTemperature(0.25 + (i & 0xFF) / 1024.0,
+                                             0.33);
+  });
+  bench("calculateColorTemperatureFixed", n, [&](size_t i) {
+    sink = opt4048_calculateColorTemperatureFixed(16384 + (i & 0xFF) * 64,
+                                                  21627);
+  });
+
+  // Whole batches against the scalar float functions in a loop
+  auto t0 = std::chrono::steady_clock::now();
+  opt4048_convertBatch(&ch[0][0], &ch[1][0], &ch[2][0], n, &batch);
+  auto t1 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i++) {
+    float x, y, lux;
+    opt4048_calculateCIE(ch[0][i], ch[1][i], ch[2][i], 0, &x, &y, &lux);
+    batch.lux[i] = lux;
+    batch.CIEx[i] = x;
+    batch.CIEy[i] = y;
+    batch.CCT[i] = opt4048_calculateColorTemperature(x, y);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  double batchRate = n / std::chrono::duration<double>(t1 - t0).count();
+  double scalarRate = n / std::chrono::duration<double>(t2 - t1).count();
+  printf("\n%-32s %10.1f Msamples/s\n", "convertBatch", batchRate / 1e6);
+  printf("%-32s %10.1f Msamples/s\n", "calculateCIE float loop",
+         scalarRate / 1e6);
+  return ok ? 0 : 1;
+}
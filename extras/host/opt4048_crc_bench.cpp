@@ -0,0 +1,164 @@
+/*!
+ * @file opt4048_crc_bench.cpp
+ *
+ * Checks the CRC used by opt4048_decodeChannel() against the bit-by-bit
+ * implementation getChannelsRaw() used to have, on every 28-bit input, and
+ * measures frames decoded per second with each.
+ *
+ * The reference is the original loop over the exponent, the 20-bit
+ * mantissa and the counter, following the datasheet formula bit by bit.
+ *
+ * Usage: opt4048_crc_bench [-c] [frames]
+ *
+ *   -c      Only run the exhaustive check, exit status 1 on a mismatch
+ *   frames  Frames per benchmark run, 10000000 by default
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "Adafruit_OPT4048_Math.h"
+
+// The CRC as getChannelsRaw() computed it before the parity table:
+// X[0] = XOR(E[3:0], R[19:0], C[3:0])
+// X[1] = XOR(C[1], C[3], R[1], R[3], ..., R[19], E[1], E[3])
+// X[2] = XOR(C[3], R[3], R[7], R[11], R[15], R[19], E[3])
+// X[3] = XOR(R[3], R[11], R[19])
+static uint8_t referenceCRC(uint8_t exp, uint32_t mant, uint8_t counter) {
+  uint8_t x0 = 0, x1 = 0, x2 = 0, x3 = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    x0 ^= (exp >> i) & 1;
+  }
+  for (uint8_t i = 0; i < 20; i++) {
+    x0 ^= (mant >> i) & 1;
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    x0 ^= (counter >> i) & 1;
+  }
+
+  x1 ^= (counter >> 1) & 1;
+  x1 ^= (counter >> 3) & 1;
+  for (uint8_t i = 1; i < 20; i += 2) {
+    x1 ^= (mant >> i) & 1;
+  }
+  x1 ^= (exp >> 1) & 1;
+  x1 ^= (exp >> 3) & 1;
+
+  x2 ^= (counter >> 3) & 1;
+  for (uint8_t i = 3; i < 20; i += 4) {
+    x2 ^= (mant >> i) & 1;
+  }
+  x2 ^= (exp >> 3) & 1;
+
+  x3 ^= (mant >> 3) & 1;
+  x3 ^= (mant >> 11) & 1;
+  x3 ^= (mant >> 19) & 1;
+
+  return (x3 << 3) | (x2 << 2) | (x1 << 1) | x0;
+}
+
+// The decode loop of the original getChannelsRaw()
+static bool referenceDecode(const uint8_t* buf, uint32_t* values) {
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    uint8_t exp = buf[4 * ch] >> 4;
+    uint32_t mant = ((uint32_t)(buf[4 * ch] & 0x0F) << 16) |
+                    ((uint32_t)buf[4 * ch + 1] << 8) | buf[4 * ch + 2];
+    uint8_t counter = buf[4 * ch + 3] >> 4;
+    if ((buf[4 * ch + 3] & 0x0F) != referenceCRC(exp, mant, counter)) {
+      return false;
+    }
+    values[ch] = mant << exp;
+  }
+  return true;
+}
+
+static bool libraryDecode(const uint8_t* buf, uint32_t* values) {
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    if (!opt4048_decodeChannel(&buf[4 * ch], &values[ch])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Compare both CRCs on every exponent, mantissa and counter
+static uint32_t checkAll(void) {
+  uint32_t mismatches = 0;
+  for (uint32_t v = 0; v < (1UL << 28); v++) {
+    uint8_t exp = v >> 24;
+    uint8_t counter = (v >> 20) & 0x0F;
+    uint32_t mant = v & 0xFFFFF;
+    if (referenceCRC(exp, mant, counter) !=
+        opt4048_calculateCRC(exp, mant, counter)) {
+      if (!mismatches) {
+        printf("first mismatch: exp %u mantissa 0x%05X counter %u\n", exp,
+               (unsigned)mant, counter);
+      }
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+// Decode every frame in turn, return frames per second and the sum of the
+// codes of the frames that passed, so the work can't be optimized away
+static double benchDecode(bool (*decode)(const uint8_t*, uint32_t*),
+                          const std::vector<uint8_t>& frames, long count,
+                          uint64_t* sum) {
+  size_t n = frames.size() / 16;
+  uint32_t values[4];
+  *sum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < count; i++) {
+    if (decode(&frames[16 * (i % n)], values)) {
+      *sum += values[0] + values[1] + values[2] + values[3];
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return count / std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char** argv) {
+  bool checkOnly = argc > 1 && !strcmp(argv[1], "-c");
+  long count = 10000000;
+  if (argc > 1 + checkOnly) {
+    count = atol(argv[1 + checkOnly]);
+  }
+
+  uint32_t mismatches = checkAll();
+  printf("%u of %lu inputs differ\n", (unsigned)mismatches, 1UL << 28);
+  if (checkOnly || mismatches) {
+    return mismatches ? 1 : 0;
+  }
+
+  // 4096 frames of random codes and counters, one in 16 channels damaged
+  std::vector<uint8_t> frames(16 * 4096);
+  srand(1);
+  for (size_t f = 0; f < frames.size() / 16; f++) {
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      uint32_t code = (uint32_t)rand() >> (rand() % 16);
+      opt4048_encodeChannel(code, f & 0x0F, &frames[16 * f + 4 * ch]);
+      if (rand() % 16 == 0) {
+        frames[16 * f + 4 * ch + 1 + rand() % 3] ^= 1 << (rand() % 8);
+      }
+    }
+  }
+
+  uint64_t refSum, libSum;
+  double ref = benchDecode(referenceDecode, frames, count, &refSum);
+  double lib = benchDecode(libraryDecode, frames, count, &libSum);
+  printf("bit-by-bit   %12.0f frames/s\n", ref);
+  printf("parity table %12.0f frames/s (%.1fx)\n", lib, lib / ref);
+  if (refSum != libSum) {
+    printf("decoded values differ\n");
+    return 1;
+  }
+  return 0;
+}
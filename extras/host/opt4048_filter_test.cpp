@@ -0,0 +1,191 @@
+/*!
+ * @file opt4048_filter_test.cpp
+ *
+ * Host tests of the streaming filters against brute-force references that
+ * keep every sample: while the window fills, as it wraps around, and with
+ * the largest codes at the largest window or shift.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "Adafruit_OPT4048_Filter.h"
+#include "host_test.h"
+
+#define FILTER_SAMPLES 1000 //!< Samples fed to each filter
+
+#define MAX_CODE (0xFFFFFUL << 6) //!< Largest code in a measurement
+
+static uint32_t seed;
+
+// Random ADC code with a random exponent, or one of a few values when
+// narrow, so the median sees plenty of ties
+static uint32_t randomCode(bool narrow) {
+  seed = seed * 1664525 + 1013904223;
+  if (narrow) {
+    return (seed >> 16) % 5;
+  }
+  if ((seed >> 8) % 8 == 0) {
+    return MAX_CODE;
+  }
+  return ((seed >> 4) & 0xFFFFF) << ((seed >> 28) % 7);
+}
+
+// Fill history with random samples
+static void randomSamples(std::vector<uint32_t>* history, bool narrow) {
+  seed = 12345;
+  history->resize(FILTER_SAMPLES * 4);
+  for (size_t i = 0; i < history->size(); i++) {
+    (*history)[i] = randomCode(narrow);
+  }
+}
+
+// Rounded average of the last window samples of each channel
+static void boxcarReference(const std::vector<uint32_t>& history, size_t n,
+                            size_t window, uint32_t* out) {
+  size_t count = n < window ? n : window;
+  for (int ch = 0; ch < 4; ch++) {
+    uint64_t sum = 0;
+    for (size_t i = n - count; i < n; i++) {
+      sum += history[i * 4 + ch];
+    }
+    out[ch] = (sum + count / 2) / count;
+  }
+}
+
+// Upper median of the last window samples of each channel
+static void medianReference(const std::vector<uint32_t>& history, size_t n,
+                            size_t window, uint32_t* out) {
+  size_t count = n < window ? n : window;
+  for (int ch = 0; ch < 4; ch++) {
+    std::vector<uint32_t> last;
+    for (size_t i = n - count; i < n; i++) {
+      last.push_back(history[i * 4 + ch]);
+    }
+    std::sort(last.begin(), last.end());
+    out[ch] = last[count / 2];
+  }
+}
+
+// Samples where a filter of window N differs from its reference
+template <class Filter, uint8_t N>
+static uint32_t windowMismatches(bool median, bool narrow) {
+  std::vector<uint32_t> history;
+  randomSamples(&history, narrow);
+
+  Filter filter;
+  uint32_t bad = 0;
+  for (size_t n = 1; n <= FILTER_SAMPLES; n++) {
+    uint32_t out[4], expected[4];
+    filter.update(&history[(n - 1) * 4], out);
+    if (median) {
+      medianReference(history, n, N, expected);
+    } else {
+      boxcarReference(history, n, N, expected);
+    }
+    for (int ch = 0; ch < 4; ch++) {
+      bad += out[ch] != expected[ch];
+    }
+  }
+  return bad;
+}
+
+// Largest distance of an EMA from the exact one in real numbers
+template <uint8_t SHIFT>
+static double emaError(void) {
+  std::vector<uint32_t> history;
+  randomSamples(&history, false);
+
+  Adafruit_OPT4048_EMA<SHIFT> filter;
+  double exact[4], worst = 0;
+  for (size_t n = 0; n < FILTER_SAMPLES; n++) {
+    const uint32_t* in = &history[n * 4];
+    uint32_t out[4];
+    filter.update(in, out);
+    for (int ch = 0; ch < 4; ch++) {
+      exact[ch] = n ? exact[ch] + (in[ch] - exact[ch]) / (1 << SHIFT) : in[ch];
+      double error = fabs(out[ch] - exact[ch]);
+      worst = error > worst ? error : worst;
+    }
+  }
+  return worst;
+}
+
+TEST(boxcar_matches_a_brute_force_average) {
+  CHECK((windowMismatches<Adafruit_OPT4048_Boxcar<1>, 1>(false, false)) == 0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Boxcar<5>, 5>(false, false)) == 0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Boxcar<64>, 64>(false, false)) ==
+        0);
+
+  // 64 of the largest codes still fit the 32 bit sum
+  Adafruit_OPT4048_Boxcar<64> filter;
+  const uint32_t max[4] = {MAX_CODE, MAX_CODE, MAX_CODE, MAX_CODE};
+  uint32_t out[4];
+  for (int i = 0; i < 200; i++) {
+    filter.update(max, out);
+  }
+  CHECK(out[0] == MAX_CODE && out[3] == MAX_CODE);
+}
+
+TEST(median_matches_a_brute_force_sort) {
+  CHECK((windowMismatches<Adafruit_OPT4048_Median<1>, 1>(true, false)) == 0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Median<5>, 5>(true, false)) == 0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Median<31>, 31>(true, false)) ==
+        0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Median<7>, 7>(true, true)) == 0);
+  CHECK((windowMismatches<Adafruit_OPT4048_Median<31>, 31>(true, true)) == 0);
+}
+
+TEST(median_rejects_a_single_spike) {
+  Adafruit_OPT4048_Median<3> filter;
+  const uint32_t level[4] = {1000, 2000, 3000, 4000};
+  const uint32_t spike[4] = {MAX_CODE, 0, MAX_CODE, 0};
+  uint32_t out[4];
+  filter.update(level, out);
+  filter.update(level, out);
+  filter.update(spike, out);
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(out[ch] == level[ch]);
+  }
+}
+
+TEST(ema_stays_within_a_code_of_the_exact_average) {
+  CHECK(emaError<1>() < 1.5);
+  CHECK(emaError<3>() < 1.5);
+  CHECK(emaError<6>() < 1.5);
+
+  // The largest codes at the largest shift keep 32 bits of state
+  Adafruit_OPT4048_EMA<6> filter;
+  const uint32_t max[4] = {MAX_CODE, MAX_CODE, MAX_CODE, MAX_CODE};
+  uint32_t out[4];
+  for (int i = 0; i < 1000; i++) {
+    filter.update(max, out);
+  }
+  CHECK(out[0] == MAX_CODE);
+}
+
+TEST(filters_work_in_place_and_reset) {
+  Adafruit_OPT4048_Boxcar<4> boxcar;
+  Adafruit_OPT4048_EMA<2> ema;
+  Adafruit_OPT4048_Median<3> median;
+  uint32_t a[4] = {100, 200, 300, 400};
+  uint32_t b[4] = {100, 200, 300, 400};
+  uint32_t c[4] = {100, 200, 300, 400};
+  boxcar.update(a, a);
+  ema.update(b, b);
+  median.update(c, c);
+  CHECK(a[1] == 200 && b[1] == 200 && c[1] == 200);
+
+  // After a reset the next sample is the first
+  const uint32_t next[4] = {900, 900, 900, 900};
+  boxcar.reset();
+  ema.reset();
+  median.reset();
+  boxcar.update(next, a);
+  ema.update(next, b);
+  median.update(next, c);
+  CHECK(a[0] == 900 && b[0] == 900 && c[0] == 900);
+}
@@ -0,0 +1,114 @@
+/*!
+ * @file opt4048_instrumentation_test.cpp
+ *
+ * Host tests of the per-method bus statistics, built against a copy of the
+ * library compiled with OPT4048_INSTRUMENTATION.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_mock.h"
+
+static const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+
+// Statistics of one method
+static opt4048_call_stats_t stats(Adafruit_OPT4048* sensor,
+                                  opt4048_call_t call) {
+  opt4048_call_stats_t s;
+  CHECK(sensor->getCallStats(call, &s));
+  return s;
+}
+
+// Sum of a method's latency histogram
+static uint32_t histogramCalls(const opt4048_call_stats_t& s) {
+  uint32_t calls = 0;
+  for (uint8_t i = 0; i < OPT4048_LATENCY_BUCKETS; i++) {
+    calls += s.latency[i];
+  }
+  return calls;
+}
+
+// Attach registers holding sample and start a sensor on them
+static bool start(Adafruit_OPT4048* sensor, OPT4048Registers* regs) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, regs);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  regs->setSample(sample, 1);
+  return sensor->begin();
+}
+
+TEST(instrumentation_counts_begin_and_its_nested_calls) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  // ID read, CONFIG/THRESHOLD_CFG read, both written in one burst; the
+  // address probe is BusIO's own and not counted
+  opt4048_call_stats_t s = stats(&sensor, OPT4048_CALL_BEGIN);
+  CHECK(s.calls == 1);
+  CHECK(s.transactions == 3);
+  CHECK(s.bytesWritten == 1 + 1 + 5);
+  CHECK(s.bytesRead == 2 + 4);
+  CHECK(s.crcErrors == 0 && s.failedTransfers == 0);
+  CHECK(histogramCalls(s) == 1);
+  CHECK(stats(&sensor, OPT4048_CALL_RESYNC).calls == 0);
+
+  sensor.resetCallStats();
+  CHECK(stats(&sensor, OPT4048_CALL_BEGIN).calls == 0);
+}
+
+TEST(instrumentation_charges_nested_reads_to_the_outer_call) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  double x, y, lux;
+  CHECK(sensor.getCIE(&x, &y, &lux));
+  opt4048_call_stats_t s = stats(&sensor, OPT4048_CALL_GET_CIE);
+  CHECK(s.calls == 1 && s.transactions == 1);
+  CHECK(s.bytesRead == 12); // Channels 0-2 only
+  CHECK(stats(&sensor, OPT4048_CALL_GET_CHANNELS_RAW).calls == 0);
+}
+
+TEST(instrumentation_attributes_crc_errors_and_failures) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  uint32_t values[4];
+
+  // One bad channel, then a re-read of just that channel, also bad
+  regs.regs[OPT4048_REG_CH2_LSB] ^= 0x0100;
+  sensor.setCRCRetry(1);
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  opt4048_call_stats_t s = stats(&sensor, OPT4048_CALL_GET_CHANNELS_RAW);
+  CHECK(s.calls == 1 && s.transactions == 2);
+  CHECK(s.bytesRead == 16 + 4 && s.bytesWritten == 2);
+  CHECK(s.crcErrors == 2);
+
+  // A failed transfer reads nothing
+  Wire.failNext(1);
+  CHECK(!sensor.getFlags());
+  s = stats(&sensor, OPT4048_CALL_GET_FLAGS);
+  CHECK(s.calls == 1 && s.transactions == 1 && s.failedTransfers == 1);
+  CHECK(s.bytesRead == 0);
+}
+
+TEST(instrumentation_histogram_follows_bus_time) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  // 2 + 17 bytes with their ACKs take 1.72 ms at 100 kHz
+  Wire.setClock(100000);
+  uint8_t frame[16];
+  for (int i = 0; i < 10; i++) {
+    CHECK(sensor.getFrameRaw(frame));
+  }
+  opt4048_call_stats_t s = stats(&sensor, OPT4048_CALL_GET_FRAME_RAW);
+  CHECK(s.calls == 10 && histogramCalls(s) == 10);
+  CHECK(s.latency[10] == 10);
+}
@@ -0,0 +1,230 @@
+/*!
+ * @file opt4048_integrity_test.cpp
+ *
+ * Host tests of the checks that keep damaged or mixed samples out: the CRC
+ * against every single bit flip on the bus, CRC re-reads, and frames torn
+ * between two conversions on the virtual OPT4048.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+static const uint32_t other[4] = {120000, 180000, 60000, 25000};
+
+/**
+ * @brief Register file that flips bits of the next read on the bus
+ *
+ * Can also store a new channel 0 right after that read, as if the sensor
+ * finished converting it in between.
+ */
+class NoisyRegisters : public OPT4048Registers {
+ public:
+  NoisyRegisters() : flipByte(-1), flipMask(0), nextCounter(-1), nextCode(0) {}
+
+  bool read(uint8_t* data, size_t len) override {
+    OPT4048Registers::read(data, len);
+    if (flipByte >= 0 && (size_t)flipByte < len) {
+      data[flipByte] ^= flipMask;
+      flipByte = -1;
+      if (nextCounter >= 0) {
+        setChannel(0, nextCode, nextCounter);
+        nextCounter = -1;
+      }
+    }
+    return true;
+  }
+
+  int flipByte;       ///< Byte of the next read to damage, -1 for none
+  uint8_t flipMask;   ///< Bits to flip in it
+  int8_t nextCounter; ///< Counter of the channel 0 to store, -1 for none
+  uint32_t nextCode;  ///< ADC code of that channel 0
+};
+
+// Attach registers holding light and start a sensor on them
+static bool start(Adafruit_OPT4048* sensor, OPT4048Registers* regs) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, regs);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  regs->setSample(light, 1);
+  bool ok = sensor->begin();
+  Wire.clearLog();
+  return ok;
+}
+
+// Attach a simulator lit by light, start a sensor on it at time 0
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(light);
+  bool ok = sensor->begin() &&
+            sensor->setConversionTime(OPT4048_CONVERSION_TIME_600US);
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(every_single_bit_flip_fails_the_read) {
+  NoisyRegisters regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t values[4];
+  uint32_t caught = 0;
+  for (int bit = 0; bit < 16 * 8; bit++) {
+    regs.flipByte = bit / 8;
+    regs.flipMask = 1 << (bit % 8);
+    if (!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values)) {
+      caught++;
+    }
+  }
+  CHECK(caught == 16 * 8);
+
+  // The same frame reads fine without the noise
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(values[2] == light[2]);
+}
+
+TEST(crc_retry_rereads_only_the_damaged_channel) {
+  NoisyRegisters regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  sensor.setCRCRetry(2);
+
+  uint32_t values[4];
+  regs.flipByte = 4 * 2 + 1; // A mantissa bit of channel 2
+  regs.flipMask = 0x10;
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == light[ch]);
+  }
+  CHECK(Wire.getTransfers() == 2);
+  CHECK(Wire.getLog()[1].out[0] == OPT4048_REG_CH2_MSB);
+  CHECK(Wire.getLog()[1].in.size() == 4);
+}
+
+TEST(crc_retry_of_channel_0_must_match_the_others) {
+  NoisyRegisters regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  sensor.setCRCRetry(1);
+
+  // The re-read of channel 0 finds the next conversion already stored,
+  // which can't be mixed with channels 1 to 3 of the one before
+  uint32_t values[4];
+  regs.flipByte = 2;
+  regs.flipMask = 0x01;
+  regs.nextCode = other[0];
+  regs.nextCounter = 2;
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(Wire.getLog()[1].in.size() == 4);
+}
+
+TEST(torn_frames_fail_without_a_deadline) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // Without QWAKE, conversion 1 with light and 2 with other
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(sim.wakeUs + 4 * 600);
+  sim.setLight(other);
+
+  // Channels 0 and 1 of conversion 2 are stored, 2 and 3 are not
+  sim.advance(2 * 600 + 100);
+  uint32_t values[4];
+  uint32_t before = micros();
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(micros() == before);
+
+  // The conversion is still new once it is whole
+  sim.advance(2 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == other[ch]);
+  }
+}
+
+TEST(torn_frames_wait_within_the_crc_deadline) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+  sensor.setCRCRetry(0, 2 * 600);
+
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(sim.wakeUs + 4 * 600);
+  sim.setLight(other);
+
+  // Channels 2 and 3 land within the deadline
+  sim.advance(2 * 600 + 100);
+  uint32_t values[4];
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == other[ch]);
+  }
+  CHECK(sim.getConversions() == 2);
+  CHECK(micros() < sim.wakeUs + 3 * 4 * 600);
+
+  // Only the channels asked for are waited for, and never past the deadline
+  sim.setLight(light);
+  sim.advance(600);
+  uint32_t start = micros();
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(micros() == start);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_X | OPT4048_CHANNEL_Y, values));
+  CHECK(values[0] == light[0] && values[1] == light[1]);
+  CHECK(micros() - start == 600);
+}
+
+TEST(torn_frames_stay_new_for_read_if_new) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  uint32_t values[4];
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  sim.setLight(other);
+
+  sim.advance(600 + 100);
+  uint32_t before = micros();
+  CHECK(!sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  CHECK(micros() == before);
+  sim.advance(3 * 600);
+  CHECK(sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == other[ch]);
+  }
+}
+
+TEST(async_one_shot_without_quick_wake_is_never_torn) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // The wake-up delays every conversion past its due time
+  for (int i = 0; i < 4; i++) {
+    sim.setLight(i & 1 ? other : light);
+    CHECK(sensor.startMeasurement());
+    uint32_t started = micros();
+    while (!sensor.ready() && micros() - started < 100000) {
+      sim.advance(50);
+      sensor.poll();
+    }
+    uint32_t values[4];
+    CHECK(sensor.getMeasurement(values));
+    for (int ch = 0; ch < 4; ch++) {
+      CHECK(values[ch] == (i & 1 ? other : light)[ch]);
+    }
+    CHECK(micros() - started >= sim.wakeUs + 4 * 600);
+  }
+}
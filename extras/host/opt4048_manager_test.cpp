@@ -0,0 +1,155 @@
+/*!
+ * @file opt4048_manager_test.cpp
+ *
+ * Host tests of Adafruit_OPT4048_Manager scheduling sensors on the virtual
+ * OPT4048.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048_Manager.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+
+/**
+ * @brief Virtual OPT4048 that can be told to NACK register writes
+ *
+ * Writes of just the register pointer, as before a read, still succeed.
+ */
+class FlakySimulator : public OPT4048Simulator {
+ public:
+  FlakySimulator() : failWrites(0) {}
+
+  bool write(const uint8_t* data, size_t len) override {
+    if (failWrites && len > 1) {
+      failWrites--;
+      return false;
+    }
+    return OPT4048Simulator::write(data, len);
+  }
+
+  uint32_t failWrites; ///< Register writes left to NACK
+};
+
+// Start a one-shot sensor with quick wake on sim at addr, at time 0
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                  uint8_t addr) {
+  mock_setMicros(0);
+  Wire.attach(addr, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(light);
+  return sensor->begin(addr) &&
+         sensor->setConversionTime(OPT4048_CONVERSION_TIME_600US) &&
+         sensor->setQuickWake(true) && sensor->setMode(OPT4048_MODE_ONESHOT);
+}
+
+// Run the manager for a while, return the samples it reported
+static uint32_t run(Adafruit_OPT4048_Manager* manager, uint32_t us) {
+  uint32_t samples = 0;
+  for (uint32_t t = 0; t < us; t += 50) {
+    mock_advanceMicros(50);
+    samples += manager->update();
+  }
+  return samples;
+}
+
+TEST(manager_takes_the_bus_from_the_sensor) {
+  Adafruit_OPT4048_Manager manager;
+  Adafruit_OPT4048 idle;
+  CHECK(!manager.add(&idle));
+  CHECK(manager.getSensorCount() == 0);
+
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_DEFAULT_ADDR));
+  CHECK(sensor.getWire() == &Wire);
+  CHECK(manager.add(&sensor));
+  CHECK(manager.begin());
+  Wire.setClock(400000);
+  CHECK(run(&manager, 100000) > 30);
+  CHECK(manager.getBusUtilization(&Wire) > 0);
+  CHECK(manager.getBusUtilization(&Wire1) == 0);
+}
+
+TEST(manager_staggers_sensors_on_one_bus) {
+  OPT4048Simulator sim0, sim1;
+  Adafruit_OPT4048 sensor0, sensor1;
+  CHECK(start(&sensor0, &sim0, OPT4048_DEFAULT_ADDR));
+  CHECK(start(&sensor1, &sim1, OPT4048_DEFAULT_ADDR + 1));
+
+  Adafruit_OPT4048_Manager manager;
+  CHECK(manager.add(&sensor0));
+  CHECK(manager.add(&sensor1));
+  CHECK(manager.begin());
+  run(&manager, 100000);
+
+  // Half a measurement apart, each converting back to back
+  uint32_t t0 = sim0.getLastConversion(), t1 = sim1.getLastConversion();
+  uint32_t apart = t0 > t1 ? t0 - t1 : t1 - t0;
+  CHECK(apart % (4 * 600) >= 4 * 600 / 2 - 100);
+  CHECK(apart % (4 * 600) <= 4 * 600 / 2 + 100);
+  CHECK(sim0.getConversions() > 30 && sim1.getConversions() > 30);
+  Wire.detach(OPT4048_DEFAULT_ADDR + 1);
+}
+
+TEST(manager_retries_a_failed_one_shot_restart) {
+  FlakySimulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_DEFAULT_ADDR));
+
+  Adafruit_OPT4048_Manager manager;
+  CHECK(manager.add(&sensor));
+  CHECK(manager.begin());
+  CHECK(run(&manager, 10000) > 0);
+
+  // The write that retriggers the next conversion is NACKed
+  sim.failWrites = 1;
+  run(&manager, 10000);
+  CHECK(sim.failWrites == 0);
+  uint32_t conversions = sim.getConversions();
+  CHECK(run(&manager, 10000) > 0);
+  CHECK(sim.getConversions() > conversions);
+}
+
+// Conversions per second of a sensor run alone by a manager at 400 kHz
+static float soloRate(opt4048_conversion_time_t convTime) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_DEFAULT_ADDR));
+  CHECK(sensor.setConversionTime(convTime));
+  Adafruit_OPT4048_Manager manager;
+  CHECK(manager.add(&sensor));
+  CHECK(manager.begin());
+  Wire.setClock(400000);
+  run(&manager, 1000000);
+  return sim.getConversions() * 1e6f / micros();
+}
+
+TEST(manager_serves_mixed_conversion_times_at_their_own_rates) {
+  float solo0 = soloRate(OPT4048_CONVERSION_TIME_600US);
+  float solo1 = soloRate(OPT4048_CONVERSION_TIME_1MS);
+
+  OPT4048Simulator sim0, sim1;
+  Adafruit_OPT4048 sensor0, sensor1;
+  CHECK(start(&sensor0, &sim0, OPT4048_DEFAULT_ADDR));
+  CHECK(start(&sensor1, &sim1, OPT4048_DEFAULT_ADDR + 1));
+  CHECK(sensor1.setConversionTime(OPT4048_CONVERSION_TIME_1MS));
+
+  // The stagger drifts, so the reads run into each other now and then, but
+  // each costs at most one transaction of waiting
+  Adafruit_OPT4048_Manager manager;
+  CHECK(manager.add(&sensor0));
+  CHECK(manager.add(&sensor1));
+  CHECK(manager.begin());
+  Wire.setClock(400000);
+  run(&manager, 1000000);
+  float rate0 = sim0.getConversions() * 1e6f / micros();
+  float rate1 = sim1.getConversions() * 1e6f / micros();
+  CHECK(rate0 > 0.9f * solo0);
+  CHECK(rate1 > 0.9f * solo1);
+  Wire.detach(OPT4048_DEFAULT_ADDR + 1);
+}
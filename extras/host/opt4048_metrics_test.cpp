@@ -0,0 +1,155 @@
+/*!
+ * @file opt4048_metrics_test.cpp
+ *
+ * Host tests of getMetrics() and opt4048_calculateMetrics(): reference
+ * whites, and agreement with the separate CIE, lux and CCT conversions.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_mock.h"
+
+static const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+
+// Channels 0 to 2 read straight as X, Y and Z, 1e-4 per code
+static const float identity[4][4] = {
+    {1e-4f, 0, 0, 0}, {0, 1e-4f, 0, 2e-3f}, {0, 0, 1e-4f, 0}, {0, 0, 0, 0}};
+
+// D65 at Y = 10 through the identity calibration
+static const uint32_t d65[4] = {95047, 100000, 108883, 0};
+
+// Attach registers holding codes and start a sensor on them
+static bool start(Adafruit_OPT4048* sensor, OPT4048Registers* regs,
+                  const uint32_t* codes) {
+  Wire.attach(OPT4048_DEFAULT_ADDR, regs);
+  Wire.failNext(0);
+  regs->setSample(codes, 1);
+  bool ok = sensor->begin();
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(metrics_of_d65_are_the_reference_white) {
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(identity, &cal));
+
+  opt4048_metrics_t m;
+  CHECK(opt4048_calculateMetrics(d65, &cal, OPT4048_METRIC_ALL, nullptr, &m));
+  CHECK(m.valid == OPT4048_METRIC_ALL);
+  CHECK_NEAR(m.X, 9.5047, 1e-4);
+  CHECK_NEAR(m.Y, 10, 1e-4);
+  CHECK_NEAR(m.Z, 10.8883, 1e-4);
+  CHECK_NEAR(m.lux, 200, 1e-3);
+  CHECK_NEAR(m.CIEx, 0.31272, 1e-5);
+  CHECK_NEAR(m.CIEy, 0.32903, 1e-5);
+
+  CHECK_NEAR(m.L, 100, 1e-3);
+  CHECK_NEAR(m.a, 0, 1e-3);
+  CHECK_NEAR(m.b, 0, 1e-3);
+  CHECK_NEAR(m.R, 1, 1e-3);
+  CHECK_NEAR(m.G, 1, 1e-3);
+  CHECK_NEAR(m.B, 1, 1e-3);
+  CHECK_NEAR(m.CCT, 6504, 5);
+}
+
+TEST(metrics_are_relative_to_the_white_given) {
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(identity, &cal));
+
+  // D65 at half the luminance of a measured D65 white
+  const uint32_t half[4] = {47524, 50000, 54442, 0};
+  const float white[3] = {9.5047f, 10, 10.8883f};
+  opt4048_metrics_t m;
+  CHECK(opt4048_calculateMetrics(half, &cal, OPT4048_METRIC_LAB, white, &m));
+  CHECK(m.valid == OPT4048_METRIC_LAB);
+  CHECK_NEAR(m.L, 76.07, 0.01);
+  CHECK_NEAR(m.a, 0, 0.01);
+  CHECK_NEAR(m.b, 0, 0.01);
+
+  // The same sample without a white is white at its own luminance
+  CHECK(opt4048_calculateMetrics(half, &cal, OPT4048_METRIC_LAB, nullptr, &m));
+  CHECK_NEAR(m.L, 100, 1e-3);
+}
+
+TEST(metrics_skip_what_the_mask_leaves_out) {
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(identity, &cal));
+
+  opt4048_metrics_t m;
+  m.L = -1;
+  CHECK(opt4048_calculateMetrics(d65, &cal, OPT4048_METRIC_XY, nullptr, &m));
+  CHECK(m.valid == OPT4048_METRIC_XY);
+  CHECK(m.L == -1);
+  CHECK_NEAR(m.Y, 10, 1e-4);
+
+  // X + Y + Z must be positive
+  const uint32_t dark[4] = {0, 0, 0, 0};
+  CHECK(!opt4048_calculateMetrics(dark, &cal, OPT4048_METRIC_ALL, nullptr,
+                                  &m));
+  CHECK(m.valid == 0);
+}
+
+TEST(metrics_read_only_the_channels_they_use) {
+  // Channel 2 has no coefficients, so its code must not matter
+  const float matrix[4][4] = {
+      {1e-4f, 0, 5e-5f, 0}, {0, 1e-4f, 5e-5f, 2e-3f}, {0}, {0}};
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(matrix, &cal));
+  CHECK(cal.xyzChannels == 0x03);
+
+  const uint32_t zeros[4] = {d65[0], d65[1], 0, 0};
+  const uint32_t junk[4] = {d65[0], d65[1], 0xFFFFFFFF, 0xFFFFFFFF};
+  opt4048_metrics_t m, j;
+  CHECK(opt4048_calculateMetrics(zeros, &cal, OPT4048_METRIC_ALL, nullptr,
+                                 &m));
+  CHECK(opt4048_calculateMetrics(junk, &cal, OPT4048_METRIC_ALL, nullptr, &j));
+  CHECK(m.X == j.X && m.Y == j.Y && m.Z == j.Z && m.lux == j.lux);
+  CHECK(m.CCT == j.CCT && m.L == j.L && m.R == j.R);
+}
+
+TEST(get_metrics_matches_the_separate_conversions) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs, sample));
+
+  // One 12 byte read of channels 0 to 2
+  opt4048_metrics_t m;
+  CHECK(sensor.getMetrics(&m));
+  CHECK(m.valid == OPT4048_METRIC_ALL);
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].in.size() == 12);
+
+  float x, y, lux;
+  CHECK(sensor.getCIE(&x, &y, &lux));
+  CHECK_NEAR(m.CIEx, x, 1e-6);
+  CHECK_NEAR(m.CIEy, y, 1e-6);
+  CHECK_NEAR(m.lux, lux, lux * 1e-6);
+
+  double dlux;
+  CHECK(sensor.getLux(&dlux));
+  CHECK_NEAR(m.lux, dlux, dlux * 1e-6);
+
+  float cct, duv;
+  CHECK(opt4048_calculateCCT(x, y, &cct, &duv));
+  CHECK_NEAR(m.CCT, cct, 0.5);
+  CHECK_NEAR(m.Duv, duv, 1e-5);
+}
+
+TEST(get_metrics_uses_the_sensor_calibration) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs, d65));
+  CHECK(sensor.setCalibration(identity));
+
+  opt4048_metrics_t m;
+  CHECK(sensor.getMetrics(&m, OPT4048_METRIC_XY | OPT4048_METRIC_CCT));
+  CHECK(m.valid == (OPT4048_METRIC_XY | OPT4048_METRIC_CCT));
+  CHECK_NEAR(m.CIEx, 0.31272, 1e-5);
+  CHECK_NEAR(m.CCT, 6504, 5);
+
+  Adafruit_OPT4048 idle;
+  CHECK(!idle.getMetrics(&m));
+}
@@ -0,0 +1,127 @@
+/*!
+ * @file opt4048_mock.cpp
+ *
+ * Canned OPT4048 register file for host tests.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "opt4048_mock.h"
+
+#include "Adafruit_OPT4048.h"
+
+OPT4048Registers::OPT4048Registers() {
+  reset();
+}
+
+/**
+ * @brief Load the power-on register values and clear the write counts
+ */
+void OPT4048Registers::reset(void) {
+  memset(regs, 0, sizeof(regs));
+  memset(_writes, 0, sizeof(_writes));
+  regs[OPT4048_REG_THRESHOLD_HIGH] = 0xBFFF;
+  regs[OPT4048_REG_CONFIG] = 0x3208;
+  regs[OPT4048_REG_THRESHOLD_CFG] = 0x8011;
+  regs[OPT4048_REG_DEVICE_ID] = 0x0821;
+  pointer = 0;
+}
+
+/**
+ * @brief Store one channel as the device would, with a valid CRC
+ *
+ * @param ch Channel 0-3
+ * @param code ADC code, rounded down to what the register format can hold
+ * @param counter 4-bit sample counter
+ */
+void OPT4048Registers::setChannel(uint8_t ch, uint32_t code, uint8_t counter) {
+  uint8_t buf[4];
+  opt4048_encodeChannel(code, counter, buf);
+  regs[ch * 2] = (uint16_t)(buf[0] << 8 | buf[1]);
+  regs[ch * 2 + 1] = (uint16_t)(buf[2] << 8 | buf[3]);
+}
+
+/**
+ * @brief Store all four channels of one conversion
+ *
+ * @param codes ADC codes of channels 0-3
+ * @param counter 4-bit sample counter shared by the channels
+ */
+void OPT4048Registers::setSample(const uint32_t* codes, uint8_t counter) {
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    setChannel(ch, codes[ch], counter);
+  }
+}
+
+/**
+ * @brief Number of times the controller wrote a register
+ *
+ * @param reg Register address
+ * @return Write count since reset()
+ */
+uint32_t OPT4048Registers::getWrites(uint8_t reg) {
+  return reg < OPT4048_MOCK_REGISTERS ? _writes[reg] : 0;
+}
+
+/**
+ * @brief Set the pointer and store any words that follow it
+ *
+ * @param data Register address, then MSB first words
+ * @param len Number of bytes, 0 for an address probe
+ * @return true, the device ACKs every write
+ */
+bool OPT4048Registers::write(const uint8_t* data, size_t len) {
+  if (!len) {
+    return true;
+  }
+  pointer = data[0];
+  for (size_t i = 1; i + 1 < len; i += 2) {
+    if (pointer >= OPT4048_REG_THRESHOLD_LOW &&
+        pointer <= OPT4048_REG_THRESHOLD_CFG) {
+      regs[pointer] = (uint16_t)(data[i] << 8 | data[i + 1]);
+      _writes[pointer]++;
+      registerWritten(pointer);
+    }
+    pointer++;
+  }
+  return true;
+}
+
+/**
+ * @brief Return words from the pointer on
+ *
+ * @param data Buffer for the bytes
+ * @param len Number of bytes
+ * @return true, the device ACKs every read
+ */
+bool OPT4048Registers::read(uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i += 2) {
+    uint16_t value = pointer < OPT4048_MOCK_REGISTERS ? regs[pointer] : 0;
+    data[i] = value >> 8;
+    if (i + 1 < len) {
+      data[i + 1] = value & 0xFF;
+    }
+    registerRead(pointer);
+    pointer++;
+  }
+  return true;
+}
+
+/**
+ * @brief Called after the controller writes a register
+ *
+ * @param reg Register address
+ */
+void OPT4048Registers::registerWritten(uint8_t reg) {
+  (void)reg;
+}
+
+/**
+ * @brief Called after a register was returned to the controller
+ *
+ * @param reg Register address
+ */
+void OPT4048Registers::registerRead(uint8_t reg) {
+  (void)reg;
+}
@@ -0,0 +1,50 @@
+/*!
+ * @file opt4048_mock.h
+ *
+ * Canned OPT4048 register file for host tests. Registers hold whatever the
+ * test puts in them; nothing changes on its own. See opt4048_sim.h for a
+ * device that converts.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_MOCK_H
+#define OPT4048_HOST_MOCK_H
+
+#include "Wire.h"
+
+#define OPT4048_MOCK_REGISTERS 0x20 //!< Size of the mock register file
+
+/**
+ * @brief OPT4048 register file with an auto-incrementing address pointer
+ *
+ * A write sets the pointer from its first byte and stores any following
+ * byte pairs MSB first, advancing the pointer after each word. A read
+ * returns words from the pointer on, also advancing it. Only 0x08 to 0x0B
+ * are writable, as on the device.
+ */
+class OPT4048Registers : public MockDevice {
+ public:
+  OPT4048Registers();
+
+  void reset(void);
+  void setChannel(uint8_t ch, uint32_t code, uint8_t counter);
+  void setSample(const uint32_t* codes, uint8_t counter);
+  uint32_t getWrites(uint8_t reg);
+
+  bool write(const uint8_t* data, size_t len) override;
+  bool read(uint8_t* data, size_t len) override;
+
+  uint16_t regs[OPT4048_MOCK_REGISTERS]; ///< Register contents
+  uint8_t pointer;                       ///< Register address pointer
+
+ protected:
+  virtual void registerWritten(uint8_t reg);
+  virtual void registerRead(uint8_t reg);
+
+ private:
+  uint32_t _writes[OPT4048_MOCK_REGISTERS]; ///< Writes per register
+};
+
+#endif // OPT4048_HOST_MOCK_H
@@ -0,0 +1,163 @@
+/*!
+ * @file opt4048_resume_test.cpp
+ *
+ * Host tests of suspend() and resume() on the virtual OPT4048, across a
+ * simulated host sleep with a fresh driver object on wake.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+
+// Attach a simulator lit by light, start a sensor on it at time 0 in mode
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                  opt4048_mode_t mode) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(light);
+  bool ok = sensor->begin() &&
+            sensor->setConversionTime(OPT4048_CONVERSION_TIME_600US) &&
+            sensor->setMode(mode);
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(suspend_saves_the_one_shot_mode_after_its_conversion) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_MODE_ONESHOT));
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(sim.getConversions() == 1);
+  CHECK(((sim.regs[OPT4048_REG_CONFIG] >> 4) & 0x03) ==
+        OPT4048_MODE_POWERDOWN);
+
+  // QWAKE goes on the device in power-down, without a conversion
+  uint16_t words[4];
+  CHECK(sensor.suspend(words));
+  CHECK(((words[2] >> 4) & 0x03) == OPT4048_MODE_ONESHOT);
+  CHECK(words[2] & 0x8000);
+  CHECK(Wire.getTransfers() == 2);
+  CHECK(sim.regs[OPT4048_REG_CONFIG] == (words[2] & ~0x0030));
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(!sim.isConverting());
+  CHECK(sim.getConversions() == 1);
+
+  // Suspending again only reads
+  Wire.clearLog();
+  uint16_t again[4];
+  CHECK(sensor.suspend(again));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(again[2] == words[2] && again[3] == words[3]);
+  CHECK(sensor.getQuickWake());
+}
+
+TEST(suspend_after_get_mode_still_saves_the_one_shot_mode) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_MODE_ONESHOT));
+
+  // Poll for the end of the conversion the documented way
+  uint32_t polls = 0;
+  while (sensor.getMode() != OPT4048_MODE_POWERDOWN && polls++ < 100) {
+    sim.advance(600);
+  }
+  CHECK(sensor.getMode() == OPT4048_MODE_POWERDOWN);
+  CHECK(sim.getConversions() == 1);
+
+  uint16_t words[4];
+  CHECK(sensor.suspend(words));
+  CHECK(((words[2] >> 4) & 0x03) == OPT4048_MODE_ONESHOT);
+  CHECK(words[2] & 0x8000);
+
+  // The resumed sensor converts without the wake-up time
+  Adafruit_OPT4048 woken;
+  CHECK(woken.resume(words));
+  sim.advance(4 * 600);
+  CHECK(sim.getConversions() == 2);
+}
+
+TEST(suspend_leaves_other_modes_alone) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_MODE_CONTINUOUS));
+  uint16_t config = sim.regs[OPT4048_REG_CONFIG];
+
+  uint16_t words[4];
+  CHECK(sensor.suspend(words));
+  CHECK(words[2] == config);
+  CHECK(Wire.getTransfers() == 1);
+
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  sim.advance(sim.wakeUs + 4 * 600);
+  Wire.clearLog();
+  CHECK(sensor.suspend(words, false));
+  CHECK(((words[2] >> 4) & 0x03) == OPT4048_MODE_ONESHOT);
+  CHECK(!(words[2] & 0x8000));
+  CHECK(Wire.getTransfers() == 1);
+}
+
+TEST(resume_converts_at_once_with_quick_wake) {
+  OPT4048Simulator sim;
+  uint16_t words[4];
+  {
+    Adafruit_OPT4048 sensor;
+    CHECK(start(&sensor, &sim, OPT4048_MODE_ONESHOT));
+    sim.advance(sim.wakeUs + 4 * 600);
+    CHECK(sensor.suspend(words));
+  }
+
+  // The host sleeps and comes back with a fresh driver
+  sim.advance(1000000);
+  Wire.clearLog();
+  Adafruit_OPT4048 sensor;
+  CHECK(sensor.resume(words));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].out.size() == 1 + 8);
+  CHECK(sensor.getWire() == &Wire);
+  CHECK(sim.isConverting());
+
+  // QWAKE skips the wake-up time
+  sim.advance(4 * 600);
+  CHECK(sim.getConversions() == 2);
+  uint32_t values[4];
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == light[ch]);
+  }
+}
+
+TEST(resume_moves_to_a_new_address_or_bus) {
+  OPT4048Simulator sim, other;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim, OPT4048_MODE_ONESHOT));
+  uint16_t words[4];
+  CHECK(sensor.suspend(words));
+
+  // Same address, other bus
+  Wire1.attach(OPT4048_DEFAULT_ADDR, &other);
+  Wire1.failNext(0);
+  Wire1.setClock(0);
+  Wire1.clearLog();
+  Wire.clearLog();
+  CHECK(sensor.resume(words, OPT4048_DEFAULT_ADDR, &Wire1));
+  CHECK(sensor.getWire() == &Wire1);
+  CHECK(Wire.getTransfers() == 0);
+  CHECK(Wire1.getTransfers() == 1);
+  CHECK(other.regs[OPT4048_REG_CONFIG] == words[2]);
+
+  // Back on the first bus, then at another address on it
+  CHECK(sensor.resume(words));
+  CHECK(sensor.getWire() == &Wire);
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire1.getTransfers() == 1);
+  CHECK(!sensor.resume(words, OPT4048_DEFAULT_ADDR + 1));
+  CHECK(Wire.getTransfers() == 2);
+  Wire1.detach(OPT4048_DEFAULT_ADDR);
+}
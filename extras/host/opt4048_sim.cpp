@@ -0,0 +1,402 @@
+/*!
+ * @file opt4048_sim.cpp
+ *
+ * Software model of the OPT4048, see opt4048_sim.h.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "opt4048_sim.h"
+
+#include "Adafruit_OPT4048.h"
+
+// Conversion time per channel in microseconds, datasheet page 29
+static const uint32_t conversion_us[12] = {
+    600,   1000,  1800,   3400,   6500,   12700,
+    25000, 50000, 100000, 200000, 400000, 800000};
+
+#define SIM_MANTISSA_MAX 0xFFFFF //!< Largest 20 bit mantissa
+#define SIM_RANGE_MAX 6          //!< Largest fixed range, 144 klux
+
+OPT4048Simulator::OPT4048Simulator() {
+  wakeUs = 500;
+  memset(_level, 0, sizeof(_level));
+  _handler = nullptr;
+  reset();
+}
+
+/**
+ * @brief Power-on reset: reset register values, power-down, counter 0
+ *
+ * Each conversion carries the next counter value, so the first one has 1
+ * and can be told apart from the empty result registers. One aborted after
+ * storing a channel uses up its value too.
+ *
+ * The light level and the interrupt handler are kept.
+ */
+void OPT4048Simulator::reset(void) {
+  OPT4048Registers::reset();
+  _converting = false;
+  _one_shot = false;
+  _start = 0;
+  _channel_us = conversion_us[8];
+  _channel = 0;
+  _range = 0;
+  _counter = 0;
+  _overload = false;
+  _faults = 0;
+  _fault_flag = 0;
+  _conversions = 0;
+  _last_end = 0;
+}
+
+/**
+ * @brief Set the light falling on the sensor
+ *
+ * Takes effect for channels converted from now on.
+ *
+ * @param level ADC code each of the 4 channels would read with an unlimited
+ * range, i.e. mantissa << exponent
+ */
+void OPT4048Simulator::setLight(const uint32_t* level) {
+  update();
+  memcpy(_level, level, sizeof(_level));
+}
+
+/**
+ * @brief Set the function called when the INT pin signals
+ *
+ * Only called while INT_DIR makes the pin an output. Runs through
+ * mock_interrupt(), so it can't preempt a noInterrupts() section.
+ *
+ * @param handler Function to call, or nullptr for none
+ */
+void OPT4048Simulator::setInterruptHandler(void (*handler)(void)) {
+  _handler = handler;
+}
+
+/**
+ * @brief Move the virtual clock forward, processing events on time
+ *
+ * The clock is stepped to each channel completion in turn, so interrupt
+ * handlers see micros() at the moment the pin changed.
+ *
+ * @param us Microseconds to advance
+ */
+void OPT4048Simulator::advance(uint32_t us) {
+  uint32_t target = micros() + us;
+  while (_converting && (int32_t)(target - nextEvent()) >= 0) {
+    mock_setMicros(nextEvent());
+    finishChannel();
+  }
+  mock_setMicros(target);
+}
+
+/**
+ * @brief Process every event up to the current virtual time
+ */
+void OPT4048Simulator::update(void) {
+  uint32_t now = micros();
+  while (_converting && (int32_t)(now - nextEvent()) >= 0) {
+    finishChannel();
+  }
+}
+
+/**
+ * @brief Check whether a conversion is running
+ *
+ * @return true between the start of a conversion and its last channel
+ */
+bool OPT4048Simulator::isConverting(void) {
+  update();
+  return _converting;
+}
+
+/**
+ * @brief Number of conversions completed since reset()
+ *
+ * @return Conversion count
+ */
+uint32_t OPT4048Simulator::getConversions(void) {
+  update();
+  return _conversions;
+}
+
+/**
+ * @brief When the last conversion completed
+ *
+ * @return micros() at its end, 0 if there was none
+ */
+uint32_t OPT4048Simulator::getLastConversion(void) {
+  update();
+  return _last_end;
+}
+
+/**
+ * @brief Conversion time per channel of the current configuration
+ *
+ * @return Time in microseconds
+ */
+uint32_t OPT4048Simulator::getConversionTime(void) {
+  uint8_t convTime = (regs[OPT4048_REG_CONFIG] >> 6) & 0x0F;
+  return conversion_us[convTime > 11 ? 11 : convTime];
+}
+
+/**
+ * @brief Catch up with the virtual clock, then handle a bus write
+ *
+ * @param data Register address, then MSB first words
+ * @param len Number of bytes, 0 for an address probe
+ * @return true, the device ACKs every write
+ */
+bool OPT4048Simulator::write(const uint8_t* data, size_t len) {
+  update();
+  return OPT4048Registers::write(data, len);
+}
+
+/**
+ * @brief Catch up with the virtual clock, then handle a bus read
+ *
+ * Reading the status register clears CONVERSION_READY, and FLAG_H and
+ * FLAG_L in latched mode, after it is returned.
+ *
+ * @param data Buffer for the bytes
+ * @param len Number of bytes
+ * @return true, the device ACKs every read
+ */
+bool OPT4048Simulator::read(uint8_t* data, size_t len) {
+  update();
+  return OPT4048Registers::read(data, len);
+}
+
+/**
+ * @brief React to a register written by the controller
+ *
+ * @param reg Register address
+ */
+void OPT4048Simulator::registerWritten(uint8_t reg) {
+  if (reg != OPT4048_REG_CONFIG) {
+    return;
+  }
+
+  uint8_t mode = (regs[OPT4048_REG_CONFIG] >> 4) & 0x03;
+  if (mode == OPT4048_MODE_POWERDOWN) {
+    abort();
+  } else if (mode == OPT4048_MODE_CONTINUOUS) {
+    if (!_converting) {
+      start(micros(), true);
+    }
+    _one_shot = false;
+  } else {
+    // Any one-shot write starts a fresh conversion
+    bool fromStandby = !_converting;
+    abort();
+    start(micros(), fromStandby);
+  }
+}
+
+/**
+ * @brief Clear the flags that reading the status register clears
+ *
+ * @param reg Register address
+ */
+void OPT4048Simulator::registerRead(uint8_t reg) {
+  if (reg != OPT4048_REG_STATUS) {
+    return;
+  }
+
+  uint16_t clear = OPT4048_FLAG_CONVERSION_READY;
+  if (regs[OPT4048_REG_CONFIG] & 0x0008) {
+    clear |= OPT4048_FLAG_H | OPT4048_FLAG_L;
+  }
+  regs[OPT4048_REG_STATUS] &= ~clear;
+}
+
+/**
+ * @brief Stop the running conversion, if any
+ *
+ * Channels it already stored keep its counter, so that counter is used up
+ * and the next conversion carries the one after it, as if it had finished.
+ */
+void OPT4048Simulator::abort(void) {
+  if (_converting && _channel > 0) {
+    _counter = (_counter + 1) & 0x0F;
+  }
+  _converting = false;
+}
+
+/**
+ * @brief Start a conversion, latching the settings it uses
+ *
+ * @param time micros() of the request
+ * @param fromStandby The sensor was idle and has to wake up first
+ */
+void OPT4048Simulator::start(uint32_t time, bool fromStandby) {
+  uint16_t config = regs[OPT4048_REG_CONFIG];
+  uint8_t mode = (config >> 4) & 0x03;
+  uint8_t range = (config >> 10) & 0x0F;
+
+  _converting = true;
+  _one_shot =
+      mode == OPT4048_MODE_ONESHOT || mode == OPT4048_MODE_AUTO_ONESHOT;
+  _start = time;
+  if (fromStandby && !(config & 0x8000)) {
+    _start += wakeUs;
+  }
+  _channel_us = getConversionTime();
+  _channel = 0;
+  _overload = false;
+
+  if (mode == OPT4048_MODE_AUTO_ONESHOT || range == OPT4048_RANGE_AUTO) {
+    uint32_t brightest = 0;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+      if (_level[ch] > brightest) {
+        brightest = _level[ch];
+      }
+    }
+    _range = 0;
+    while (_range < SIM_RANGE_MAX &&
+           (brightest >> _range) > SIM_MANTISSA_MAX) {
+      _range++;
+    }
+  } else {
+    _range = range > SIM_RANGE_MAX ? SIM_RANGE_MAX : range;
+  }
+}
+
+/**
+ * @brief Store the result of the channel being converted
+ */
+void OPT4048Simulator::finishChannel(void) {
+  uint8_t counter = (_counter + 1) & 0x0F;
+  uint32_t mantissa = _level[_channel] >> _range;
+  if (mantissa > SIM_MANTISSA_MAX) {
+    mantissa = SIM_MANTISSA_MAX;
+    _overload = true;
+  }
+
+  // EXPONENT[15:12] RESULT_MSB[11:0], RESULT_LSB[15:8] COUNTER[7:4] CRC[3:0]
+  uint8_t crc = opt4048_calculateCRC(_range, mantissa, counter);
+  regs[2 * _channel] = (uint16_t)(_range << 12 | mantissa >> 8);
+  regs[2 * _channel + 1] =
+      (uint16_t)((mantissa & 0xFF) << 8 | counter << 4 | crc);
+
+  uint8_t intCfg = (regs[OPT4048_REG_THRESHOLD_CFG] >> 2) & 0x03;
+  if (intCfg == OPT4048_INT_CFG_DATA_READY_NEXT) {
+    raiseInterrupt();
+  }
+  if (++_channel == 4) {
+    finishConversion();
+  }
+}
+
+/**
+ * @brief Update the flags at the end of a conversion and start the next
+ */
+void OPT4048Simulator::finishConversion(void) {
+  uint32_t end = nextEvent() - _channel_us;
+  _counter = (_counter + 1) & 0x0F;
+  _conversions++;
+  _last_end = end;
+
+  uint16_t* status = &regs[OPT4048_REG_STATUS];
+  *status |= OPT4048_FLAG_CONVERSION_READY;
+  if (_overload) {
+    *status |= OPT4048_FLAG_OVERLOAD;
+  } else {
+    *status &= ~OPT4048_FLAG_OVERLOAD;
+  }
+
+  uint8_t ch = (regs[OPT4048_REG_THRESHOLD_CFG] >> 5) & 0x03;
+  uint16_t msb = regs[2 * ch], lsb = regs[2 * ch + 1];
+  compareThresholds(((uint32_t)(msb & 0x0FFF) << 8 | lsb >> 8) << (msb >> 12));
+
+  uint8_t intCfg = (regs[OPT4048_REG_THRESHOLD_CFG] >> 2) & 0x03;
+  if (intCfg == OPT4048_INT_CFG_DATA_READY_ALL) {
+    raiseInterrupt();
+  }
+
+  if (_one_shot) {
+    // The device returns to power-down, and MODE reads back as such
+    regs[OPT4048_REG_CONFIG] &= ~0x0030;
+    _converting = false;
+  } else {
+    start(end, false);
+  }
+}
+
+/**
+ * @brief Count a threshold violation and raise FLAG_H or FLAG_L
+ *
+ * In latched window mode a flag is set once the channel has been outside
+ * the window FAULT_COUNT times in a row, and stays set until the status
+ * register is read; INT is asserted by either flag. In transparent
+ * hysteresis mode FLAG_H is set that many times above the high threshold
+ * and only cleared that many times below the low one, FLAG_L the other way
+ * round, and INT follows FLAG_H, so falling light never asserts it.
+ *
+ * @param code ADC code of the threshold channel
+ */
+void OPT4048Simulator::compareThresholds(uint32_t code) {
+  uint16_t low = regs[OPT4048_REG_THRESHOLD_LOW];
+  uint16_t high = regs[OPT4048_REG_THRESHOLD_HIGH];
+  uint8_t flag = 0;
+  if (code > (uint32_t)(high & 0x0FFF) << (8 + (high >> 12))) {
+    flag = OPT4048_FLAG_H;
+  } else if (code < (uint32_t)(low & 0x0FFF) << (8 + (low >> 12))) {
+    flag = OPT4048_FLAG_L;
+  }
+
+  if (flag != _fault_flag) {
+    _faults = 0;
+    _fault_flag = flag;
+  }
+  if (!flag) {
+    return;
+  }
+
+  // FAULT_COUNT 0-3 means 1, 2, 4 or 8 faults in a row
+  uint8_t needed = 1 << (regs[OPT4048_REG_CONFIG] & 0x03);
+  if (_faults < needed) {
+    _faults++;
+  }
+  if (_faults < needed) {
+    return;
+  }
+
+  // The pin only changes, and the handler only runs, on a new assertion
+  uint16_t* status = &regs[OPT4048_REG_STATUS];
+  uint16_t before = *status;
+  bool asserted;
+  if (regs[OPT4048_REG_CONFIG] & 0x0008) {
+    *status |= flag;
+    asserted = !(before & (OPT4048_FLAG_H | OPT4048_FLAG_L));
+  } else {
+    *status &= ~(OPT4048_FLAG_H | OPT4048_FLAG_L);
+    *status |= flag;
+    asserted = flag == OPT4048_FLAG_H && !(before & OPT4048_FLAG_H);
+  }
+  uint8_t intCfg = (regs[OPT4048_REG_THRESHOLD_CFG] >> 2) & 0x03;
+  if (asserted && intCfg == OPT4048_INT_CFG_SMBUS_ALERT) {
+    raiseInterrupt();
+  }
+}
+
+/**
+ * @brief Signal on the INT pin, if it is an output
+ */
+void OPT4048Simulator::raiseInterrupt(void) {
+  if (_handler && (regs[OPT4048_REG_THRESHOLD_CFG] & 0x0010)) {
+    mock_interrupt(_handler);
+  }
+}
+
+/**
+ * @brief When the channel being converted will be done
+ *
+ * @return micros() of the event
+ */
+uint32_t OPT4048Simulator::nextEvent(void) {
+  return _start + (_channel + 1) * _channel_us;
+}
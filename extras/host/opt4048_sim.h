@@ -0,0 +1,99 @@
+/*!
+ * @file opt4048_sim.h
+ *
+ * Software model of the OPT4048 for driving the real driver on the host at
+ * simulated kHz rates, without a breakout board.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#ifndef OPT4048_HOST_SIM_H
+#define OPT4048_HOST_SIM_H
+
+#include "opt4048_mock.h"
+
+/**
+ * @brief Virtual OPT4048 that converts on the virtual clock
+ *
+ * Built on the register file of OPT4048Registers, it models:
+ *
+ * - Operating modes. Writing a one-shot MODE starts a conversion, even if
+ *   MODE is unchanged, and MODE reads back as power-down once it is done.
+ *   Continuous mode converts back to back, power-down aborts a conversion.
+ *   Leaving power-down takes wakeUs unless QWAKE is set.
+ * - The sample counter, which advances once per conversion, including one
+ *   that was aborted after it stored a channel.
+ * - Conversion timing. Channels 0 to 3 are converted in turn, each taking
+ *   the CONVERSION_TIME, and each channel's registers change when that
+ *   channel is done, so a read can see two different conversions, as on
+ *   the device. Settings are latched when a conversion starts.
+ * - Ranges. A fixed RANGE saturates the mantissa and sets the overload
+ *   flag; auto-range, and the forced auto-range one-shot mode, pick the
+ *   smallest range that holds the brightest channel.
+ * - Result frames with EXPONENT = range, a 20 bit mantissa, the 4-bit
+ *   counter of the conversion and a valid CRC.
+ * - Status flags: CONVERSION_READY after each conversion, FLAG_H and FLAG_L
+ *   after FAULT_COUNT consecutive threshold violations of the selected
+ *   channel. Latched mode compares against a window and keeps the flags
+ *   until 0x0C is read; transparent mode is a hysteresis on FLAG_H. Reading
+ *   0x0C clears CONVERSION_READY, and FLAG_H and FLAG_L in latched mode.
+ * - The INT pin as an output, reported through an interrupt handler for
+ *   each of the three INT_CFG mechanisms.
+ *
+ * Not modeled: the reduced resolution of the short conversion times, noise,
+ * I2C burst mode being switched off, and INT as a trigger input.
+ *
+ * Events are processed lazily on the next bus access, or on time by
+ * advance(), which is needed for the interrupt handler to see the virtual
+ * clock at the moment the pin changed.
+ */
+class OPT4048Simulator : public OPT4048Registers {
+ public:
+  OPT4048Simulator();
+
+  void reset(void);
+  void setLight(const uint32_t* level);
+  void setInterruptHandler(void (*handler)(void));
+  void advance(uint32_t us);
+  void update(void);
+  bool isConverting(void);
+  uint32_t getConversions(void);
+  uint32_t getLastConversion(void);
+  uint32_t getConversionTime(void);
+
+  bool write(const uint8_t* data, size_t len) override;
+  bool read(uint8_t* data, size_t len) override;
+
+  uint32_t wakeUs; ///< Start delay from power-down without QWAKE
+
+ protected:
+  void registerWritten(uint8_t reg) override;
+  void registerRead(uint8_t reg) override;
+
+ private:
+  void abort(void);
+  void start(uint32_t time, bool fromStandby);
+  void finishChannel(void);
+  void finishConversion(void);
+  void compareThresholds(uint32_t code);
+  void raiseInterrupt(void);
+  uint32_t nextEvent(void);
+
+  uint32_t _level[4];     ///< Light per channel as ADC codes
+  void (*_handler)(void); ///< INT handler, nullptr for none
+  bool _converting;       ///< A conversion is running
+  bool _one_shot;         ///< It was started by a one-shot MODE
+  uint32_t _start;        ///< micros() when channel 0 started
+  uint32_t _channel_us;   ///< Conversion time per channel
+  uint8_t _channel;       ///< Channel being converted
+  uint8_t _range;         ///< Range of the running conversion
+  uint8_t _counter;       ///< Counter of the last finished or aborted one
+  bool _overload;         ///< A channel saturated in this conversion
+  uint8_t _faults;        ///< Consecutive threshold violations
+  uint8_t _fault_flag;    ///< FLAG_H or FLAG_L being counted
+  uint32_t _conversions;  ///< Conversions completed since reset()
+  uint32_t _last_end;     ///< micros() when the last one completed
+};
+
+#endif // OPT4048_HOST_SIM_H
@@ -0,0 +1,111 @@
+/*!
+ * @file opt4048_sim_bench.cpp
+ *
+ * End-to-end throughput and latency of the driver against the virtual
+ * OPT4048, for every operating mode. The driver runs unmodified through
+ * startMeasurement() and poll(), polled every step microseconds of virtual
+ * time on a 400 kHz bus, for the given virtual duration.
+ *
+ * Samples/s and latency are in virtual time: latency runs from the end of
+ * the conversion to the poll() that returned it, or in the one-shot modes
+ * from startMeasurement(). Host ns/sample is the wall clock cost of
+ * simulating and decoding one sample.
+ *
+ * Usage: opt4048_sim_bench [convTime 0-11] [seconds] [step us]
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "Adafruit_OPT4048.h"
+#include "opt4048_sim.h"
+
+static const char* mode_names[4] = {"power-down", "auto one-shot", "one-shot",
+                                    "continuous"};
+
+int main(int argc, char** argv) {
+  int convTime = argc > 1 ? atoi(argv[1]) : OPT4048_CONVERSION_TIME_600US;
+  double seconds = argc > 2 ? atof(argv[2]) : 10;
+  uint32_t step = argc > 3 ? atol(argv[3]) : 20;
+  uint32_t duration = (uint32_t)(seconds * 1e6);
+
+  const uint32_t light[4] = {100000, 200000, 50000, 30000};
+  OPT4048Simulator sim;
+  sim.setLight(light);
+  Wire.attach(OPT4048_DEFAULT_ADDR, &sim);
+  Wire.setClock(400000);
+  Wire.setLogging(false);
+
+  printf("conversion time %d, %.1f s virtual, polled every %u us\n\n",
+         convTime, seconds, step);
+  printf("%-14s %10s %10s %10s %8s %8s %10s\n", "mode", "samples/s",
+         "lat mean", "lat max", "missed", "xfers", "host ns");
+
+  for (int mode = OPT4048_MODE_POWERDOWN; mode <= OPT4048_MODE_CONTINUOUS;
+       mode++) {
+    Adafruit_OPT4048 sensor;
+    mock_setMicros(0);
+    sim.reset();
+    if (!sensor.begin() ||
+        !sensor.setConversionTime((opt4048_conversion_time_t)convTime) ||
+        !sensor.setQuickWake(mode != OPT4048_MODE_POWERDOWN &&
+                             mode != OPT4048_MODE_CONTINUOUS) ||
+        !sensor.setMode((opt4048_mode_t)mode)) {
+      fprintf(stderr, "setup failed\n");
+      return 1;
+    }
+    Wire.clearLog();
+
+    uint32_t samples = 0, latency_max = 0;
+    double latency_sum = 0;
+    bool oneShot = mode == OPT4048_MODE_ONESHOT ||
+                   mode == OPT4048_MODE_AUTO_ONESHOT;
+    uint32_t values[4];
+    uint32_t t0 = micros(), started = t0;
+    if (mode == OPT4048_MODE_POWERDOWN) {
+      sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values);
+    } else {
+      sensor.startMeasurement();
+    }
+
+    auto w0 = std::chrono::steady_clock::now();
+    while (micros() - t0 < duration) {
+      sim.advance(step);
+      bool ready;
+      if (mode == OPT4048_MODE_POWERDOWN) {
+        // Nothing converts, so nothing new may ever be reported
+        ready = sensor.readIfNew(OPT4048_CHANNEL_ALL, values);
+      } else {
+        ready = sensor.poll() && sensor.getMeasurement(values);
+      }
+      if (!ready) {
+        continue;
+      }
+      samples++;
+      uint32_t latency =
+          micros() - (oneShot ? started : sim.getLastConversion());
+      latency_sum += latency;
+      if (latency > latency_max) {
+        latency_max = latency;
+      }
+      if (oneShot) {
+        started = micros();
+        sensor.startMeasurement();
+      }
+    }
+    auto w1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(w1 - w0).count();
+
+    printf("%-14s %10.1f %10.1f %10u %8u %8.1f %10.1f\n", mode_names[mode],
+           samples / seconds, samples ? latency_sum / samples : 0.0,
+           latency_max, sensor.getTotalMissedSamples(),
+           samples ? (double)Wire.getTransfers() / samples : 0.0,
+           samples ? ns / samples : 0.0);
+  }
+  return 0;
+}
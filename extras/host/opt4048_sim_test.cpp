@@ -0,0 +1,294 @@
+/*!
+ * @file opt4048_sim_test.cpp
+ *
+ * Host tests of the virtual OPT4048, and of the driver running against it.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+
+static uint32_t int_count;
+static uint32_t int_time;
+
+static void onInt(void) {
+  int_count++;
+  int_time = micros();
+}
+
+// Attach a simulator lit by light, start a sensor on it at time 0
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(light);
+  bool ok = sensor->begin() &&
+            sensor->setConversionTime(OPT4048_CONVERSION_TIME_600US);
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(sim_powers_up_idle) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  sim.advance(100000);
+  CHECK(!sim.isConverting());
+  CHECK(sim.getConversions() == 0);
+  CHECK(sim.regs[OPT4048_REG_CH0_MSB] == 0);
+}
+
+TEST(sim_one_shot_converts_once_and_clears_mode) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  CHECK(sim.isConverting());
+  CHECK(((sim.regs[OPT4048_REG_CONFIG] >> 4) & 0x03) == OPT4048_MODE_ONESHOT);
+
+  // Wake-up plus four channels of 600us
+  sim.advance(sim.wakeUs + 4 * 600 - 1);
+  CHECK(sim.isConverting());
+  sim.advance(1);
+  CHECK(!sim.isConverting());
+  CHECK(sim.getConversions() == 1);
+  CHECK(((sim.regs[OPT4048_REG_CONFIG] >> 4) & 0x03) == 0);
+  CHECK(sensor.resync());
+  CHECK(sensor.getMode() == OPT4048_MODE_POWERDOWN);
+
+  uint32_t values[4];
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  for (int ch = 0; ch < 4; ch++) {
+    CHECK(values[ch] == light[ch]);
+  }
+
+  sim.advance(100000);
+  CHECK(sim.getConversions() == 1);
+}
+
+TEST(sim_quick_wake_skips_the_wake_up) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  sim.advance(4 * 600);
+  CHECK(sim.getConversions() == 1);
+}
+
+TEST(sim_continuous_converts_back_to_back) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(sim.wakeUs + 10 * 4 * 600);
+  CHECK(sim.getConversions() == 10);
+  CHECK(sim.isConverting());
+
+  // Each conversion carries the next counter value
+  uint8_t counter;
+  uint32_t code;
+  uint8_t buf[4] = {
+      (uint8_t)(sim.regs[0] >> 8), (uint8_t)sim.regs[0],
+      (uint8_t)(sim.regs[1] >> 8), (uint8_t)sim.regs[1]};
+  CHECK(opt4048_decodeChannel(buf, &code, &counter));
+  CHECK(counter == 10 && code == light[0]);
+
+  CHECK(sensor.setMode(OPT4048_MODE_POWERDOWN));
+  sim.advance(100000);
+  CHECK(sim.getConversions() == 10);
+}
+
+TEST(sim_channels_update_one_at_a_time) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(4 * 600 + 2 * 600);
+
+  // Channels 0 and 1 are from the second conversion, 2 and 3 the first
+  uint32_t code;
+  uint8_t counter[4];
+  for (int ch = 0; ch < 4; ch++) {
+    uint8_t buf[4] = {
+        (uint8_t)(sim.regs[2 * ch] >> 8), (uint8_t)sim.regs[2 * ch],
+        (uint8_t)(sim.regs[2 * ch + 1] >> 8), (uint8_t)sim.regs[2 * ch + 1]};
+    CHECK(opt4048_decodeChannel(buf, &code, &counter[ch]));
+  }
+  CHECK(counter[0] == 2 && counter[1] == 2);
+  CHECK(counter[2] == 1 && counter[3] == 1);
+}
+
+TEST(sim_ranges_saturate_or_adapt) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // 200000 needs range 0, 5000000 needs range 3
+  const uint32_t bright[4] = {100000, 5000000, 50000, 30000};
+  sim.setLight(bright);
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setRange(OPT4048_RANGE_2K_LUX));
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  sim.advance(4 * 600);
+  uint32_t values[4];
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(values[1] == 0xFFFFF);
+  CHECK(sensor.getFlags() & OPT4048_FLAG_OVERLOAD);
+
+  CHECK(sensor.setMode(OPT4048_MODE_AUTO_ONESHOT));
+  sim.advance(4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sim.regs[OPT4048_REG_CH1_MSB] >> 12 == 3);
+  CHECK(values[1] == (5000000 & ~7u) && values[0] == 100000);
+  CHECK(!(sensor.getFlags() & OPT4048_FLAG_OVERLOAD));
+}
+
+TEST(sim_status_flags_follow_thresholds) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // Channel 0 at 100000 against a window of 120000 to 200000, 2 faults
+  CHECK(sensor.setThresholdLow(120000));
+  CHECK(sensor.setThresholdHigh(200000));
+  CHECK(sensor.setFaultCount(OPT4048_FAULT_COUNT_2));
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+
+  sim.advance(4 * 600);
+  CHECK(sensor.getFlags() == OPT4048_FLAG_CONVERSION_READY);
+  CHECK(sensor.getFlags() == 0);
+
+  // Latched until read, even once the light is back in the window
+  sim.advance(4 * 600);
+  CHECK(sim.regs[OPT4048_REG_STATUS] & OPT4048_FLAG_L);
+  const uint32_t inside[4] = {150000, 200000, 50000, 30000};
+  sim.setLight(inside);
+  sim.advance(2 * 4 * 600);
+  CHECK(sensor.getFlags() ==
+        (OPT4048_FLAG_CONVERSION_READY | OPT4048_FLAG_L));
+  CHECK(sensor.getFlags() == 0);
+}
+
+TEST(sim_interrupt_fires_when_data_is_ready) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+  int_count = 0;
+  sim.setInterruptHandler(onInt);
+
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(3 * 4 * 600 + 100);
+  CHECK(int_count == 3);
+  CHECK(int_time == 3 * 4 * 600);
+
+  CHECK(sensor.setInterruptConfig(OPT4048_INT_CFG_DATA_READY_NEXT));
+  int_count = 0;
+  sim.advance(4 * 600);
+  CHECK(int_count == 4);
+
+  // Not while INT is an input
+  CHECK(sensor.setInterruptDirection(false));
+  int_count = 0;
+  sim.advance(4 * 600);
+  CHECK(int_count == 0);
+  sim.setInterruptHandler(nullptr);
+}
+
+TEST(sim_drives_async_measurements) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(sensor.setQuickWake(true));
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  sim.advance(100000);
+  CHECK(sensor.startMeasurement());
+  uint32_t started = micros();
+  while (!sensor.ready() && micros() - started < 100000) {
+    sim.advance(50);
+    sensor.poll();
+  }
+  uint32_t values[4];
+  CHECK(sensor.getMeasurement(values));
+  CHECK(values[2] == light[2]);
+  CHECK(sim.getConversions() == 2);
+  CHECK(micros() - started == 4 * 600);
+}
+
+TEST(async_measurements_keep_the_one_shot_mode_that_was_set) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // getMode() sees power-down once the first conversion is done
+  CHECK(sensor.setMode(OPT4048_MODE_ONESHOT));
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(sensor.getMode() == OPT4048_MODE_POWERDOWN);
+
+  // The fixed range one-shot mode is restarted, not the auto-range one
+  CHECK(sensor.startMeasurement());
+  CHECK(((sim.regs[OPT4048_REG_CONFIG] >> 4) & 0x03) == OPT4048_MODE_ONESHOT);
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(sensor.poll());
+
+  // A sensor that was powered down gets the forced auto-range one
+  CHECK(sensor.setMode(OPT4048_MODE_POWERDOWN));
+  CHECK(sensor.startMeasurement());
+  CHECK(((sim.regs[OPT4048_REG_CONFIG] >> 4) & 0x03) ==
+        OPT4048_MODE_AUTO_ONESHOT);
+}
+
+TEST(reads_count_the_conversions_they_skip) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  // Continuous conversions end every 4 * 600 us after the wake-up
+  uint32_t values[4];
+  CHECK(sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  sim.advance(sim.wakeUs + 4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+
+  // Two conversions go unread
+  sim.advance(3 * 4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_MISSED);
+  CHECK(sensor.getMissedSamples() == 2);
+  CHECK(sensor.getTotalMissedSamples() == 2);
+
+  // Reading again too soon misses nothing
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_DUPLICATE);
+  CHECK(sensor.getMissedSamples() == 0);
+  sim.advance(4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  CHECK(sensor.getMissedSamples() == 0);
+
+  // Gaps across the wrap of the 4-bit counter, counted modulo 16
+  sim.advance(15 * 4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getMissedSamples() == 14);
+  CHECK(sensor.getTotalMissedSamples() == 16);
+  sim.advance(17 * 4 * 600);
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  CHECK(sensor.getTotalMissedSamples() == 16);
+  CHECK(sim.getConversions() == 1 + 3 + 1 + 15 + 17);
+}
@@ -0,0 +1,279 @@
+/*!
+ * @file opt4048_stream_test.cpp
+ *
+ * Host tests of the binary stream framing: which frames the encoder picks
+ * and what it puts in them, and how the decoder recovers from garbage,
+ * damaged frames and lost frames.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <vector>
+
+#include "Adafruit_OPT4048_Stream.h"
+#include "host_test.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+
+// Little endian 16 bit value in a frame
+static uint16_t u16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+// Check the header and CRC of a frame of the given type and size
+static bool validFrame(const uint8_t* frame, size_t len, uint8_t type,
+                       uint8_t seq) {
+  return frame[0] == OPT4048_STREAM_SYNC0 &&
+         frame[1] == OPT4048_STREAM_SYNC1 && frame[2] == type &&
+         frame[3] == seq &&
+         u16(&frame[len - 2]) == opt4048_streamCRC(&frame[2], len - 4);
+}
+
+// Encode count raw frames of a slowly rising signal, one per entry
+static std::vector<Bytes> rawFrames(uint8_t count, bool delta,
+                                    uint8_t keyInterval) {
+  Adafruit_OPT4048_StreamEncoder encoder;
+  encoder.setDelta(delta, keyInterval);
+  std::vector<Bytes> frames;
+  for (uint8_t i = 0; i < count; i++) {
+    const uint32_t values[4] = {sample[0], sample[1] + 100u * i, sample[2],
+                                sample[3]};
+    uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+    size_t len = encoder.encodeRaw(values, 2400 * i, frame);
+    frames.push_back(Bytes(frame, frame + len));
+  }
+  return frames;
+}
+
+// Feed bytes to a decoder and collect the samples it produces
+static std::vector<opt4048_stream_sample_t>
+decodeAll(Adafruit_OPT4048_StreamDecoder* decoder, const Bytes& bytes) {
+  std::vector<opt4048_stream_sample_t> samples;
+  for (size_t i = 0; i < bytes.size(); i++) {
+    opt4048_stream_sample_t s;
+    if (decoder->push(bytes[i], &s)) {
+      samples.push_back(s);
+    }
+  }
+  return samples;
+}
+
+// Check that a sample is frame i of rawFrames()
+static bool isFrame(const opt4048_stream_sample_t& s, uint8_t i) {
+  return s.seq == i && s.timestamp == 2400u * i && s.values[0] == sample[0] &&
+         s.values[1] == sample[1] + 100u * i && s.values[3] == sample[3];
+}
+
+TEST(stream_crc_is_ccitt_false) {
+  // The standard check value over "123456789"
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  CHECK(opt4048_streamCRC(check, sizeof(check)) == 0x29B1);
+}
+
+TEST(stream_packs_codes_like_the_sensor) {
+  CHECK(opt4048_packCode(0xFFFFF) == 0x0FFFFF);
+  CHECK(opt4048_packCode(0x100000) == 0x180000);
+  CHECK(opt4048_packCode(0xFFFFF << 6) == 0x6FFFFF);
+  for (uint8_t exp = 0; exp <= 6; exp++) {
+    uint32_t code = 0xABCDE << exp;
+    CHECK(opt4048_unpackCode(opt4048_packCode(code)) == code);
+  }
+}
+
+TEST(stream_sends_key_frames_by_default) {
+  Adafruit_OPT4048_StreamEncoder encoder;
+  uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+  for (uint8_t i = 0; i < 3; i++) {
+    CHECK(encoder.encodeRaw(sample, 1000 * i, frame) == 22);
+    CHECK(validFrame(frame, 22, OPT4048_STREAM_RAW, i));
+  }
+
+  // u32 time, then each channel as 3 packed bytes
+  CHECK(u16(&frame[4]) == 2000 && u16(&frame[6]) == 0);
+  uint32_t packed = frame[8] | (frame[9] << 8) | ((uint32_t)frame[10] << 16);
+  CHECK(packed == opt4048_packCode(sample[0]));
+
+  CHECK(encoder.encodeFixed(0x5000, 0x5400, 123456, 3000, frame) == 18);
+  CHECK(validFrame(frame, 18, OPT4048_STREAM_FIXED, 3));
+  CHECK(u16(&frame[8]) == 0x5000 && u16(&frame[10]) == 0x5400);
+}
+
+TEST(stream_sends_deltas_between_key_frames) {
+  Adafruit_OPT4048_StreamEncoder encoder;
+  encoder.setDelta(true, 3);
+  uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+  uint32_t values[4] = {sample[0], sample[1], sample[2], sample[3]};
+
+  // One key frame, then 3 deltas at most, then a key frame again
+  const uint8_t types[8] = {OPT4048_STREAM_RAW,       OPT4048_STREAM_RAW_DELTA,
+                            OPT4048_STREAM_RAW_DELTA, OPT4048_STREAM_RAW_DELTA,
+                            OPT4048_STREAM_RAW,       OPT4048_STREAM_RAW_DELTA,
+                            OPT4048_STREAM_RAW_DELTA, OPT4048_STREAM_RAW_DELTA};
+  for (uint8_t i = 0; i < 8; i++) {
+    values[1] += 100;
+    size_t len = encoder.encodeRaw(values, 2400 * i, frame);
+    CHECK(len == (types[i] == OPT4048_STREAM_RAW ? 22u : 16u));
+    CHECK(validFrame(frame, len, types[i], i));
+  }
+
+  // u16 time step, then the signed change of each packed channel
+  values[0] -= 5;
+  CHECK(encoder.encodeRaw(values, 2400 * 8 + 7, frame) == 22);
+  values[0] -= 5;
+  CHECK(encoder.encodeRaw(values, 2400 * 9 + 7, frame) == 16);
+  CHECK(u16(&frame[4]) == 2400);
+  CHECK((int16_t)u16(&frame[6]) == -5);
+  CHECK(u16(&frame[8]) == 0 && u16(&frame[10]) == 0);
+}
+
+TEST(stream_falls_back_to_key_frames_when_a_delta_overflows) {
+  Adafruit_OPT4048_StreamEncoder encoder;
+  encoder.setDelta(true, 100);
+  uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+  uint32_t values[4] = {sample[0], sample[1], sample[2], sample[3]};
+  uint32_t t = 0;
+  CHECK(encoder.encodeRaw(values, t, frame) == 22);
+
+  // The largest changes that fit in 16 bits, either way
+  values[2] += 32767;
+  CHECK(encoder.encodeRaw(values, t += 0xFFFF, frame) == 16);
+  values[2] -= 32768;
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 16);
+
+  // One more, a time step past 16 bits, or a new exponent don't
+  values[2] += 32768;
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  CHECK(encoder.encodeRaw(values, t += 0x10000, frame) == 22);
+  values[3] = 0xFFFFF;
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  values[3] = 0x100000;
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 16);
+
+  // Turning deltas off, or on again, starts over with a key frame
+  encoder.setDelta(false);
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  encoder.setDelta(true);
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 22);
+  CHECK(encoder.encodeRaw(values, t += 1, frame) == 16);
+}
+
+TEST(stream_decodes_what_it_encodes) {
+  std::vector<Bytes> frames = rawFrames(40, true, 16);
+  Bytes stream;
+  for (size_t i = 0; i < frames.size(); i++) {
+    stream.insert(stream.end(), frames[i].begin(), frames[i].end());
+  }
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  std::vector<opt4048_stream_sample_t> samples = decodeAll(&decoder, stream);
+  CHECK(samples.size() == 40);
+  for (uint8_t i = 0; i < samples.size(); i++) {
+    CHECK(isFrame(samples[i], i));
+  }
+  CHECK(samples[0].type == OPT4048_STREAM_RAW);
+  CHECK(samples[1].type == OPT4048_STREAM_RAW_DELTA);
+  CHECK(decoder.getSkippedBytes() == 0 && decoder.getCRCErrors() == 0);
+  CHECK(decoder.getLostFrames() == 0 && decoder.getUndecodableFrames() == 0);
+}
+
+TEST(stream_resyncs_after_garbage) {
+  std::vector<Bytes> frames = rawFrames(2, false, 16);
+
+  // Text, a lone sync byte, and both sync bytes before an unknown type
+  Bytes stream = {'h', 'i', '\n', OPT4048_STREAM_SYNC0, 0x00,
+                  OPT4048_STREAM_SYNC0, OPT4048_STREAM_SYNC1, 0x7F};
+  stream.insert(stream.end(), frames[0].begin(), frames[0].end());
+  stream.push_back(OPT4048_STREAM_SYNC0);
+  stream.insert(stream.end(), frames[1].begin(), frames[1].end());
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  std::vector<opt4048_stream_sample_t> samples = decodeAll(&decoder, stream);
+  CHECK(samples.size() == 2);
+  CHECK(isFrame(samples[0], 0) && isFrame(samples[1], 1));
+  CHECK(decoder.getSkippedBytes() == 9);
+  CHECK(decoder.getCRCErrors() == 0 && decoder.getLostFrames() == 0);
+}
+
+TEST(stream_rescans_a_frame_that_fails_the_crc) {
+  std::vector<Bytes> frames = rawFrames(3, false, 16);
+
+  // A header that swallows the start of the real frame behind it
+  Bytes stream = {OPT4048_STREAM_SYNC0, OPT4048_STREAM_SYNC1,
+                  OPT4048_STREAM_RAW, 0x00};
+  stream.insert(stream.end(), frames[0].begin(), frames[0].end());
+
+  // A damaged frame, then one that must still be found
+  frames[1][10] ^= 0x10;
+  stream.insert(stream.end(), frames[1].begin(), frames[1].end());
+  stream.insert(stream.end(), frames[2].begin(), frames[2].end());
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  std::vector<opt4048_stream_sample_t> samples = decodeAll(&decoder, stream);
+  CHECK(samples.size() == 2);
+  CHECK(isFrame(samples[0], 0) && isFrame(samples[1], 2));
+  CHECK(decoder.getCRCErrors() == 2);
+  CHECK(decoder.getSkippedBytes() == 4 + frames[1].size());
+  CHECK(decoder.getLostFrames() == 1);
+}
+
+TEST(stream_counts_sequence_gaps) {
+  std::vector<Bytes> frames = rawFrames(255, false, 16);
+  Bytes stream;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (i != 3 && (i < 10 || i > 12)) {
+      stream.insert(stream.end(), frames[i].begin(), frames[i].end());
+    }
+  }
+
+  // The sequence number wraps without a gap
+  Adafruit_OPT4048_StreamEncoder encoder;
+  uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+  for (int i = 0; i < 256; i++) {
+    size_t len = encoder.encodeRaw(sample, 0, frame);
+    if (i == 255) {
+      stream.insert(stream.end(), frame, frame + len);
+    }
+  }
+  size_t len = encoder.encodeRaw(sample, 0, frame);
+  stream.insert(stream.end(), frame, frame + len);
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  std::vector<opt4048_stream_sample_t> samples = decodeAll(&decoder, stream);
+  CHECK(samples.size() == 253);
+  CHECK(isFrame(samples[3], 4) && isFrame(samples[9], 13));
+  CHECK(samples[251].seq == 255 && samples[252].seq == 0);
+  CHECK(decoder.getLostFrames() == 4);
+  CHECK(decoder.getSkippedBytes() == 0 && decoder.getCRCErrors() == 0);
+}
+
+TEST(stream_waits_for_a_key_frame_after_a_broken_delta_chain) {
+  // Key frames at 0, 5 and 10, deltas in between
+  std::vector<Bytes> frames = rawFrames(12, true, 4);
+  Bytes stream;
+  for (size_t i = 2; i < frames.size(); i++) {
+    if (i != 7) {
+      stream.insert(stream.end(), frames[i].begin(), frames[i].end());
+    }
+  }
+
+  // Joining after the key frame, and losing a delta, both leave deltas
+  // with nothing to add to until the next key frame
+  Adafruit_OPT4048_StreamDecoder decoder;
+  std::vector<opt4048_stream_sample_t> samples = decodeAll(&decoder, stream);
+  CHECK(samples.size() == 4);
+  CHECK(isFrame(samples[0], 5) && isFrame(samples[1], 6));
+  CHECK(isFrame(samples[2], 10) && isFrame(samples[3], 11));
+  CHECK(decoder.getUndecodableFrames() == 5);
+  CHECK(decoder.getLostFrames() == 1);
+
+  // reset() forgets the base and the statistics
+  decoder.reset();
+  samples = decodeAll(&decoder, frames[11]);
+  CHECK(samples.empty());
+  CHECK(decoder.getUndecodableFrames() == 1 && decoder.getLostFrames() == 0);
+}
@@ -0,0 +1,417 @@
+/*!
+ * @file opt4048_test.cpp
+ *
+ * Host tests of the driver's bus traffic and decoding against a canned
+ * register file.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "Adafruit_OPT4048_Config.h"
+#include "host_test.h"
+#include "opt4048_mock.h"
+
+static const uint32_t sample[4] = {100000, 200000, 50000, 30000};
+
+// Attach fresh registers holding sample and start a sensor on them
+static bool start(Adafruit_OPT4048* sensor, OPT4048Registers* regs) {
+  Wire.attach(OPT4048_DEFAULT_ADDR, regs);
+  Wire.failNext(0);
+  regs->setSample(sample, 1);
+  bool ok = sensor->begin();
+  Wire.clearLog();
+  return ok;
+}
+
+TEST(begin_checks_id_and_sets_interrupts) {
+  OPT4048Registers regs;
+  Wire.attach(OPT4048_DEFAULT_ADDR, &regs);
+  Wire.clearLog();
+  Adafruit_OPT4048 sensor;
+  CHECK(sensor.begin());
+
+  // Probe, ID, both configuration registers, one burst write
+  const std::vector<MockTransaction>& log = Wire.getLog();
+  CHECK(log.size() == 4);
+  CHECK(log[0].out.empty() && log[0].in.empty());
+  CHECK(log[1].out.size() == 1 && log[1].out[0] == OPT4048_REG_DEVICE_ID);
+  CHECK(log[2].out.size() == 1 && log[2].out[0] == OPT4048_REG_CONFIG);
+  CHECK(log[2].in.size() == 4);
+  CHECK(log[3].out.size() == 5 && log[3].out[0] == OPT4048_REG_CONFIG);
+  CHECK(regs.regs[OPT4048_REG_CONFIG] == 0x320C);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_CFG] == 0x801D);
+
+  // Nothing to write when the device already has the settings
+  Wire.clearLog();
+  CHECK(sensor.begin());
+  CHECK(Wire.getTransfers() == 3);
+}
+
+TEST(begin_fails_without_opt4048) {
+  Adafruit_OPT4048 sensor;
+  Wire.detach(OPT4048_DEFAULT_ADDR);
+  CHECK(!sensor.begin());
+
+  OPT4048Registers regs;
+  regs.regs[OPT4048_REG_DEVICE_ID] = 0x1234;
+  Wire.attach(OPT4048_DEFAULT_ADDR, &regs);
+  CHECK(!sensor.begin());
+  CHECK(!sensor.begin(0x45));
+}
+
+TEST(get_channels_raw_decodes_all_channels) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t ch[4];
+  CHECK(sensor.getChannelsRaw(&ch[0], &ch[1], &ch[2], &ch[3]));
+  for (int i = 0; i < 4; i++) {
+    CHECK(ch[i] == sample[i]);
+  }
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].out[0] == OPT4048_REG_CH0_MSB);
+  CHECK(Wire.getLog()[0].in.size() == 16);
+
+  // A code too wide for the mantissa keeps its top 20 bits
+  regs.setChannel(0, 0x12345678, 1);
+  CHECK(sensor.getChannelsRaw(&ch[0], &ch[1], &ch[2], &ch[3]));
+  CHECK(ch[0] == 0x12345600);
+}
+
+TEST(get_channels_raw_reads_only_the_span_needed) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t values[4] = {0, 0, 0, 0};
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y, values));
+  CHECK(Wire.getLog()[0].out[0] == OPT4048_REG_CH1_MSB);
+  CHECK(Wire.getLog()[0].in.size() == 4);
+  CHECK(values[0] == 0 && values[1] == sample[1] && values[3] == 0);
+
+  Wire.clearLog();
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_Y | OPT4048_CHANNEL_W, values));
+  CHECK(Wire.getLog()[0].in.size() == 12);
+  CHECK(values[2] == 0 && values[3] == sample[3]);
+  CHECK(!sensor.getChannelsRaw(0, values));
+}
+
+TEST(crc_errors_fail_the_read) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t values[4];
+  regs.regs[OPT4048_REG_CH2_LSB] ^= 0x0100; // One mantissa bit
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_X | OPT4048_CHANNEL_Y, values));
+}
+
+TEST(a_sample_that_fails_crc_is_still_new_after) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t values[4];
+  CHECK(sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  regs.setSample(sample, 2);
+  regs.regs[OPT4048_REG_CH2_LSB] ^= 0x0100;
+  CHECK(!sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  regs.regs[OPT4048_REG_CH2_LSB] ^= 0x0100;
+  CHECK(sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  CHECK(!sensor.readIfNew(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_DUPLICATE);
+}
+
+TEST(failed_transfers_fail_the_read) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint32_t values[4];
+  Wire.failNext(1);
+  CHECK(!sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+  CHECK(sensor.getChannelsRaw(OPT4048_CHANNEL_ALL, values));
+}
+
+TEST(setters_write_once_and_getters_use_the_cache) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  CHECK(sensor.setRange(OPT4048_RANGE_9K_LUX));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].out.size() == 3);
+  CHECK(((regs.regs[OPT4048_REG_CONFIG] >> 10) & 0x0F) == 2);
+
+  Wire.clearLog();
+  CHECK(sensor.getRange() == OPT4048_RANGE_9K_LUX);
+  CHECK(sensor.getConversionTime() == OPT4048_CONVERSION_TIME_100MS);
+  CHECK(sensor.getThresholdChannel() == 0);
+  CHECK(Wire.getTransfers() == 0);
+
+  // A setter whose write fails leaves the cache alone
+  Wire.failNext(1);
+  CHECK(!sensor.setMode(OPT4048_MODE_CONTINUOUS));
+  CHECK(sensor.getMode() == OPT4048_MODE_POWERDOWN);
+}
+
+TEST(resync_reloads_the_cache) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  regs.regs[OPT4048_REG_CONFIG] = 0x183C; // 144K, 600us, continuous
+  CHECK(sensor.getRange() == OPT4048_RANGE_AUTO);
+  CHECK(sensor.resync());
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(sensor.getRange() == OPT4048_RANGE_144K_LUX);
+  CHECK(sensor.getMode() == OPT4048_MODE_CONTINUOUS);
+}
+
+TEST(set_config_is_one_burst) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  opt4048_config_t config;
+  CHECK(sensor.getConfig(&config));
+  config.range = OPT4048_RANGE_AUTO;
+  config.mode = OPT4048_MODE_CONTINUOUS;
+  config.thresholdChannel = 3;
+  CHECK(sensor.setConfig(&config));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].out.size() == 5);
+  CHECK(regs.regs[OPT4048_REG_CONFIG] == 0x323C);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_CFG] == 0x807D);
+
+  config.thresholdChannel = 4;
+  CHECK(!sensor.setConfig(&config));
+  CHECK(Wire.getTransfers() == 1);
+}
+
+// Check that setConfig() writes the words a config template encodes
+template <typename CONFIG>
+static bool setConfigWritesTemplate(const opt4048_config_t& config) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  return start(&sensor, &regs) && sensor.setConfig(&config) &&
+         regs.regs[OPT4048_REG_CONFIG] == CONFIG::config &&
+         regs.regs[OPT4048_REG_THRESHOLD_CFG] == CONFIG::thresholdConfig;
+}
+
+TEST(config_template_matches_set_config) {
+  const opt4048_config_t defaults = {OPT4048_RANGE_AUTO,
+                                     OPT4048_CONVERSION_TIME_100MS,
+                                     OPT4048_MODE_CONTINUOUS,
+                                     false,
+                                     true,
+                                     true,
+                                     OPT4048_FAULT_COUNT_1,
+                                     0,
+                                     true,
+                                     OPT4048_INT_CFG_DATA_READY_ALL};
+  CHECK((setConfigWritesTemplate<
+         Adafruit_OPT4048_Config<OPT4048_RANGE_AUTO,
+                                 OPT4048_CONVERSION_TIME_100MS,
+                                 OPT4048_MODE_CONTINUOUS>>(defaults)));
+
+  // Every field away from its default
+  const opt4048_config_t others = {OPT4048_RANGE_9K_LUX,
+                                   OPT4048_CONVERSION_TIME_600US,
+                                   OPT4048_MODE_AUTO_ONESHOT,
+                                   true,
+                                   false,
+                                   false,
+                                   OPT4048_FAULT_COUNT_8,
+                                   3,
+                                   false,
+                                   OPT4048_INT_CFG_SMBUS_ALERT};
+  CHECK((setConfigWritesTemplate<Adafruit_OPT4048_Config<
+             OPT4048_RANGE_9K_LUX, OPT4048_CONVERSION_TIME_600US,
+             OPT4048_MODE_AUTO_ONESHOT, true, false, false,
+             OPT4048_FAULT_COUNT_8, 3, false, OPT4048_INT_CFG_SMBUS_ALERT>>(
+      others)));
+}
+
+TEST(set_config_template_is_one_9_byte_burst) {
+  typedef Adafruit_OPT4048_Config<
+      OPT4048_RANGE_AUTO, OPT4048_CONVERSION_TIME_1MS, OPT4048_MODE_CONTINUOUS,
+      false, true, true, OPT4048_FAULT_COUNT_2, 1, true,
+      OPT4048_INT_CFG_SMBUS_ALERT, 150000, 250000>
+      MyConfig;
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  CHECK(sensor.setConfig<MyConfig>());
+  CHECK(Wire.getTransfers() == 1);
+  const MockTransaction& burst = Wire.getLog()[0];
+  CHECK(burst.out.size() == 9);
+  CHECK(burst.out[0] == OPT4048_REG_THRESHOLD_LOW);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_LOW] == MyConfig::thresholdLow);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_HIGH] == MyConfig::thresholdHigh);
+  CHECK(regs.regs[OPT4048_REG_CONFIG] == MyConfig::config);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_CFG] == MyConfig::thresholdConfig);
+
+  // The cache follows, so the getters need no bus traffic
+  CHECK(sensor.getRange() == OPT4048_RANGE_AUTO);
+  CHECK(sensor.getConversionTime() == OPT4048_CONVERSION_TIME_1MS);
+  CHECK(sensor.getFaultCount() == OPT4048_FAULT_COUNT_2);
+  CHECK(sensor.getThresholdChannel() == 1);
+  CHECK(Wire.getTransfers() == 1);
+
+  // The thresholds read back rounded outwards
+  CHECK(sensor.getThresholdLow() <= 150000);
+  CHECK(sensor.getThresholdHigh() >= 250000);
+}
+
+TEST(thresholds_round_trip) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  // Codes the registers hold exactly come back as they are, across the
+  // exponents up to that of the largest ADC code
+  const uint32_t exact[] = {0, 0xABC00, 0x100000, 0xFFFUL << 14};
+  for (size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++) {
+    CHECK(sensor.setThresholdLow(exact[i]));
+    CHECK(sensor.getThresholdLow() == exact[i]);
+    CHECK(sensor.setThresholdHigh(exact[i]));
+    CHECK(sensor.getThresholdHigh() == exact[i]);
+  }
+
+  // Others are rounded within one step, down for low and up for high
+  const uint32_t code = 123457;
+  CHECK(sensor.setThresholdLow(code));
+  CHECK(sensor.setThresholdHigh(code));
+  uint32_t low = sensor.getThresholdLow();
+  uint32_t high = sensor.getThresholdHigh();
+  CHECK(low <= code && code - low < 256);
+  CHECK(high >= code && high - code < 256);
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_LOW] ==
+        opt4048_encodeThreshold(code));
+  CHECK(regs.regs[OPT4048_REG_THRESHOLD_HIGH] ==
+        opt4048_encodeThreshold(code, true));
+}
+
+TEST(get_cie_matches_the_math_functions) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  double x, y, lux, ex, ey, elux;
+  CHECK(sensor.getCIE(&x, &y, &lux));
+  CHECK(opt4048_calculateCIE(sample[0], sample[1], sample[2], sample[3], &ex,
+                             &ey, &elux));
+  CHECK_NEAR(x, ex, 1e-6);
+  CHECK_NEAR(y, ey, 1e-6);
+  CHECK_NEAR(lux, elux, 1e-3);
+  CHECK(x > 0 && x < 1 && y > 0 && y < 1 && lux > 0);
+
+  uint16_t fx, fy;
+  uint32_t mlux;
+  CHECK(sensor.getCIEFixed(&fx, &fy, &mlux));
+  CHECK_NEAR(fx / 65536.0, x, 1e-3);
+  CHECK_NEAR(fy / 65536.0, y, 1e-3);
+  CHECK_NEAR(mlux / 1000.0, lux, lux * 1e-3);
+}
+
+TEST(datasheet_calibration_keeps_the_exact_conversions) {
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(nullptr, &cal));
+  CHECK(cal.datasheet);
+
+  // Double coefficients for the double version, 43/20 mlux when fixed
+  double x, y, lux, ex, ey, elux;
+  CHECK(opt4048_calculateCIE(sample, &cal, &x, &y, &lux));
+  CHECK(opt4048_calculateCIE(sample[0], sample[1], sample[2], sample[3], &ex,
+                             &ey, &elux));
+  CHECK_NEAR(x, ex, 1e-15);
+  CHECK_NEAR(y, ey, 1e-15);
+  CHECK(lux == elux && lux == opt4048_calculateLux(sample[1]));
+  CHECK(opt4048_calculateLux(sample, &cal) == lux);
+
+  uint16_t fx, fy, efx, efy;
+  uint32_t mlux, emlux;
+  CHECK(opt4048_calculateCIEFixed(sample, &cal, &fx, &fy, &mlux));
+  CHECK(opt4048_calculateCIEFixed(sample[0], sample[1], sample[2], &efx, &efy,
+                                  &emlux));
+  CHECK(fx == efx && fy == efy && mlux == emlux);
+
+  // The datasheet matrix passed in is recognized, one entry off is not
+  float matrix[4][4] = {{2.34892992e-04f, -1.89652390e-05f, 1.20811684e-05f, 0},
+                        {4.07467441e-05f, 1.98958202e-04f, -1.58848115e-05f,
+                         2.15e-3f},
+                        {9.28619404e-05f, -1.69739553e-05f, 6.74021520e-04f, 0},
+                        {0, 0, 0, 0}};
+  CHECK(opt4048_prepareCalibration(matrix, &cal));
+  CHECK(cal.datasheet);
+  matrix[2][2] *= 1.01f;
+  CHECK(opt4048_prepareCalibration(matrix, &cal));
+  CHECK(!cal.datasheet);
+}
+
+TEST(calibration_reads_only_the_channels_it_uses) {
+  // X, Y and Z from channels 0 and 1, lux from channel 1
+  const float matrix[4][4] = {{2.3e-4f, -1.9e-5f, 1.2e-5f, 0},
+                              {4.1e-5f, 2.0e-4f, -1.6e-5f, 2e-3f},
+                              {0, 0, 0, 0},
+                              {0, 0, 0, 0}};
+  opt4048_calibration_t cal;
+  CHECK(opt4048_prepareCalibration(matrix, &cal));
+  CHECK(cal.xyzChannels == 0x03 && cal.luxChannels == 0x02);
+
+  // Channels 2 and 3 as getCIE() leaves them, unread
+  const uint32_t zeros[4] = {sample[0], sample[1], 0, 0};
+  const uint32_t junk[4] = {sample[0], sample[1], 0xFFFFFFFF, 0xFFFFFFFF};
+
+  double x, y, lux, jx, jy, jlux;
+  CHECK(opt4048_calculateCIE(zeros, &cal, &x, &y, &lux));
+  CHECK(opt4048_calculateCIE(junk, &cal, &jx, &jy, &jlux));
+  CHECK(x == jx && y == jy && lux == jlux);
+  CHECK_NEAR(lux, sample[1] * 2e-3, 1e-3);
+
+  float fx, fy, flux, jfx, jfy, jflux;
+  CHECK(opt4048_calculateCIE(zeros, &cal, &fx, &fy, &flux));
+  CHECK(opt4048_calculateCIE(junk, &cal, &jfx, &jfy, &jflux));
+  CHECK(fx == jfx && fy == jfy && flux == jflux);
+
+  uint16_t qx, qy, jqx, jqy;
+  uint32_t mlux, jmlux;
+  CHECK(opt4048_calculateCIEFixed(zeros, &cal, &qx, &qy, &mlux));
+  CHECK(opt4048_calculateCIEFixed(junk, &cal, &jqx, &jqy, &jmlux));
+  CHECK(qx == jqx && qy == jqy && mlux == jmlux);
+  CHECK_NEAR(qx / 65536.0, x, 1e-4);
+  CHECK_NEAR(mlux / 1000.0, lux, 1e-3);
+}
+
+TEST(get_lux_reads_channel_1_only) {
+  Adafruit_OPT4048 idle;
+  double lux;
+  CHECK(!idle.getLux(&lux));
+
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+  CHECK(sensor.getLux(&lux));
+  CHECK(lux == opt4048_calculateLux(sample[1]));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(Wire.getLog()[0].in.size() == 4);
+}
+
+TEST(get_frame_raw_is_one_undecoded_burst) {
+  OPT4048Registers regs;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &regs));
+
+  uint8_t frame[16];
+  regs.regs[OPT4048_REG_CH3_LSB] ^= 0x0001; // Bad CRC, returned anyway
+  CHECK(sensor.getFrameRaw(frame));
+  CHECK(Wire.getTransfers() == 1);
+  CHECK(frame[0] == regs.regs[0] >> 8 && frame[15] == (regs.regs[7] & 0xFF));
+}
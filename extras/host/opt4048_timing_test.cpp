@@ -0,0 +1,154 @@
+/*!
+ * @file opt4048_timing_test.cpp
+ *
+ * Host tests of sample timestamps and interval statistics, against the
+ * virtual OPT4048 converting continuously every 4 * 600 us.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include "Adafruit_OPT4048.h"
+#include "host_test.h"
+#include "opt4048_sim.h"
+
+#define PERIOD (4 * 600) //!< Continuous conversion interval in us
+
+static const uint32_t light[4] = {100000, 200000, 50000, 30000};
+
+static Adafruit_OPT4048* int_sensor;
+
+static void onDataReady(void) {
+  int_sensor->notifyDataReady();
+}
+
+// Attach a simulator, start continuous conversions ending at every multiple
+// of PERIOD from time 0. Channel 0 of the next one is stored 600 us later,
+// so the tests read in that gap to see whole conversions.
+static bool start(Adafruit_OPT4048* sensor, OPT4048Simulator* sim) {
+  mock_setMicros(0);
+  Wire.attach(OPT4048_DEFAULT_ADDR, sim);
+  Wire.failNext(0);
+  Wire.setClock(0);
+  sim->setLight(light);
+  bool ok = sensor->begin() &&
+            sensor->setConversionTime(OPT4048_CONVERSION_TIME_600US) &&
+            sensor->setQuickWake(true);
+  mock_setMicros(0);
+  ok = ok && sensor->setMode(OPT4048_MODE_CONTINUOUS);
+  Wire.clearLog();
+  return ok;
+}
+
+// Advance the virtual clock to an absolute time and read all channels
+static bool readAt(Adafruit_OPT4048* sensor, OPT4048Simulator* sim,
+                   uint32_t time) {
+  sim->advance(time - micros());
+  uint32_t values[4];
+  return sensor->getChannelsRaw(OPT4048_CHANNEL_ALL, values);
+}
+
+TEST(sample_time_comes_from_the_int_edge) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+  int_sensor = &sensor;
+  sim.setInterruptHandler(onDataReady);
+
+  // However late the read, the sample is stamped with the latest edge
+  CHECK(readAt(&sensor, &sim, 2 * PERIOD + 300));
+  CHECK(sensor.getSampleTime() == 2 * PERIOD);
+  CHECK(readAt(&sensor, &sim, 3 * PERIOD + 500));
+  CHECK(sensor.getSampleTime() == 3 * PERIOD);
+
+  // The edge wins over a duplicate read before it
+  CHECK(readAt(&sensor, &sim, 3 * PERIOD + 550));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_DUPLICATE);
+  CHECK(readAt(&sensor, &sim, 4 * PERIOD + 500));
+  CHECK(sensor.getSampleTime() == 4 * PERIOD);
+
+  // Without an edge since the last sample it falls back to the read time
+  sim.setInterruptHandler(nullptr);
+  CHECK(readAt(&sensor, &sim, 5 * PERIOD + 400));
+  CHECK(sensor.getSampleTime() == 5 * PERIOD + 400);
+}
+
+TEST(sample_time_is_bracketed_by_a_duplicate_read) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+
+  CHECK(readAt(&sensor, &sim, PERIOD + 100));
+  CHECK(sensor.getSampleTime() == PERIOD + 100);
+
+  // Midway between the last read of the old sample and the first of the new
+  CHECK(readAt(&sensor, &sim, PERIOD + 300));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_DUPLICATE);
+  CHECK(sensor.getSampleTime() == PERIOD + 100);
+  CHECK(readAt(&sensor, &sim, PERIOD + 400));
+  CHECK(readAt(&sensor, &sim, 2 * PERIOD + 200));
+  CHECK(sensor.getSampleStatus() == OPT4048_SAMPLE_NEW);
+  CHECK(sensor.getSampleTime() == PERIOD + 400 + (PERIOD - 200) / 2);
+
+  // A duplicate only brackets the sample that follows it
+  CHECK(readAt(&sensor, &sim, 3 * PERIOD + 500));
+  CHECK(sensor.getSampleTime() == 3 * PERIOD + 500);
+}
+
+TEST(timing_stats_measure_the_sample_intervals) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+  opt4048_timing_t stats;
+
+  CHECK(readAt(&sensor, &sim, PERIOD + 100));
+  CHECK(!sensor.getTimingStats(&stats));
+  CHECK(stats.count == 0);
+
+  // Intervals of 2600, 2200, then 7200 over three conversions, then 2500
+  CHECK(readAt(&sensor, &sim, 2 * PERIOD + 300));
+  CHECK(readAt(&sensor, &sim, 3 * PERIOD + 100));
+  CHECK(readAt(&sensor, &sim, 6 * PERIOD + 100));
+  CHECK(sensor.getMissedSamples() == 2);
+  CHECK(readAt(&sensor, &sim, 7 * PERIOD + 200));
+
+  CHECK(sensor.getTimingStats(&stats));
+  CHECK(stats.count == 4);
+  CHECK(stats.nominal == sensor.getMeasurementTime());
+  CHECK(stats.min == 2200);
+  CHECK(stats.max == 2600);
+  CHECK_NEAR(stats.mean, 2425, 0.01);
+  CHECK_NEAR(stats.stddev, sqrt(21875.0), 0.01);
+
+  // After a reset the next sample only starts a new interval
+  sensor.resetTimingStats();
+  CHECK(!sensor.getTimingStats(&stats));
+  CHECK(readAt(&sensor, &sim, 8 * PERIOD + 200));
+  CHECK(!sensor.getTimingStats(&stats));
+  CHECK(readAt(&sensor, &sim, 9 * PERIOD + 200));
+  CHECK(sensor.getTimingStats(&stats));
+  CHECK(stats.count == 1 && stats.min == PERIOD && stats.max == PERIOD);
+}
+
+TEST(timing_stats_from_int_edges_match_the_conversion_time) {
+  OPT4048Simulator sim;
+  Adafruit_OPT4048 sensor;
+  CHECK(start(&sensor, &sim));
+  int_sensor = &sensor;
+  sim.setInterruptHandler(onDataReady);
+
+  // Late and irregular reads, some skipping conversions
+  const uint32_t reads[] = {1, 2, 4, 5, 8, 9, 10, 13};
+  for (size_t i = 0; i < sizeof(reads) / sizeof(reads[0]); i++) {
+    CHECK(readAt(&sensor, &sim, reads[i] * PERIOD + 70 * i));
+  }
+  sim.setInterruptHandler(nullptr);
+
+  opt4048_timing_t stats;
+  CHECK(sensor.getTimingStats(&stats));
+  CHECK(stats.count == 7);
+  CHECK(stats.min == PERIOD && stats.max == PERIOD);
+  CHECK_NEAR(stats.mean, PERIOD, 0.01);
+  CHECK_NEAR(stats.stddev, 0, 0.01);
+  CHECK(sensor.getTotalMissedSamples() == 5);
+}
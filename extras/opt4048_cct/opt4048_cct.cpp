@@ -0,0 +1,269 @@
+/*!
+ * @file opt4048_cct.cpp
+ *
+ * Host side generator, accuracy report and benchmark for the CCT and Duv
+ * lookup table used by opt4048_calculateCCT().
+ *
+ * The Planckian locus is computed here from Planck's law and the CIE 1931
+ * 2 degree color matching functions at 5nm, so the library itself only
+ * carries the finished table and needs no floating point setup at run time.
+ *
+ * Build on Linux from this directory with:
+ *
+ *   g++ -O2 -std=c++11 -I../.. -o opt4048_cct opt4048_cct.cpp
+ *       ../../Adafruit_OPT4048_Math.cpp
+ *
+ * Usage:
+ *
+ *   opt4048_cct          Accuracy report over 1000K-100000K and benchmark
+ *   opt4048_cct -g       Print the table, i.e. Adafruit_OPT4048_CCTTable.h
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "Adafruit_OPT4048_Math.h"
+
+// CIE 1931 2 degree color matching functions, 380nm to 780nm in 5nm steps
+static const double cmfX[81] = {
+    0.001368, 0.002236, 0.004243, 0.007650, 0.014310, 0.023190, 0.043510,
+    0.077630, 0.134380, 0.214770, 0.283900, 0.328500, 0.348280, 0.348060,
+    0.336200, 0.318700, 0.290800, 0.251100, 0.195360, 0.142100, 0.095640,
+    0.057950, 0.032010, 0.014700, 0.004900, 0.002400, 0.009300, 0.029100,
+    0.063270, 0.109600, 0.165500, 0.225750, 0.290400, 0.359700, 0.433450,
+    0.512050, 0.594500, 0.678400, 0.762100, 0.842500, 0.916300, 0.978600,
+    1.026300, 1.056700, 1.062200, 1.045600, 1.002600, 0.938400, 0.854450,
+    0.751400, 0.642400, 0.541900, 0.447900, 0.360800, 0.283500, 0.218700,
+    0.164900, 0.121200, 0.087400, 0.063600, 0.046770, 0.032900, 0.022700,
+    0.015840, 0.011359, 0.008111, 0.005790, 0.004109, 0.002899, 0.002049,
+    0.001440, 0.001000, 0.000690, 0.000476, 0.000332, 0.000235, 0.000166,
+    0.000117, 0.000083, 0.000059, 0.000042};
+static const double cmfY[81] = {
+    0.000039, 0.000064, 0.000120, 0.000217, 0.000396, 0.000640, 0.001210,
+    0.002180, 0.004000, 0.007300, 0.011600, 0.016840, 0.023000, 0.029800,
+    0.038000, 0.048000, 0.060000, 0.073900, 0.090980, 0.112600, 0.139020,
+    0.169300, 0.208020, 0.258600, 0.323000, 0.407300, 0.503000, 0.608200,
+    0.710000, 0.793200, 0.862000, 0.914850, 0.954000, 0.980300, 0.994950,
+    1.000000, 0.995000, 0.978600, 0.952000, 0.915400, 0.870000, 0.816300,
+    0.757000, 0.694900, 0.631000, 0.566800, 0.503000, 0.441200, 0.381000,
+    0.321000, 0.265000, 0.217000, 0.175000, 0.138200, 0.107000, 0.081600,
+    0.061000, 0.044580, 0.032000, 0.023200, 0.017000, 0.011920, 0.008210,
+    0.005723, 0.004102, 0.002929, 0.002091, 0.001484, 0.001047, 0.000740,
+    0.000520, 0.000361, 0.000249, 0.000172, 0.000120, 0.000085, 0.000060,
+    0.000042, 0.000030, 0.000021, 0.000015};
+static const double cmfZ[81] = {
+    0.006450, 0.010550, 0.020050, 0.036210, 0.067850, 0.110200, 0.207400,
+    0.371300, 0.645600, 1.039050, 1.385600, 1.622960, 1.747060, 1.782600,
+    1.772110, 1.744100, 1.669200, 1.528100, 1.287640, 1.041900, 0.812950,
+    0.616200, 0.465180, 0.353300, 0.272000, 0.212300, 0.158200, 0.111700,
+    0.078250, 0.057250, 0.042160, 0.029840, 0.020300, 0.013400, 0.008750,
+    0.005750, 0.003900, 0.002750, 0.002100, 0.001800, 0.001650, 0.001400,
+    0.001100, 0.001000, 0.000800, 0.000600, 0.000340, 0.000240, 0.000190,
+    0.000100, 0.000050, 0.000030, 0.000020, 0.000010};
+
+// Table layout: geometric mired steps from 100000K down to 1000K
+static const int kEntries = 128;
+static const double kMiredMin = 10;
+static const double kMiredMax = 1000;
+
+/**
+ * @brief Compute the CIE 1960 u,v of a black body
+ *
+ * @param mired Temperature in mired (1e6 / K), 0 for infinite temperature
+ * @param u Pointer to store u in
+ * @param v Pointer to store v in
+ */
+static void locus(double mired, double* u, double* v) {
+  double X = 0, Y = 0, Z = 0;
+  for (int i = 0; i < 81; i++) {
+    double l = (380 + 5 * i) * 1e-9;
+    // Planck's law; at infinite temperature the spectrum tends to l^-4
+    double w = mired > 0 ? pow(l, -5) / expm1(1.4388e-2 * mired / (l * 1e6))
+                         : pow(l, -4);
+    X += cmfX[i] * w;
+    Y += cmfY[i] * w;
+    Z += (i < 54 ? cmfZ[i] : 0) * w;
+  }
+  double d = X + 15 * Y + 3 * Z;
+  *u = 4 * X / d;
+  *v = 6 * Y / d;
+}
+
+/**
+ * @brief Compute the unit tangent of the locus towards lower temperatures
+ *
+ * @param mired Temperature in mired
+ * @param tu Pointer to store the u component in
+ * @param tv Pointer to store the v component in
+ */
+static void tangent(double mired, double* tu, double* tv) {
+  double u0, v0, u1, v1;
+  locus(mired - 0.01, &u0, &v0);
+  locus(mired + 0.01, &u1, &v1);
+  double n = hypot(u1 - u0, v1 - v0);
+  *tu = (u1 - u0) / n;
+  *tv = (v1 - v0) / n;
+}
+
+static double miredAt(int i) {
+  return kMiredMin * pow(kMiredMax / kMiredMin, (double)i / (kEntries - 1));
+}
+
+static void generate(void) {
+  printf("/*!\n"
+         " * @file Adafruit_OPT4048_CCTTable.h\n"
+         " *\n"
+         " * Planckian locus table for opt4048_calculateCCT(), generated by\n"
+         " * extras/opt4048_cct with \"opt4048_cct -g\". Do not edit.\n"
+         " *\n"
+         " * Written by Limor Fried/Ladyada for Adafruit Industries.\n"
+         " *\n"
+         " * MIT license, all text here must be included in any "
+         "redistribution.\n"
+         " *\n"
+         " */\n\n"
+         "#ifndef ADAFRUIT_OPT4048_CCTTABLE_H\n"
+         "#define ADAFRUIT_OPT4048_CCTTABLE_H\n\n"
+         "#if defined(__AVR__)\n"
+         "#include <avr/pgmspace.h>\n"
+         "#endif\n"
+         "#ifndef PROGMEM\n"
+         "#define PROGMEM\n"
+         "#endif\n\n"
+         "/**\n"
+         " * @brief One isotemperature line of the locus, in CIE 1960 u,v\n"
+         " */\n"
+         "typedef struct {\n"
+         "  float mired; ///< Temperature in mired (1e6 / K)\n"
+         "  float u;     ///< u of the locus\n"
+         "  float v;     ///< v of the locus\n"
+         "  float tu;    ///< u of the unit tangent towards lower K\n"
+         "  float tv;    ///< v of the unit tangent towards lower K\n"
+         "} opt4048_cct_entry_t;\n\n"
+         "#define OPT4048_CCT_ENTRIES %d //!< Entries in opt4048_cctTable\n\n"
+         "// %.0fK to %.0fK in steps of %.2f%%\n"
+         "static const opt4048_cct_entry_t opt4048_cctTable[] PROGMEM = {\n",
+         kEntries, 1e6 / kMiredMin, 1e6 / kMiredMax,
+         (pow(kMiredMax / kMiredMin, 1.0 / (kEntries - 1)) - 1) * 100);
+  for (int i = 0; i < kEntries; i++) {
+    double m = miredAt(i), u, v, tu, tv;
+    locus(m, &u, &v);
+    tangent(m, &tu, &tv);
+    printf("    {%.9g, %.9g, %.9g, %.9g, %.9g},\n", m, u, v, tu, tv);
+  }
+  printf("};\n\n#endif // ADAFRUIT_OPT4048_CCTTABLE_H\n");
+}
+
+/**
+ * @brief Chromaticity at a given distance from the locus
+ *
+ * @param K Temperature in Kelvin
+ * @param duv Signed distance from the locus in u,v, positive above it
+ * @param x Pointer to store CIE x in
+ * @param y Pointer to store CIE y in
+ */
+static void chromaticity(double K, double duv, double* x, double* y) {
+  double u, v, tu, tv;
+  locus(1e6 / K, &u, &v);
+  tangent(1e6 / K, &tu, &tv);
+  u -= duv * tv;
+  v += duv * tu;
+  double d = 2 * u - 8 * v + 4;
+  *x = 3 * u / d;
+  *y = 2 * v / d;
+}
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int report(void) {
+  static const double bands[] = {1000, 2000, 4000, 10000, 30000, 100000};
+  static const double duvs[] = {-0.02, -0.005, 0, 0.005, 0.02};
+
+  printf("Accuracy of opt4048_calculateCCT<float> against the exact locus\n");
+  printf("%-16s %12s %12s %12s %12s\n", "range", "max |dK|", "max dK/K",
+         "max |dDuv|", "McCamy dK/K");
+
+  std::vector<float> xs, ys;
+  for (int b = 0; b < 5; b++) {
+    double maxK = 0, maxRel = 0, maxDuv = 0, maxMcCamy = 0;
+    for (int i = 0; i <= 200; i++) {
+      double K = bands[b] * pow(bands[b + 1] / bands[b], i / 200.0);
+      K = fmin(fmax(K, 1000.5), 99900);
+      for (double duv : duvs) {
+        double x, y;
+        chromaticity(K, duv, &x, &y);
+        xs.push_back(x);
+        ys.push_back(y);
+
+        float cct, d;
+        if (!opt4048_calculateCCT((float)x, (float)y, &cct, &d)) {
+          printf("no result for %.0fK Duv %.3f\n", K, duv);
+          return 1;
+        }
+        maxK = fmax(maxK, fabs(cct - K));
+        maxRel = fmax(maxRel, fabs(cct - K) / K);
+        maxDuv = fmax(maxDuv, fabs(d - duv));
+        if (duv == 0) {
+          double mc = opt4048_calculateColorTemperature(x, y);
+          maxMcCamy = fmax(maxMcCamy, fabs(mc - K) / K);
+        }
+      }
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%.0f-%.0fK", bands[b], bands[b + 1]);
+    printf("%-16s %12.3f %12.2e %12.2e %12.2e\n", name, maxK, maxRel, maxDuv,
+           maxMcCamy);
+  }
+
+  // Time both methods over the same points, many times over
+  const int reps = 2000;
+  size_t n = xs.size();
+  volatile float sink = 0;
+
+  double start = seconds();
+  for (int r = 0; r < reps; r++) {
+    for (size_t i = 0; i < n; i++) {
+      float cct, duv;
+      opt4048_calculateCCT(xs[i], ys[i], &cct, &duv);
+      sink = sink + cct;
+    }
+  }
+  double lut = (seconds() - start) / (reps * n) * 1e9;
+
+  start = seconds();
+  for (int r = 0; r < reps; r++) {
+    for (size_t i = 0; i < n; i++) {
+      sink = sink + opt4048_calculateColorTemperature(xs[i], ys[i]);
+    }
+  }
+  double mccamy = (seconds() - start) / (reps * n) * 1e9;
+
+  printf("\nfloat, ns/sample: table CCT+Duv %.1f, McCamy CCT only %.1f\n", lut,
+         mccamy);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "-g") == 0) {
+    generate();
+    return 0;
+  }
+  if (argc > 1) {
+    fprintf(stderr, "usage: %s [-g]\n", argv[0]);
+    return 2;
+  }
+  return report();
+}
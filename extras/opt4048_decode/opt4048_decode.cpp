@@ -0,0 +1,341 @@
+/*!
+ * @file opt4048_decode.cpp
+ *
+ * Host side decoder for the binary stream sent by the opt4048_webserial
+ * example with BINARY_STREAM enabled, see Adafruit_OPT4048_Stream.h.
+ *
+ * Reads frames from a serial port, a pipe or a recorded capture file,
+ * resynchronizes on damaged data and converts raw channels with the same
+ * math as Adafruit_OPT4048::getCIE(). Output is CSV, or a columnar binary
+ * file for fast loading into analysis tools.
+ *
+ * Build on Linux from this directory with:
+ *
+ *   g++ -O2 -std=c++11 -I../.. -o opt4048_decode opt4048_decode.cpp
+ *       ../../Adafruit_OPT4048_Stream.cpp ../../Adafruit_OPT4048_Math.cpp
+ *
+ * or as build/opt4048_decode with the host build in extras/host.
+ *
+ * Usage:
+ *
+ *   opt4048_decode [-b baud] [-c] [-o output] [input]
+ *   opt4048_decode -B frames
+ *
+ *   input      Capture file or serial device, stdin if omitted or "-"
+ *   -b baud    Line speed to set when input is a serial device
+ *   -c         Write the columnar binary format instead of CSV
+ *   -o output  Output file, stdout if omitted
+ *   -B frames  Benchmark decoding a generated capture of this many frames,
+ *              failing if any frame other than a corrupted one goes missing
+ *
+ * The columnar format is "OPT4048C", a little endian u32 version (1) and a
+ * u32 sample count N, followed by one column after another, each N values:
+ * timestamp (u32, us), X, Y, Z, W codes (u32), then X, Y, Z, lux, CIE x,
+ * CIE y and CCT (f32). Fixed point frames have zero codes and X, Y, Z.
+ *
+ * Written by Limor Fried/Ladyada for Adafruit Industries.
+ *
+ * MIT license, all text here must be included in any redistribution.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "Adafruit_OPT4048_Math.h"
+#include "Adafruit_OPT4048_Stream.h"
+
+/**
+ * @brief Decoded samples kept in memory for the columnar output
+ */
+struct Columns {
+  std::vector<uint32_t> timestamp; ///< Sample times in microseconds
+  std::vector<uint32_t> code[4];   ///< ADC codes per channel
+  std::vector<float> fixedX;       ///< CIE x of fixed frames, else -1
+  std::vector<float> fixedY;       ///< CIE y of fixed frames
+  std::vector<float> fixedLux;     ///< Lux of fixed frames
+};
+
+static speed_t baudConstant(long baud) {
+  switch (baud) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 460800:
+      return B460800;
+    case 921600:
+      return B921600;
+    default:
+      return 0;
+  }
+}
+
+static bool setupSerial(int fd, long baud) {
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) {
+    return true; // Not a terminal, e.g. a file or a pipe
+  }
+
+  speed_t speed = baudConstant(baud);
+  if (!speed) {
+    fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+    return false;
+  }
+
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static void writeCSV(FILE* out, const opt4048_stream_sample_t* s) {
+  double CIEx, CIEy, lux;
+
+  if (s->type == OPT4048_STREAM_FIXED) {
+    CIEx = s->CIEx / 65536.0;
+    CIEy = s->CIEy / 65536.0;
+    lux = s->milliLux / 1000.0;
+    fprintf(out, "%u,%lu,,,,,", s->seq, (unsigned long)s->timestamp);
+  } else {
+    if (!opt4048_calculateCIE(s->values[0], s->values[1], s->values[2], 0,
+                              &CIEx, &CIEy, &lux)) {
+      CIEx = CIEy = lux = 0;
+    }
+    fprintf(out, "%u,%lu,%lu,%lu,%lu,%lu,", s->seq,
+            (unsigned long)s->timestamp, (unsigned long)s->values[0],
+            (unsigned long)s->values[1], (unsigned long)s->values[2],
+            (unsigned long)s->values[3]);
+  }
+
+  double cct = lux > 0 ? opt4048_calculateColorTemperature(CIEx, CIEy) : 0;
+  fprintf(out, "%.6f,%.6f,%.4f,%.1f\n", CIEx, CIEy, lux, cct);
+}
+
+static void addColumns(Columns* cols, const opt4048_stream_sample_t* s) {
+  bool fixed = s->type == OPT4048_STREAM_FIXED;
+
+  cols->timestamp.push_back(s->timestamp);
+  for (int ch = 0; ch < 4; ch++) {
+    cols->code[ch].push_back(fixed ? 0 : s->values[ch]);
+  }
+  cols->fixedX.push_back(fixed ? s->CIEx / 65536.0f : -1);
+  cols->fixedY.push_back(fixed ? s->CIEy / 65536.0f : 0);
+  cols->fixedLux.push_back(fixed ? s->milliLux / 1000.0f : 0);
+}
+
+static bool writeColumns(FILE* out, Columns* cols) {
+  size_t n = cols->timestamp.size();
+  std::vector<float> result[7];
+  for (int i = 0; i < 7; i++) {
+    result[i].resize(n);
+  }
+
+  opt4048_batch_t batch = {result[0].data(), result[1].data(),
+                           result[2].data(), result[3].data(),
+                           result[4].data(), result[5].data(),
+                           result[6].data()};
+  opt4048_convertBatch(cols->code[0].data(), cols->code[1].data(),
+                       cols->code[2].data(), n, &batch);
+
+  // Fixed point frames carry x, y and lux instead of codes
+  for (size_t i = 0; i < n; i++) {
+    if (cols->fixedX[i] >= 0) {
+      batch.CIEx[i] = cols->fixedX[i];
+      batch.CIEy[i] = cols->fixedY[i];
+      batch.lux[i] = cols->fixedLux[i];
+      batch.CCT[i] = batch.lux[i] > 0 ? opt4048_calculateColorTemperature(
+                                            batch.CIEx[i], batch.CIEy[i])
+                                      : 0;
+    }
+  }
+
+  // The column data is written in host byte order, little endian on every
+  // platform this tool is meant for
+  uint32_t header[2] = {1, (uint32_t)n};
+  bool ok = fwrite("OPT4048C", 1, 8, out) == 8 &&
+            fwrite(header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(cols->timestamp.data(), 4, n, out) == n;
+  for (int ch = 0; ch < 4; ch++) {
+    ok = ok && fwrite(cols->code[ch].data(), 4, n, out) == n;
+  }
+  for (int i = 0; i < 7; i++) {
+    ok = ok && fwrite(result[i].data(), 4, n, out) == n;
+  }
+  return ok;
+}
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int benchmark(long frames) {
+  // Generate a capture like the sketch sends it: a slow random walk at the
+  // 2.4ms sample period, delta encoded, with some line noise mixed in
+  std::vector<uint8_t> capture;
+  capture.reserve(frames * OPT4048_STREAM_MAX_FRAME);
+
+  Adafruit_OPT4048_StreamEncoder encoder;
+  encoder.setDelta(true);
+  uint32_t values[4] = {300000, 320000, 250000, 400000};
+  uint8_t frame[OPT4048_STREAM_MAX_FRAME];
+  long corrupted = 0;
+  srand(1);
+
+  for (long i = 0; i < frames; i++) {
+    for (int ch = 0; ch < 4; ch++) {
+      values[ch] += rand() % 201 - 100;
+    }
+    size_t len = encoder.encodeRaw(values, i * 2400, frame);
+    if (i % 10000 == 5000 && i + 1 < frames) {
+      frame[len / 2] ^= 0x10; // Corrupt one frame in 10000, never the last
+      corrupted++;
+    }
+    capture.insert(capture.end(), frame, frame + len);
+  }
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  opt4048_stream_sample_t sample;
+  long decoded = 0;
+  double checksum = 0;
+
+  double start = seconds();
+  for (size_t i = 0; i < capture.size(); i++) {
+    if (decoder.push(capture[i], &sample)) {
+      double CIEx, CIEy, lux;
+      opt4048_calculateCIE(sample.values[0], sample.values[1],
+                           sample.values[2], 0, &CIEx, &CIEy, &lux);
+      checksum += CIEx;
+      decoded++;
+    }
+  }
+  double elapsed = seconds() - start;
+
+  double mbps = capture.size() / elapsed / 1e6;
+  printf("%ld frames, %zu bytes in %.3f s (checksum %.3f)\n", frames,
+         capture.size(), elapsed, checksum);
+  printf("decoded %ld, CRC errors %lu, lost %lu, undecodable %lu\n", decoded,
+         (unsigned long)decoder.getCRCErrors(),
+         (unsigned long)decoder.getLostFrames(),
+         (unsigned long)decoder.getUndecodableFrames());
+  printf("%.1f Mframes/s, %.1f MB/s, %.0fx a 115200 baud line\n",
+         decoded / elapsed / 1e6, mbps, mbps * 1e6 / 11520);
+
+  // Every frame must be accounted for, and only the corrupted ones lost
+  long lost = decoder.getLostFrames();
+  long undecodable = decoder.getUndecodableFrames();
+  if (decoded + lost + undecodable != frames || lost != corrupted) {
+    fprintf(stderr, "FAIL: frames went missing\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  long baud = 115200;
+  bool columnar = false;
+  const char* outPath = nullptr;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:co:B:")) != -1) {
+    switch (opt) {
+      case 'b':
+        baud = atol(optarg);
+        break;
+      case 'c':
+        columnar = true;
+        break;
+      case 'o':
+        outPath = optarg;
+        break;
+      case 'B':
+        return benchmark(atol(optarg));
+      default:
+        fprintf(stderr,
+                "usage: %s [-b baud] [-c] [-o output] [input]\n"
+                "       %s -B frames\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+  }
+
+  int fd = 0;
+  if (optind < argc && strcmp(argv[optind], "-") != 0) {
+    fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+  if (!setupSerial(fd, baud)) {
+    return 1;
+  }
+
+  FILE* out = stdout;
+  if (outPath) {
+    out = fopen(outPath, "wb");
+    if (!out) {
+      perror(outPath);
+      return 1;
+    }
+  }
+  if (!columnar) {
+    fprintf(out, "seq,timestamp_us,x_code,y_code,z_code,w_code,"
+                 "CIEx,CIEy,lux,CCT\n");
+  }
+
+  Adafruit_OPT4048_StreamDecoder decoder;
+  opt4048_stream_sample_t sample;
+  Columns cols;
+  uint8_t buf[65536];
+  ssize_t len;
+
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < len; i++) {
+      if (!decoder.push(buf[i], &sample)) {
+        continue;
+      }
+      if (columnar) {
+        addColumns(&cols, &sample);
+      } else {
+        writeCSV(out, &sample);
+      }
+    }
+  }
+
+  if (columnar && !writeColumns(out, &cols)) {
+    perror("write");
+    return 1;
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  fprintf(stderr,
+          "skipped %lu bytes, %lu CRC errors, %lu lost frames, "
+          "%lu undecodable\n",
+          (unsigned long)decoder.getSkippedBytes(),
+          (unsigned long)decoder.getCRCErrors(),
+          (unsigned long)decoder.getLostFrames(),
+          (unsigned long)decoder.getUndecodableFrames());
+  return 0;
+}